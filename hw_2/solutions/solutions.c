@@ -40,6 +40,41 @@ int num_occurences(int* arr, int len, int val) {
     return count;
 }
 
+// open addressing set of ints for remove_duplicates, linear probing.
+// capacity is a power of two with at least twice the slots of the input
+// so probe runs stay short
+typedef struct {
+    int* keys;
+    char* used;
+    size_t mask;
+    int shift;  // 64 - log2(capacity)
+} IntSet;
+
+// multiply by 2^64 / golden ratio and keep the top log2(capacity) bits,
+// the low bits of the product only depend on the low bits of x
+static size_t hash_int(const IntSet* set, int x) {
+    return (size_t)(((unsigned long long)(unsigned)x * 0x9E3779B97F4A7C15ULL) >> set->shift);
+}
+
+// returns 1 if x was added, 0 if it was already there
+static int int_set_insert(IntSet* set, int x) {
+    size_t i = hash_int(set, x);
+    while (set->used[i]) {
+        if (set->keys[i] == x) return 0;
+        i = (i + 1) & set->mask;
+    }
+    set->used[i] = 1;
+    set->keys[i] = x;
+    return 1;
+}
+
+static int is_sorted(const int* arr, int len) {
+    for (int i = 1; i < len; i++) {
+        if (arr[i - 1] > arr[i]) return 0;
+    }
+    return 1;
+}
+
 int* remove_duplicates(int* arr, int len, int* new_len) {
     if (!arr || len <= 0) {
         *new_len = 0;
@@ -47,23 +82,53 @@ int* remove_duplicates(int* arr, int len, int* new_len) {
     }
     
     // just malloc enough space
-    int* res = (int*)malloc(len * sizeof(int));
+    int* res = (int*)malloc((size_t)len * sizeof(int));
     int k = 0;
+    if (!res) {
+        *new_len = 0;
+        return NULL;
+    }
 
-    for (int i = 0; i < len; i++) {
-        int found = 0;
-        for (int j = 0; j < k; j++) {
-            if (res[j] == arr[i]) {
-                found = 1;
-                break;
+    if (is_sorted(arr, len)) {
+        // duplicates are next to each other, no set needed
+        for (int i = 0; i < len; i++) {
+            if (k == 0 || res[k - 1] != arr[i]) {
+                res[k++] = arr[i];
             }
         }
-        if (!found) {
-            res[k] = arr[i];
-            k++;
+        *new_len = k;
+        return res;
+    }
+
+    // size_t, for len > 2^30 an unsigned capacity would double past
+    // 2^31 to 0 and never get there
+    size_t capacity = 16;
+    int bits = 4;
+    while (capacity < 2 * (size_t)len) {
+        capacity *= 2;
+        bits++;
+    }
+    IntSet set;
+    set.keys = (int*)malloc(capacity * sizeof(int));
+    set.used = (char*)calloc(capacity, 1);
+    if (!set.keys || !set.used) {
+        free(set.keys);
+        free(set.used);
+        free(res);
+        *new_len = 0;
+        return NULL;
+    }
+    set.mask = capacity - 1;
+    set.shift = 64 - bits;
+
+    for (int i = 0; i < len; i++) {
+        if (int_set_insert(&set, arr[i])) {
+            res[k++] = arr[i];
         }
     }
 
+    free(set.keys);
+    free(set.used);
     *new_len = k;
     return res;
 }
@@ -83,15 +148,36 @@ char* string_reverse(const char* str) {
     return res;
 }
 
+#define TRANSPOSE_BLOCK 32
+
+// same cache-oblivious kernel as hw_4/transpose.h: keep halving the
+// bigger side until the block fits in cache, then do the plain loop.
+// lds/ldd are the row lengths of the full source/destination
+static void transpose_block(const int* src, int rows, int cols, int lds,
+                            int* dst, int ldd) {
+    if (rows <= TRANSPOSE_BLOCK && cols <= TRANSPOSE_BLOCK) {
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                dst[c * ldd + r] = src[r * lds + c];
+            }
+        }
+    } else if (rows >= cols) {
+        int half = rows / 2;
+        transpose_block(src, half, cols, lds, dst, ldd);
+        transpose_block(src + half * lds, rows - half, cols, lds, dst + half, ldd);
+    } else {
+        int half = cols / 2;
+        transpose_block(src, rows, half, lds, dst, ldd);
+        transpose_block(src + half, rows, cols - half, lds, dst + half * ldd, ldd);
+    }
+}
+
 int* transpose(int* matrix, int rows, int cols) {
     if (!matrix || rows <= 0 || cols <= 0) return NULL;
 
     int* res = (int*)malloc(rows * cols * sizeof(int));
-    
-    for (int r = 0; r < rows; r++) {
-        for (int c = 0; c < cols; c++) {
-            res[c * rows + r] = matrix[r * cols + c];
-        }
+    if (res) {
+        transpose_block(matrix, rows, cols, cols, res, rows);
     }
     return res;
 }
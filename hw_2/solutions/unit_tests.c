@@ -51,8 +51,63 @@ TEST(HW2, RemoveDuplicates) {
     free(result);
 }
 
+TEST(HW2, RemoveDuplicatesLarge) {
+    // enough values to make the hash set probe and collide, first
+    // occurrences have to stay in order
+    int len = 100000;
+    int* a = (int*)malloc(len * sizeof(int));
+    for (int i = 0; i < len; i++) {
+        a[i] = (int)((i * 7919LL) % 1000) * 65536 - 3;
+    }
+    int new_len;
+    int* result = remove_duplicates(a, len, &new_len);
+    ASSERT_EQ(new_len, 1000);
+    for (int i = 0; i < new_len; i++) {
+        ASSERT_EQ(result[i], a[i]);
+    }
+    free(result);
+
+    // sorted input takes the linear path
+    for (int i = 0; i < len; i++) {
+        a[i] = i / 3 - 100;
+    }
+    result = remove_duplicates(a, len, &new_len);
+    ASSERT_EQ(new_len, (len - 1) / 3 + 1);
+    for (int i = 0; i < new_len; i++) {
+        ASSERT_EQ(result[i], i - 100);
+    }
+    free(result);
+    free(a);
+}
+
 TEST(HW2, StringReverse) {
     char *result = string_reverse("hello");
     ASSERT_STREQ(result, "olleh");
     free(result);
-}
\ No newline at end of file
+}
+
+TEST(HW2, Transpose) {
+    int m[] = {1, 2, 3,
+               4, 5, 6};
+    int* t = transpose(m, 2, 3);
+    ASSERT_EQ(t[0], 1);
+    ASSERT_EQ(t[1], 4);
+    ASSERT_EQ(t[2], 2);
+    ASSERT_EQ(t[5], 6);
+    free(t);
+
+    // big enough to go through the blocked path
+    int rows = 70, cols = 45;
+    int* big = (int*)malloc(rows * cols * sizeof(int));
+    for (int i = 0; i < rows * cols; i++) {
+        big[i] = i;
+    }
+    t = transpose(big, rows, cols);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            ASSERT_EQ(t[c * rows + r], big[r * cols + c]);
+        }
+    }
+    free(t);
+    free(big);
+}
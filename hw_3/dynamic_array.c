@@ -1,6 +1,7 @@
 #include "dynamic_array.h"
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,25 +25,65 @@ static int offset_to_index(const DynamicArray *da, int offset) {
   return offset - da->origin;
 }
 
-static int out_of_buffer(DynamicArray *da, int offset) {
-  return offset < 0 || offset >= da->capacity;
-}
+static int max_int(int a, int b) { return a > b ? a : b; }
 
-static void extend_buffer(DynamicArray *da) {
-  double *temp = (double *)calloc(2 * da->capacity, sizeof(double));
-  int new_origin = da->capacity - (da->end - da->origin) / 2,
-      new_end = new_origin + (da->end - da->origin);
+static int min_int(int a, int b) { return a < b ? a : b; }
 
-  for (int i = 0; i < DynamicArray_size(da); i++) {
-    temp[new_origin + i] = DynamicArray_get(da, i);
-  }
+// slack added on one side when it runs out: growth - 1 times the size,
+// so pushing n elements costs O(n) copies in total
+static int growth_slack(const DynamicArray *da) {
+  int size = da->end - da->origin;
+  return max_int((int)(size * (da->growth - 1.0)),
+                 DYNAMIC_ARRAY_INITIAL_CAPACITY);
+}
 
-  free(da->buffer);
+static void resize_buffer(DynamicArray *da, int new_capacity) {
+  double *temp = (double *)realloc(da->buffer, new_capacity * sizeof(double));
+  assert(temp != NULL);
   da->buffer = temp;
+  da->capacity = new_capacity;
+}
 
-  da->capacity = 2 * da->capacity;
+// move the elements so they start at new_origin, the buffer has to be
+// big enough already
+static void move_elements(DynamicArray *da, int new_origin) {
+  int size = da->end - da->origin;
+  memmove(da->buffer + new_origin, da->buffer + da->origin,
+          size * sizeof(double));
   da->origin = new_origin;
-  da->end = new_end;
+  da->end = new_origin + size;
+}
+
+// make offsets up to min_end - 1 valid. when more than half the buffer
+// is unused space in front (pop_front has been eating it, e.g. a
+// queue) the elements slide down into it, otherwise the buffer grows at
+// the back only and the front slack stays as it is. either way the cost
+// is paid for by at least size more pushes
+static void grow_back(DynamicArray *da, int min_end) {
+  int new_origin = min_int(da->origin / 2, DYNAMIC_ARRAY_INITIAL_CAPACITY);
+  if (da->origin >= da->capacity / 2 &&
+      min_end - da->origin + new_origin <= da->capacity) {
+    move_elements(da, new_origin);
+    return;
+  }
+  resize_buffer(da, max_int(min_end, da->capacity + growth_slack(da)));
+}
+
+// make room for at least one more element in front. same as grow_back
+// the other way around: slide up into a mostly unused back, or grow the
+// front slack with realloc and one memmove
+static void grow_front(DynamicArray *da) {
+  int size = da->end - da->origin;
+  int back_slack = da->capacity - da->end;
+  int new_origin = da->capacity - size -
+                   min_int(back_slack / 2, DYNAMIC_ARRAY_INITIAL_CAPACITY);
+  if (back_slack >= da->capacity / 2 && new_origin > 0) {
+    move_elements(da, new_origin);
+    return;
+  }
+  int slack = growth_slack(da);
+  resize_buffer(da, da->capacity + slack);
+  move_elements(da, da->origin + slack);
 }
 
 DynamicArray *DynamicArray_new(void) {
@@ -51,9 +92,30 @@ DynamicArray *DynamicArray_new(void) {
   da->buffer = (double *)calloc(da->capacity, sizeof(double));
   da->origin = da->capacity / 2;
   da->end = da->origin;
+  da->growth = DYNAMIC_ARRAY_GROWTH_FACTOR;
   return da;
 }
 
+void DynamicArray_set_growth_factor(DynamicArray *da, double factor) {
+  assert(factor > 1.0);
+  da->growth = factor;
+}
+
+void DynamicArray_reserve(DynamicArray *da, int n) {
+  assert(da->buffer != NULL);
+  if (da->origin + n > da->capacity) {
+    resize_buffer(da, da->origin + n);
+  }
+}
+
+void DynamicArray_shrink_to_fit(DynamicArray *da) {
+  assert(da->buffer != NULL);
+  int size = DynamicArray_size(da);
+  move_elements(da, 0);
+  // never down to 0, realloc could hand back NULL for that
+  resize_buffer(da, max_int(size, 1));
+}
+
 void DynamicArray_destroy(DynamicArray *da) {
   if (da == NULL)
     return;
@@ -104,13 +166,16 @@ void DynamicArray_print_debug_info(const DynamicArray *da) {
 void DynamicArray_set(DynamicArray *da, int index, double value) {
   assert(da->buffer != NULL);
   assert(index >= 0);
-  while (out_of_buffer(da, index_to_offset(da, index))) {
-    extend_buffer(da);
+  if (index_to_offset(da, index) >= da->capacity) {
+    grow_back(da, index_to_offset(da, index + 1));
   }
-  da->buffer[index_to_offset(da, index)] = value;
   if (index >= DynamicArray_size(da)) {
+    // realloc doesnt zero anything, the gap has to read back as 0
+    int gap = index - DynamicArray_size(da);
+    memset(da->buffer + da->end, 0, gap * sizeof(double));
     da->end = index_to_offset(da, index + 1);
   }
+  da->buffer[index_to_offset(da, index)] = value;
 }
 
 double DynamicArray_get(const DynamicArray *da, int index) {
@@ -124,16 +189,21 @@ double DynamicArray_get(const DynamicArray *da, int index) {
 }
 
 void DynamicArray_push(DynamicArray *da, double value) {
-  DynamicArray_set(da, DynamicArray_size(da), value);
+  assert(da->buffer != NULL);
+  if (da->end == da->capacity) {
+    grow_back(da, da->end + 1);
+  }
+  da->buffer[da->end] = value;
+  da->end++;
 }
 
 void DynamicArray_push_front(DynamicArray *da, double value) {
   assert(da->buffer != NULL);
-  while (da->origin == 0) {
-    extend_buffer(da);
+  if (da->origin == 0) {
+    grow_front(da);
   }
   da->origin--;
-  DynamicArray_set(da, 0, value);
+  da->buffer[da->origin] = value;
 }
 
 double DynamicArray_pop(DynamicArray *da) {
@@ -154,6 +224,7 @@ double DynamicArray_pop_front(DynamicArray *da) {
 DynamicArray *DynamicArray_map(const DynamicArray *da, double (*f)(double)) {
   assert(da->buffer != NULL);
   DynamicArray *result = DynamicArray_new();
+  DynamicArray_reserve(result, DynamicArray_size(da));
   for (int i = 0; i < DynamicArray_size(da); i++) {
     DynamicArray_set(result, i, f(DynamicArray_get(da, i)));
   }
@@ -201,48 +272,301 @@ double DynamicArray_mean(const DynamicArray *da) {
   return DynamicArray_sum(da) / DynamicArray_size(da);
 }
 
-// bubble sort helper for median
-void sort_array(double arr[], int len) {
-  int i, j;
-  double temp;
-  for (i = 0; i < len - 1; i++) {
-    for (j = 0; j < len - i - 1; j++) {
-      if (arr[j] > arr[j + 1]) {
-        // swap them
-        temp = arr[j];
-        arr[j] = arr[j + 1];
-        arr[j + 1] = temp;
-      }
+/* ======= sorting and selection ======= */
+
+// below this many elements insertion sort beats partitioning
+#define INSERTION_SORT_MAX 16
+
+// from this many elements up DynamicArray_sort uses the radix sort
+#define RADIX_SORT_MIN 1024
+
+static void swap_doubles(double *a, double *b) {
+  double temp = *a;
+  *a = *b;
+  *b = temp;
+}
+
+static void insertion_sort(double *a, int n) {
+  for (int i = 1; i < n; i++) {
+    double x = a[i];
+    int j = i;
+    for (; j > 0 && a[j - 1] > x; j--) {
+      a[j] = a[j - 1];
     }
+    a[j] = x;
   }
 }
 
+static void sift_down(double *a, int n, int i) {
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= n) {
+      return;
+    }
+    if (child + 1 < n && a[child + 1] > a[child]) {
+      child++;
+    }
+    if (!(a[child] > a[i])) {
+      return;
+    }
+    swap_doubles(a + i, a + child);
+    i = child;
+  }
+}
+
+// the fallback when quicksort keeps picking bad pivots, O(n log n) no
+// matter what the input is
+static void heap_sort(double *a, int n) {
+  for (int i = n / 2 - 1; i >= 0; i--) {
+    sift_down(a, n, i);
+  }
+  for (int end = n - 1; end > 0; end--) {
+    swap_doubles(a, a + end);
+    sift_down(a, end, 0);
+  }
+}
+
+// Hoare partition around the median of the first, middle and last
+// element. returns split in [1, n) with a[0..split) <= pivot <=
+// a[split..n). the median of three puts a value on each side that
+// stops the scans, so they never run off the ends. n >= 3
+static int partition(double *a, int n) {
+  int mid = n / 2;
+  if (a[mid] < a[0]) {
+    swap_doubles(a + mid, a);
+  }
+  if (a[n - 1] < a[0]) {
+    swap_doubles(a + n - 1, a);
+  }
+  if (a[n - 1] < a[mid]) {
+    swap_doubles(a + n - 1, a + mid);
+  }
+  double pivot = a[mid];
+  int i = -1, j = n;
+  for (;;) {
+    do {
+      i++;
+    } while (a[i] < pivot);
+    do {
+      j--;
+    } while (a[j] > pivot);
+    if (i >= j) {
+      return j + 1;
+    }
+    swap_doubles(a + i, a + j);
+  }
+}
+
+// how many bad partitions to put up with before giving up on
+// quicksort, 2 log2(n) like std::sort
+static int depth_limit(int n) {
+  int depth = 0;
+  for (; n > 1; n /= 2) {
+    depth += 2;
+  }
+  return depth;
+}
+
+// introsort: quicksort, heapsort once the recursion gets too deep,
+// insertion sort for the small pieces. recurses on the smaller side so
+// the stack stays O(log n)
+static void intro_sort(double *a, int n, int depth) {
+  while (n > INSERTION_SORT_MAX) {
+    if (depth == 0) {
+      heap_sort(a, n);
+      return;
+    }
+    depth--;
+    int split = partition(a, n);
+    if (split < n - split) {
+      intro_sort(a, split, depth);
+      a += split;
+      n -= split;
+    } else {
+      intro_sort(a + split, n - split, depth);
+      n = split;
+    }
+  }
+  insertion_sort(a, n);
+}
+
+// doubles as unsigned keys in the same order: negatives get all their
+// bits flipped, positives just the sign bit
+static uint64_t radix_key(double x) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return (bits >> 63) ? ~bits : bits | (UINT64_C(1) << 63);
+}
+
+static double radix_value(uint64_t key) {
+  uint64_t bits = (key >> 63) ? key & ~(UINT64_C(1) << 63) : ~key;
+  double x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// LSD radix sort on the keys, a byte at a time. all eight histograms
+// come out of one pass over the input, and a byte that is the same in
+// every key (the exponent of numbers of similar size, often) costs
+// nothing
+static void radix_sort(double *a, int n) {
+  uint64_t *keys = (uint64_t *)malloc(n * sizeof(uint64_t)),
+           *temp = (uint64_t *)malloc(n * sizeof(uint64_t));
+  assert(keys != NULL && temp != NULL);
+  int counts[8][256];
+  memset(counts, 0, sizeof(counts));
+  for (int i = 0; i < n; i++) {
+    keys[i] = radix_key(a[i]);
+    for (int b = 0; b < 8; b++) {
+      counts[b][(keys[i] >> (8 * b)) & 0xff]++;
+    }
+  }
+  for (int b = 0; b < 8; b++) {
+    int shift = 8 * b;
+    if (counts[b][(keys[0] >> shift) & 0xff] == n) {
+      continue;
+    }
+    int offset = 0;
+    for (int d = 0; d < 256; d++) {
+      int c = counts[b][d];
+      counts[b][d] = offset;
+      offset += c;
+    }
+    for (int i = 0; i < n; i++) {
+      temp[counts[b][(keys[i] >> shift) & 0xff]++] = keys[i];
+    }
+    uint64_t *swap = keys;
+    keys = temp;
+    temp = swap;
+  }
+  for (int i = 0; i < n; i++) {
+    a[i] = radix_value(keys[i]);
+  }
+  free(keys);
+  free(temp);
+}
+
+// partial quicksort that only goes into the pieces holding one of the
+// wanted ranks. ranks are sorted, without repeats, and relative to the
+// original array, a starts at rank base. afterwards every a[rank - base]
+// holds what a sorted array would. one partition pass serves all the
+// ranks on either side of it, so k ranks cost O(n log k) expected
+static void select_ranks(double *a, int n, int base, const int *ranks,
+                         int count, int depth) {
+  while (count > 0 && n > INSERTION_SORT_MAX) {
+    if (depth == 0) {
+      heap_sort(a, n);
+      return;
+    }
+    depth--;
+    int split = partition(a, n);
+    int left = 0;
+    while (left < count && ranks[left] < base + split) {
+      left++;
+    }
+    select_ranks(a, split, base, ranks, left, depth);
+    a += split;
+    n -= split;
+    base += split;
+    ranks += left;
+    count -= left;
+  }
+  if (count > 0) {
+    insertion_sort(a, n);
+  }
+}
+
+static int compare_ints(const void *x, const void *y) {
+  int a = *(const int *)x, b = *(const int *)y;
+  return (a > b) - (a < b);
+}
+
+// copy of the elements, for selecting in without touching da
+static double *copy_elements(const DynamicArray *da) {
+  int n = DynamicArray_size(da);
+  double *copy = (double *)malloc(n * sizeof(double));
+  assert(copy != NULL);
+  memcpy(copy, da->buffer + da->origin, n * sizeof(double));
+  return copy;
+}
+
 double DynamicArray_median(const DynamicArray *da) {
   assert(DynamicArray_size(da) > 0);
   int sz = DynamicArray_size(da);
-  double *sorted = (double *)malloc(sz * sizeof(double));
+  double *values = copy_elements(da);
 
-  // copy into temp array first
-  int i;
-  for (i = 0; i < sz; i++) {
-    sorted[i] = DynamicArray_get(da, i);
-  }
-
-  // sort the array
-  sort_array(sorted, sz);
+  // the middle one, or the two middle ones for an even count
+  int ranks[2] = {(sz - 1) / 2, sz / 2};
+  select_ranks(values, sz, 0, ranks, ranks[0] == ranks[1] ? 1 : 2,
+               depth_limit(sz));
 
   double result;
   if (sz % 2 == 0) {
     // even number of elements, take average of middle two
-    result = (sorted[sz / 2 - 1] + sorted[sz / 2]) / 2.0;
+    result = (values[sz / 2 - 1] + values[sz / 2]) / 2.0;
   } else {
     // odd, just take the middle one
-    result = sorted[sz / 2];
+    result = values[sz / 2];
   }
-  free(sorted);
+  free(values);
   return result;
 }
 
+double DynamicArray_quantile(const DynamicArray *da, double q) {
+  double result;
+  DynamicArray_quantiles(da, &q, 1, &result);
+  return result;
+}
+
+void DynamicArray_quantiles(const DynamicArray *da, const double *q,
+                            int count, double *out) {
+  assert(DynamicArray_size(da) > 0);
+  assert(count >= 0);
+  int sz = DynamicArray_size(da);
+
+  // each quantile sits between two ranks, collect them all, sorted and
+  // without repeats
+  int *ranks = (int *)malloc((2 * count + 1) * sizeof(int));
+  assert(ranks != NULL);
+  int num_ranks = 0;
+  for (int i = 0; i < count; i++) {
+    assert(q[i] >= 0.0 && q[i] <= 1.0);
+    int lo = (int)floor((sz - 1) * q[i]);
+    ranks[num_ranks++] = lo;
+    ranks[num_ranks++] = lo + 1 < sz ? lo + 1 : lo;
+  }
+  qsort(ranks, num_ranks, sizeof(int), compare_ints);
+  int unique = 0;
+  for (int i = 0; i < num_ranks; i++) {
+    if (unique == 0 || ranks[unique - 1] != ranks[i]) {
+      ranks[unique++] = ranks[i];
+    }
+  }
+
+  double *values = copy_elements(da);
+  select_ranks(values, sz, 0, ranks, unique, depth_limit(sz));
+  for (int i = 0; i < count; i++) {
+    double h = (sz - 1) * q[i];
+    int lo = (int)floor(h);
+    double frac = h - lo;
+    out[i] = frac == 0.0 ? values[lo]
+                         : values[lo] + frac * (values[lo + 1] - values[lo]);
+  }
+  free(values);
+  free(ranks);
+}
+
+void DynamicArray_sort(DynamicArray *da) {
+  assert(da->buffer != NULL);
+  int sz = DynamicArray_size(da);
+  double *a = da->buffer + da->origin;
+  if (sz >= RADIX_SORT_MIN) {
+    radix_sort(a, sz);
+  } else {
+    intro_sort(a, sz, depth_limit(sz));
+  }
+}
+
 double DynamicArray_sum(const DynamicArray *da) {
   double total = 0.0;
   int i;
@@ -266,6 +590,7 @@ DynamicArray *DynamicArray_copy(const DynamicArray *da) {
   DynamicArray *newArr = DynamicArray_new();
   int i;
   int len = DynamicArray_size(da); // store size first
+  DynamicArray_reserve(newArr, len);
   for (i = 0; i < len; i++) {
     DynamicArray_push(newArr, DynamicArray_get(da, i));
   }
@@ -288,6 +613,7 @@ DynamicArray *DynamicArray_range(double a, double b, double step) {
 DynamicArray *DynamicArray_concat(const DynamicArray *a,
                                   const DynamicArray *b) {
   DynamicArray *res = DynamicArray_new();
+  DynamicArray_reserve(res, DynamicArray_size(a) + DynamicArray_size(b));
   for (int i = 0; i < DynamicArray_size(a); i++) {
     DynamicArray_push(res, DynamicArray_get(a, i));
   }
@@ -354,26 +680,124 @@ DynamicArray *DynamicArray_filter(const DynamicArray *da, Predicate p) {
   return res;
 }
 
+// DynamicArray_unique keeps a value unless it is within EPSILON of one
+// already kept. a plain hash set cant find "close" values, so values are
+// hashed by the bucket of width 2 * EPSILON they fall in, and a lookup
+// checks the bucket and both neighbours. anything within EPSILON is in
+// one of those three even with the rounding in x / width, and a bucket
+// holds at most a few kept values, so the lookup is O(1)
+#define UNIQUE_BUCKET_WIDTH (2 * EPSILON)
+
+typedef struct {
+  uint64_t *keys;
+  int *indices; // into the result, -1 for an empty slot
+  size_t mask;
+  int shift; // 64 - log2 of the slot count
+} BucketTable;
+
+static uint64_t bucket_key(double x) {
+  double bucket = floor(x / UNIQUE_BUCKET_WIDTH);
+  if (fabs(bucket) < 4611686018427387904.0) { // 2^62
+    return (uint64_t)(int64_t)bucket;
+  }
+  // huge, infinite or NaN. doubles this big are more than EPSILON apart
+  // anyway, so any key that is the same for equal values will do
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+// neighbouring buckets have consecutive keys, the multiply spreads them
+// out and the slot comes from the high bits of the product, where every
+// bit of the key has had a say
+static size_t bucket_slot(const BucketTable *table, uint64_t key) {
+  return (size_t)((key * UINT64_C(0x9E3779B97F4A7C15)) >> table->shift);
+}
+
+// kept value within EPSILON of x in the buckets around key?
+static int bucket_table_contains(const BucketTable *table,
+                                 const double *kept, uint64_t key, double x) {
+  for (uint64_t k = key - 1; k != key + 2; k++) {
+    for (size_t i = bucket_slot(table, k); table->indices[i] >= 0;
+         i = (i + 1) & table->mask) {
+      if (table->keys[i] == k && doubles_equal(kept[table->indices[i]], x)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void bucket_table_insert(BucketTable *table, uint64_t key, int index) {
+  size_t i = bucket_slot(table, key);
+  while (table->indices[i] >= 0) {
+    i = (i + 1) & table->mask;
+  }
+  table->keys[i] = key;
+  table->indices[i] = index;
+}
+
+static int is_sorted(const double *a, int n) {
+  for (int i = 1; i < n; i++) {
+    if (!(a[i - 1] <= a[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 DynamicArray *DynamicArray_unique(const DynamicArray *da) {
   DynamicArray *result = DynamicArray_new();
   int n = DynamicArray_size(da);
-  int i, j;
-
-  for (i = 0; i < n; i++) {
-    double current = DynamicArray_get(da, i);
-    int found = 0;
-
-    for (j = 0; j < DynamicArray_size(result); j++) {
-      if (doubles_equal(DynamicArray_get(result, j), current)) {
-        found = 1;
-        break;
+  if (n == 0) {
+    return result;
+  }
+  const double *values = da->buffer + da->origin;
+  DynamicArray_reserve(result, n);
+  double *kept = result->buffer + result->origin;
+  int k = 0;
+
+  if (is_sorted(values, n)) {
+    // everything kept so far is smaller, the last one kept is the
+    // closest, no table needed
+    for (int i = 0; i < n; i++) {
+      if (k == 0 || !doubles_equal(kept[k - 1], values[i])) {
+        kept[k++] = values[i];
       }
     }
+    result->end = result->origin + k;
+    return result;
+  }
 
-    if (found == 0) {
-      DynamicArray_push(result, current);
+  // at most half full so the probe runs stay short
+  // size_t, for n > 2^30 an unsigned would double past 2^31 to 0 and
+  // the loop would never end
+  size_t capacity = 16;
+  int bits = 4;
+  while (capacity < 2 * (size_t)n) {
+    capacity *= 2;
+    bits++;
+  }
+  BucketTable table;
+  table.keys = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+  table.indices = (int *)malloc(capacity * sizeof(int));
+  assert(table.keys != NULL && table.indices != NULL);
+  memset(table.indices, -1, capacity * sizeof(int));
+  table.mask = capacity - 1;
+  table.shift = 64 - bits;
+
+  for (int i = 0; i < n; i++) {
+    double current = values[i];
+    uint64_t key = bucket_key(current);
+    if (!bucket_table_contains(&table, kept, key, current)) {
+      bucket_table_insert(&table, key, k);
+      kept[k++] = current;
     }
   }
+
+  free(table.keys);
+  free(table.indices);
+  result->end = result->origin + k;
   return result;
 }
 
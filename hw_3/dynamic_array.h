@@ -2,15 +2,33 @@
 #define _DYNAMIC_ARRAY
 
 #define DYNAMIC_ARRAY_INITIAL_CAPACITY 10
+#define DYNAMIC_ARRAY_GROWTH_FACTOR 2.0
 
 typedef struct {
   int capacity, origin, end;
   double *buffer;
+  double growth;
 } DynamicArray;
 
 DynamicArray *DynamicArray_new(void);
 void DynamicArray_destroy(DynamicArray *);
 
+/*! How much a full side grows by, as a multiple of the size. Each end
+ * has its own slack: running out at the back only grows the back, and
+ * running out at the front only grows the front. Has to be above 1,
+ * default DYNAMIC_ARRAY_GROWTH_FACTOR.
+ */
+void DynamicArray_set_growth_factor(DynamicArray *da, double factor);
+
+/*! Make room for n elements from the current front, so pushing at the
+ * back doesnt reallocate until the size gets to n.
+ */
+void DynamicArray_reserve(DynamicArray *da, int n);
+
+/*! Give back all the slack at both ends.
+ */
+void DynamicArray_shrink_to_fit(DynamicArray *da);
+
 void DynamicArray_set(DynamicArray *, int, double);
 double DynamicArray_get(const DynamicArray *, int);
 int DynamicArray_size(const DynamicArray *);
@@ -57,7 +75,10 @@ typedef int (*Predicate)(double);
 /* Keeps only elements that satisfy the predicate */
 DynamicArray *DynamicArray_filter(const DynamicArray *da, Predicate p);
 
-/* Removes duplicates */
+/* Removes duplicates, values within EPSILON of one seen earlier. Keeps
+ * the first occurrences in order. Expected O(n) with a hash table, one
+ * linear pass without it if the input is sorted.
+ */
 DynamicArray *DynamicArray_unique(const DynamicArray *da);
 
 /* Splits into chunks */
@@ -72,6 +93,25 @@ double DynamicArray_mean(const DynamicArray *da);
 double DynamicArray_median(const DynamicArray *da);
 double DynamicArray_sum(const DynamicArray *da);
 
+/*! Order statistics, none of them change the array. The q-th quantile
+ * for q in [0, 1] interpolates linearly between the two nearest ranks,
+ * so 0 is the min, 1 the max and 0.5 the median. Quickselect on a
+ * copy: expected O(n), never worse than O(n log n). NaNs give
+ * meaningless results.
+ */
+double DynamicArray_quantile(const DynamicArray *da, double q);
+
+/*! out[i] = DynamicArray_quantile(da, q[i]) for i < count, sharing one
+ * copy and one partial sort between all of them.
+ */
+void DynamicArray_quantiles(const DynamicArray *da, const double *q,
+                            int count, double *out);
+
+/*! Sort in place, ascending. Radix sort for big arrays, introsort for
+ * small ones.
+ */
+void DynamicArray_sort(DynamicArray *da);
+
 /*! Extra Credit
  */
 int DynamicArray_is_valid(const DynamicArray *da);
@@ -0,0 +1,132 @@
+#include "dynamic_array.h"
+#include "benchmark/benchmark.h"
+
+// DynamicArray growth, elements per second. every iteration starts from
+// an empty array so all the reallocations are included.
+namespace {
+
+void BM_DynamicArrayPush(benchmark::State &state) {
+  int n = state.range(0);
+  for (auto _ : state) {
+    DynamicArray *da = DynamicArray_new();
+    for (int i = 0; i < n; i++) {
+      DynamicArray_push(da, i);
+    }
+    benchmark::DoNotOptimize(DynamicArray_size(da));
+    DynamicArray_destroy(da);
+    free(da);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+}
+BENCHMARK(BM_DynamicArrayPush)->Arg(1000)->Arg(10000000)->Unit(benchmark::kMillisecond);
+
+void BM_DynamicArrayPushFront(benchmark::State &state) {
+  int n = state.range(0);
+  for (auto _ : state) {
+    DynamicArray *da = DynamicArray_new();
+    for (int i = 0; i < n; i++) {
+      DynamicArray_push_front(da, i);
+    }
+    benchmark::DoNotOptimize(DynamicArray_size(da));
+    DynamicArray_destroy(da);
+    free(da);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+}
+BENCHMARK(BM_DynamicArrayPushFront)->Arg(1000)->Arg(10000000)->Unit(benchmark::kMillisecond);
+
+// set far past the end, the gap gets filled with zeros
+void BM_DynamicArraySetSparse(benchmark::State &state) {
+  int n = state.range(0);
+  for (auto _ : state) {
+    DynamicArray *da = DynamicArray_new();
+    for (int i = 0; i < n; i += 1000) {
+      DynamicArray_set(da, i, i);
+    }
+    benchmark::DoNotOptimize(DynamicArray_size(da));
+    DynamicArray_destroy(da);
+    free(da);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+}
+BENCHMARK(BM_DynamicArraySetSparse)->Arg(10000000)->Unit(benchmark::kMillisecond);
+
+// order statistics and sorting on n pseudo random values
+DynamicArray *random_array(int n) {
+  DynamicArray *da = DynamicArray_new();
+  DynamicArray_reserve(da, n);
+  unsigned x = 12345;
+  for (int i = 0; i < n; i++) {
+    x = x * 1103515245 + 12345;
+    DynamicArray_push(da, (x >> 8) / 1000.0 - 8000.0);
+  }
+  return da;
+}
+
+void BM_DynamicArrayMedian(benchmark::State &state) {
+  int n = state.range(0);
+  DynamicArray *da = random_array(n);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(DynamicArray_median(da));
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+  DynamicArray_destroy(da);
+  free(da);
+}
+BENCHMARK(BM_DynamicArrayMedian)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// the usual summary, all five at once
+void BM_DynamicArrayQuantiles(benchmark::State &state) {
+  int n = state.range(0);
+  DynamicArray *da = random_array(n);
+  double q[] = {0.05, 0.25, 0.5, 0.75, 0.95};
+  double out[5];
+  for (auto _ : state) {
+    DynamicArray_quantiles(da, q, 5, out);
+    benchmark::DoNotOptimize(out[0]);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+  DynamicArray_destroy(da);
+  free(da);
+}
+BENCHMARK(BM_DynamicArrayQuantiles)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+void BM_DynamicArraySort(benchmark::State &state) {
+  int n = state.range(0);
+  DynamicArray *da = random_array(n);
+  for (auto _ : state) {
+    state.PauseTiming();
+    DynamicArray *copy = DynamicArray_copy(da);
+    state.ResumeTiming();
+    DynamicArray_sort(copy);
+    state.PauseTiming();
+    DynamicArray_destroy(copy);
+    free(copy);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+  DynamicArray_destroy(da);
+  free(da);
+}
+BENCHMARK(BM_DynamicArraySort)->Arg(1000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// n values with about n / 4 distinct ones
+void BM_DynamicArrayUnique(benchmark::State &state) {
+  int n = state.range(0);
+  DynamicArray *da = DynamicArray_new();
+  for (int i = 0; i < n; i++) {
+    DynamicArray_push(da, (int)((i * 7919LL) % (n / 4)) * 0.001);
+  }
+  for (auto _ : state) {
+    DynamicArray *u = DynamicArray_unique(da);
+    benchmark::DoNotOptimize(DynamicArray_size(u));
+    DynamicArray_destroy(u);
+    free(u);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * n);
+  DynamicArray_destroy(da);
+  free(da);
+}
+BENCHMARK(BM_DynamicArrayUnique)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+} // namespace
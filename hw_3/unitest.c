@@ -224,6 +224,62 @@ TEST(DynamicArray, Unique) {
   DynamicArray_destroy(u);
 }
 
+// the old O(n^2) scan, what DynamicArray_unique has to agree with
+static DynamicArray *unique_reference(const DynamicArray *da) {
+  DynamicArray *result = DynamicArray_new();
+  for (int i = 0; i < DynamicArray_size(da); i++) {
+    double current = DynamicArray_get(da, i);
+    int found = 0;
+    for (int j = 0; j < DynamicArray_size(result) && !found; j++) {
+      found = fabs(DynamicArray_get(result, j) - current) < EPSILON;
+    }
+    if (!found) {
+      DynamicArray_push(result, current);
+    }
+  }
+  return result;
+}
+
+TEST(DynamicArray, UniqueTolerance) {
+  // steps just under and just over EPSILON, near bucket edges, both
+  // signs, plus values too big for the buckets
+  DynamicArray *a = DynamicArray_new();
+  for (int i = 0; i < 4000; i++) {
+    int r = (int)((i * 7919LL) % 2001) - 1000;
+    DynamicArray_push(a, r * 0.7 * EPSILON);
+    DynamicArray_push(a, r * 1.3 * EPSILON + 0.5);
+  }
+  DynamicArray_push(a, 1e300);
+  DynamicArray_push(a, -1e300);
+  DynamicArray_push(a, 1e300);
+
+  DynamicArray *u = DynamicArray_unique(a);
+  DynamicArray *expected = unique_reference(a);
+  ASSERT_EQ(DynamicArray_size(u), DynamicArray_size(expected));
+  for (int i = 0; i < DynamicArray_size(u); i++) {
+    ASSERT_EQ(DynamicArray_get(u, i), DynamicArray_get(expected, i));
+  }
+
+  // sorted takes the linear path, same answer
+  DynamicArray_sort(a);
+  DynamicArray *su = DynamicArray_unique(a);
+  DynamicArray *sexpected = unique_reference(a);
+  ASSERT_EQ(DynamicArray_size(su), DynamicArray_size(sexpected));
+  for (int i = 0; i < DynamicArray_size(su); i++) {
+    ASSERT_EQ(DynamicArray_get(su, i), DynamicArray_get(sexpected, i));
+  }
+
+  DynamicArray *empty = DynamicArray_new();
+  DynamicArray *eu = DynamicArray_unique(empty);
+  ASSERT_EQ(DynamicArray_size(eu), 0);
+
+  DynamicArray *arrays[] = {a, u, expected, su, sexpected, empty, eu};
+  for (int i = 0; i < 7; i++) {
+    DynamicArray_destroy(arrays[i]);
+    free(arrays[i]);
+  }
+}
+
 TEST(DynamicArray, Split) {
   DynamicArray *a = DynamicArray_range(1, 10, 1); // 10 elements
   int count = 0;
@@ -242,4 +298,190 @@ TEST(DynamicArray, Split) {
   free(chunks);
 }
 
+TEST(DynamicArray, GrowthAndSlack) {
+  DynamicArray *da = DynamicArray_new();
+
+  // once the front has grown the first time, it grows on its own and
+  // the back slack doesnt change
+  for (int i = 0; i < 20; i++) {
+    DynamicArray_push_front(da, i);
+  }
+  int back_slack = da->capacity - da->end;
+  for (int i = 20; i < 1000; i++) {
+    DynamicArray_push_front(da, i);
+  }
+  ASSERT_EQ(DynamicArray_size(da), 1000);
+  ASSERT_EQ(da->capacity - da->end, back_slack);
+  ASSERT_EQ(DynamicArray_first(da), 999);
+  ASSERT_EQ(DynamicArray_last(da), 0);
+
+  // setting past the end still reads back zeros in the gap, even after
+  // the buffer has held other values there
+  for (int i = 0; i < 500; i++) {
+    DynamicArray_pop(da);
+  }
+  DynamicArray_set(da, 700, X);
+  ASSERT_EQ(DynamicArray_size(da), 701);
+  ASSERT_EQ(DynamicArray_get(da, 499), 500);
+  ASSERT_EQ(DynamicArray_get(da, 500), 0);
+  ASSERT_EQ(DynamicArray_get(da, 699), 0);
+  ASSERT_EQ(DynamicArray_get(da, 700), X);
+
+  DynamicArray_shrink_to_fit(da);
+  ASSERT_EQ(da->capacity, 701);
+  ASSERT_EQ(da->origin, 0);
+  ASSERT_EQ(DynamicArray_get(da, 0), 999);
+  DynamicArray_push_front(da, -1);
+  DynamicArray_push(da, -2);
+  ASSERT_EQ(DynamicArray_size(da), 703);
+  ASSERT_EQ(DynamicArray_first(da), -1);
+  ASSERT_EQ(DynamicArray_get(da, 1), 999);
+  ASSERT_EQ(DynamicArray_last(da), -2);
+
+  DynamicArray_destroy(da);
+  free(da);
+}
+
+TEST(DynamicArray, ReserveAndGrowthFactor) {
+  DynamicArray *da = DynamicArray_new();
+  DynamicArray_reserve(da, 100);
+  double *buffer = da->buffer;
+  int capacity = da->capacity;
+  for (int i = 0; i < 100; i++) {
+    DynamicArray_push(da, i);
+  }
+  ASSERT_EQ(da->buffer, buffer);
+  ASSERT_EQ(da->capacity, capacity);
+
+  // 1.5 grows the back by half the size
+  DynamicArray_set_growth_factor(da, 1.5);
+  DynamicArray_push(da, 100);
+  ASSERT_EQ(da->capacity, capacity + 50);
+  ASSERT_DEATH(DynamicArray_set_growth_factor(da, 1.0), ".*Assertion.*");
+
+  // empty arrays can be shrunk and grown again
+  while (DynamicArray_size(da) > 0) {
+    DynamicArray_pop_front(da);
+  }
+  DynamicArray_shrink_to_fit(da);
+  DynamicArray_push_front(da, 1);
+  DynamicArray_push_front(da, 0);
+  DynamicArray_push(da, 2);
+  ASSERT_EQ(DynamicArray_size(da), 3);
+  ASSERT_EQ(DynamicArray_get(da, 0), 0);
+  ASSERT_EQ(DynamicArray_get(da, 2), 2);
+
+  DynamicArray_destroy(da);
+  free(da);
+}
+
+TEST(DynamicArray, QueueDoesntGrow) {
+  // push at the back and pop at the front, the elements slide back into
+  // the space popped off the front instead of the buffer growing
+  DynamicArray *da = DynamicArray_new();
+  for (int i = 0; i < 100; i++) {
+    DynamicArray_push(da, i);
+  }
+  int capacity = da->capacity;
+  for (int i = 100; i < 100000; i++) {
+    ASSERT_EQ(DynamicArray_pop_front(da), i - 100);
+    DynamicArray_push(da, i);
+  }
+  ASSERT_EQ(DynamicArray_size(da), 100);
+  ASSERT_LE(da->capacity, 2 * capacity);
+
+  // same the other way around
+  for (int i = 0; i < 100000; i++) {
+    DynamicArray_pop(da);
+    DynamicArray_push_front(da, -i);
+  }
+  ASSERT_EQ(DynamicArray_size(da), 100);
+  ASSERT_LE(da->capacity, 4 * capacity);
+  ASSERT_EQ(DynamicArray_first(da), -99999);
+
+  DynamicArray_destroy(da);
+  free(da);
+}
+
+TEST(DynamicArray, Quantiles) {
+  DynamicArray *da = DynamicArray_new();
+  double values[] = {1, 5, 2, 4, 3};
+  for (int i = 0; i < 5; i++) {
+    DynamicArray_push(da, values[i]);
+  }
+  ASSERT_EQ(DynamicArray_quantile(da, 0), 1);
+  ASSERT_EQ(DynamicArray_quantile(da, 1), 5);
+  ASSERT_EQ(DynamicArray_quantile(da, 0.5), 3);
+  ASSERT_NEAR(DynamicArray_quantile(da, 0.125), 1.5, EPSILON);
+  ASSERT_NEAR(DynamicArray_quantile(da, 0.9), 4.6, EPSILON);
+  // the array itself isnt touched
+  ASSERT_EQ(DynamicArray_get(da, 1), 5);
+  ASSERT_DEATH(DynamicArray_quantile(da, 1.5), ".*Assertion.*");
+
+  // lots of values with lots of repeats, against every rank
+  DynamicArray *big = DynamicArray_new();
+  int n = 10001;
+  for (int i = 0; i < n; i++) {
+    DynamicArray_push(big, (i * 7919) % 1000 - 500);
+  }
+  DynamicArray *sorted = DynamicArray_copy(big);
+  DynamicArray_sort(sorted);
+  double q[] = {0, 0.01, 0.25, 0.5, 0.75, 0.99, 1};
+  double out[7];
+  DynamicArray_quantiles(big, q, 7, out);
+  for (int i = 0; i < 7; i++) {
+    ASSERT_EQ(out[i], DynamicArray_get(sorted, (int)((n - 1) * q[i])));
+    ASSERT_EQ(out[i], DynamicArray_quantile(big, q[i]));
+  }
+  ASSERT_EQ(DynamicArray_median(big), DynamicArray_get(sorted, n / 2));
+  DynamicArray_push(big, 1000);
+  ASSERT_NEAR(DynamicArray_median(big),
+              (DynamicArray_get(sorted, n / 2) +
+               DynamicArray_get(sorted, n / 2 + 1)) / 2,
+              EPSILON);
+
+  DynamicArray_destroy(da);
+  DynamicArray_destroy(big);
+  DynamicArray_destroy(sorted);
+  free(da);
+  free(big);
+  free(sorted);
+}
+
+TEST(DynamicArray, Sort) {
+  // small ones go through the introsort, big ones through the radix sort
+  int sizes[] = {0, 1, 2, 17, 1000, 5000};
+  for (int s = 0; s < 6; s++) {
+    DynamicArray *da = DynamicArray_new();
+    for (int i = 0; i < sizes[s]; i++) {
+      DynamicArray_push(da, ((i * 7919) % 2003 - 1000) * 0.37);
+    }
+    DynamicArray_push_front(da, -0.0);
+    DynamicArray_push_front(da, 1e300);
+    DynamicArray_push_front(da, -1e-300);
+    int size = DynamicArray_size(da);
+    DynamicArray_sort(da);
+    ASSERT_EQ(DynamicArray_size(da), size);
+    for (int i = 1; i < size; i++) {
+      ASSERT_LE(DynamicArray_get(da, i - 1), DynamicArray_get(da, i));
+    }
+    ASSERT_EQ(DynamicArray_last(da), 1e300);
+    DynamicArray_destroy(da);
+    free(da);
+  }
+
+  // already sorted and reversed, the worst cases for a naive quicksort
+  DynamicArray *da = DynamicArray_new();
+  for (int i = 0; i < 1000; i++) {
+    DynamicArray_push(da, 1000 - i);
+  }
+  DynamicArray_sort(da);
+  DynamicArray_sort(da);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(DynamicArray_get(da, i), i + 1);
+  }
+  DynamicArray_destroy(da);
+  free(da);
+}
+
 } // namespace
\ No newline at end of file
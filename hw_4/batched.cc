@@ -0,0 +1,298 @@
+#include "batched.h"
+#include "simd.h"
+#include "thread_pool.h"
+#include "transpose.h"
+#include <algorithm>
+#include <stdexcept>
+
+// the group kernels get compiled once per instruction set and picked at
+// load time, same idea as the runtime dispatch in simd.cc but letting
+// the compiler vectorize the lane loops instead of writing intrinsics
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__clang__)
+#define BATCHED_CLONES __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#else
+#define BATCHED_CLONES
+#endif
+
+namespace batched {
+
+namespace {
+
+// one cache line of lanes as a gcc vector type, so the clones below
+// get one zmm, two ymm or four xmm per element without any intrinsics
+template <typename T>
+struct lane_vector {
+    typedef T type __attribute__((vector_size(64)));
+};
+
+// these only ever get inlined into the clones, so the warning about
+// passing 64 byte vectors by value on plain x86-64 doesnt apply
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+template <typename V, typename T>
+inline __attribute__((always_inline)) V load(const T* p) {
+    V v;
+    __builtin_memcpy(&v, p, sizeof(V));
+    return v;
+}
+
+template <typename V, typename T>
+inline __attribute__((always_inline)) void store(T* p, V v) {
+    __builtin_memcpy(p, &v, sizeof(V));
+}
+
+// one group, LANES matrices at once. every op works on a full vector of
+// lanes, i.e. the same element of LANES matrices. JB columns of C are
+// done together so each load of A gets reused.
+template <typename T>
+inline __attribute__((always_inline))
+void group_multiply(size_t m, size_t n, size_t k, T alpha, const T* A, const T* B, T beta, T* C) {
+    typedef typename lane_vector<T>::type V;
+    constexpr size_t W = lanes<T>;
+    constexpr size_t JB = 4;
+    for (size_t i = 0; i < m; i++) {
+        size_t j = 0;
+        for (; j + JB <= n; j += JB) {
+            V acc0 = {}, acc1 = {}, acc2 = {}, acc3 = {};
+            for (size_t p = 0; p < k; p++) {
+                V a = load<V>(A + (i * k + p) * W);
+                const T* b = B + (p * n + j) * W;
+                acc0 += a * load<V>(b);
+                acc1 += a * load<V>(b + W);
+                acc2 += a * load<V>(b + 2 * W);
+                acc3 += a * load<V>(b + 3 * W);
+            }
+            V acc[JB] = {acc0, acc1, acc2, acc3};
+            for (size_t jj = 0; jj < JB; jj++) {
+                T* c = C + (i * n + j + jj) * W;
+                store(c, beta == T(0) ? alpha * acc[jj] : alpha * acc[jj] + beta * load<V>(c));
+            }
+        }
+        for (; j < n; j++) {
+            V acc = {};
+            for (size_t p = 0; p < k; p++) {
+                acc += load<V>(A + (i * k + p) * W) * load<V>(B + (p * n + j) * W);
+            }
+            T* c = C + (i * n + j) * W;
+            store(c, beta == T(0) ? alpha * acc : alpha * acc + beta * load<V>(c));
+        }
+    }
+}
+
+BATCHED_CLONES
+void group_kernel(size_t m, size_t n, size_t k, double alpha, const double* A, const double* B,
+                  double beta, double* C) {
+    group_multiply(m, n, k, alpha, A, B, beta, C);
+}
+
+BATCHED_CLONES
+void group_kernel(size_t m, size_t n, size_t k, float alpha, const float* A, const float* B,
+                  float beta, float* C) {
+    group_multiply(m, n, k, alpha, A, B, beta, C);
+}
+
+// interleave `used` matrices starting at src into one group (and back).
+// lanes past `used` are left alone, whatever they hold never gets
+// written back out
+template <typename T>
+void interleave(size_t used, size_t rows, size_t cols, const T* src, size_t ld, size_t stride, T* group) {
+    constexpr size_t W = lanes<T>;
+    for (size_t l = 0; l < used; l++) {
+        const T* mat = src + l * stride;
+        for (size_t r = 0; r < rows; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                group[(r * cols + c) * W + l] = mat[r * ld + c];
+            }
+        }
+    }
+}
+
+template <typename T>
+void deinterleave(size_t used, size_t rows, size_t cols, const T* group, T* dst, size_t ld, size_t stride) {
+    constexpr size_t W = lanes<T>;
+    for (size_t l = 0; l < used; l++) {
+        T* mat = dst + l * stride;
+        for (size_t r = 0; r < rows; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                mat[r * ld + c] = group[(r * cols + c) * W + l];
+            }
+        }
+    }
+}
+
+// how many items each thread should get at least, for work per item
+size_t grain(size_t work_per_item) {
+    return std::max<size_t>(1, PARALLEL_MIN_WORK / std::max<size_t>(1, work_per_item));
+}
+
+template <typename T>
+void check_same_shape(const Interleaved<T>& a, const Interleaved<T>& b) {
+    if (a.count() != b.count() || a.rows() != b.rows() || a.cols() != b.cols()) {
+        throw std::invalid_argument("batches have different shapes");
+    }
+}
+
+// resize c to count x rows x cols unless it already is
+template <typename T>
+void fit(Interleaved<T>& c, size_t count, size_t rows, size_t cols) {
+    if (c.count() != count || c.rows() != rows || c.cols() != cols) {
+        c = Interleaved<T>(count, rows, cols);
+    }
+}
+
+}
+
+/* ======= Interleaved ======= */
+
+template <typename T>
+Interleaved<T>::Interleaved(size_t count, size_t rows, size_t cols)
+    : data((count + LANES - 1) / LANES * LANES * rows * cols, T(0)),
+      num(count), num_rows(rows), num_cols(cols) {}
+
+template <typename T>
+Interleaved<T> Interleaved<T>::pack(size_t count, size_t rows, size_t cols,
+                                    const T* src, size_t ld, size_t stride) {
+    Interleaved res(count, rows, cols);
+    parallel::for_range(res.groups(), grain(rows * cols * LANES), [&](size_t first, size_t last) {
+        for (size_t g = first; g < last; g++) {
+            size_t used = std::min(LANES, count - g * LANES);
+            interleave(used, rows, cols, src + g * LANES * stride, ld, stride, res.group(g));
+        }
+    });
+    return res;
+}
+
+template <typename T>
+void Interleaved<T>::unpack(T* dst, size_t ld, size_t stride) const {
+    parallel::for_range(groups(), grain(num_rows * num_cols * LANES), [&](size_t first, size_t last) {
+        for (size_t g = first; g < last; g++) {
+            size_t used = std::min(LANES, num - g * LANES);
+            deinterleave(used, num_rows, num_cols, group(g), dst + g * LANES * stride, ld, stride);
+        }
+    });
+}
+
+template <typename T>
+void multiply(const Interleaved<T>& A, const Interleaved<T>& B, Interleaved<T>& C, size_t threads) {
+    if (&C == &A || &C == &B) {
+        throw std::invalid_argument("batched multiply cant write into one of its inputs");
+    }
+    if (A.count() != B.count() || A.cols() != B.rows()) {
+        throw std::invalid_argument("batch shapes dont work for multiply");
+    }
+    size_t m = A.rows(), n = B.cols(), k = A.cols();
+    fit(C, A.count(), m, n);
+    parallel::for_range(A.groups(), grain(m * n * k * lanes<T>), [&](size_t first, size_t last) {
+        for (size_t g = first; g < last; g++) {
+            group_kernel(m, n, k, T(1), A.group(g), B.group(g), T(0), C.group(g));
+        }
+    }, threads);
+}
+
+// the padding lanes get added too, doesnt matter and keeps it one flat loop
+template <typename T>
+void add(const Interleaved<T>& A, const Interleaved<T>& B, Interleaved<T>& C, size_t threads) {
+    check_same_shape(A, B);
+    fit(C, A.count(), A.rows(), A.cols());
+    size_t per_group = A.rows() * A.cols() * lanes<T>;
+    parallel::for_range(A.groups(), grain(per_group), [&](size_t first, size_t last) {
+        simd::add(A.group(first), B.group(first), C.group(first), (last - first) * per_group);
+    }, threads);
+}
+
+template <typename T>
+void transpose(const Interleaved<T>& A, Interleaved<T>& C, size_t threads) {
+    if (&A == &C) {
+        throw std::invalid_argument("batched transpose cant run in place");
+    }
+    size_t rows = A.rows(), cols = A.cols();
+    constexpr size_t W = lanes<T>;
+    fit(C, A.count(), cols, rows);
+    parallel::for_range(A.groups(), grain(rows * cols * W), [&](size_t first, size_t last) {
+        for (size_t g = first; g < last; g++) {
+            const T* a = A.group(g);
+            T* c = C.group(g);
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t j = 0; j < cols; j++) {
+                    std::copy(a + (r * cols + j) * W, a + (r * cols + j + 1) * W, c + (j * rows + r) * W);
+                }
+            }
+        }
+    }, threads);
+}
+
+/* ======= strided ======= */
+
+template <typename T>
+void multiply(size_t count, size_t m, size_t n, size_t k,
+              T alpha, const T* A, size_t lda, size_t stride_a,
+              const T* B, size_t ldb, size_t stride_b,
+              T beta, T* C, size_t ldc, size_t stride_c,
+              size_t threads) {
+    constexpr size_t W = lanes<T>;
+    size_t groups = (count + W - 1) / W;
+    parallel::for_range(groups, grain(m * n * k * W), [&](size_t first, size_t last) {
+        // scratch for one group, reused for every group of this chunk
+        std::vector<T, MatrixAllocator<T>> Ag(m * k * W), Bg(k * n * W), Cg(m * n * W);
+        for (size_t g = first; g < last; g++) {
+            size_t base = g * W;
+            size_t used = std::min(W, count - base);
+            interleave(used, m, k, A + base * stride_a, lda, stride_a, Ag.data());
+            interleave(used, k, n, B + base * stride_b, ldb, stride_b, Bg.data());
+            if (beta != T(0)) {
+                interleave(used, m, n, C + base * stride_c, ldc, stride_c, Cg.data());
+            }
+            group_kernel(m, n, k, alpha, Ag.data(), Bg.data(), beta, Cg.data());
+            deinterleave(used, m, n, Cg.data(), C + base * stride_c, ldc, stride_c);
+        }
+    }, threads);
+}
+
+// nothing to gain from interleaving an elementwise op, each matrix is
+// already a row of contiguous loads
+template <typename T>
+void add(size_t count, size_t rows, size_t cols,
+         const T* A, size_t lda, size_t stride_a,
+         const T* B, size_t ldb, size_t stride_b,
+         T* C, size_t ldc, size_t stride_c,
+         size_t threads) {
+    parallel::for_range(count, grain(rows * cols), [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            for (size_t r = 0; r < rows; r++) {
+                simd::add(A + i * stride_a + r * lda, B + i * stride_b + r * ldb,
+                          C + i * stride_c + r * ldc, cols);
+            }
+        }
+    }, threads);
+}
+
+template <typename T>
+void transpose(size_t count, size_t rows, size_t cols,
+               const T* A, size_t lda, size_t stride_a,
+               T* C, size_t ldc, size_t stride_c,
+               size_t threads) {
+    parallel::for_range(count, grain(rows * cols), [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            transposition::out_of_place(A + i * stride_a, rows, cols, lda, C + i * stride_c, ldc);
+        }
+    }, threads);
+}
+
+template class Interleaved<float>;
+template class Interleaved<double>;
+
+#define BATCHED_INSTANTIATE(T)                                                                   \
+    template void multiply(const Interleaved<T>&, const Interleaved<T>&, Interleaved<T>&, size_t); \
+    template void add(const Interleaved<T>&, const Interleaved<T>&, Interleaved<T>&, size_t);      \
+    template void transpose(const Interleaved<T>&, Interleaved<T>&, size_t);                      \
+    template void multiply(size_t, size_t, size_t, size_t, T, const T*, size_t, size_t,            \
+                           const T*, size_t, size_t, T, T*, size_t, size_t, size_t);               \
+    template void add(size_t, size_t, size_t, const T*, size_t, size_t, const T*, size_t, size_t,  \
+                      T*, size_t, size_t, size_t);                                                 \
+    template void transpose(size_t, size_t, size_t, const T*, size_t, size_t, T*, size_t, size_t,  \
+                            size_t);
+
+BATCHED_INSTANTIATE(float)
+BATCHED_INSTANTIATE(double)
+
+}
@@ -0,0 +1,113 @@
+#ifndef BATCHED_H
+#define BATCHED_H
+
+#include <cstddef>
+#include <vector>
+#include "matrix_allocator.h"
+
+// Operations on large batches of small, same-shaped matrices (think
+// tens of thousands of 8x8 .. 64x64). Going through Matrix for each one
+// pays an allocation and a thread pool dispatch per pair, and an 8x8
+// product is too small for the blocked gemm to get going.
+//
+// The trick for the product is to vectorize across the batch instead of
+// inside a matrix. Interleaved<T> stores LANES matrices side by side,
+// element (r, c) of all of them next to each other:
+//
+//     group g: [ (0,0) of LANES matrices ][ (0,1) of LANES matrices ] ...
+//
+// so one vector register holds the same element of LANES different
+// matrices and the product is the plain triple loop with every scalar
+// op turned into a full width vector op, whatever the matrix size.
+//
+// The strided functions take the usual layout, matrix i starting at
+// ptr + i * stride with row stride ld, and interleave LANES matrices at
+// a time internally. Everything is split over the thread pool by
+// batch entries. Compiled for float and double.
+namespace batched {
+
+    // one cache line (and one AVX-512 register) per element
+    template <typename T>
+    constexpr size_t lanes = 64 / sizeof(T);
+
+    // below this many multiply-adds per thread the batch stays on one thread
+    constexpr size_t PARALLEL_MIN_WORK = 1 << 16;
+
+    template <typename T>
+    class Interleaved {
+
+    public:
+
+        static constexpr size_t LANES = lanes<T>;
+
+        // count zero filled rows x cols matrices. the last group gets
+        // padded out to LANES, the padding is just never read back
+        Interleaved(size_t count, size_t rows, size_t cols);
+
+        // from / to count matrices at src + i * stride, row stride ld
+        static Interleaved pack(size_t count, size_t rows, size_t cols,
+                                const T* src, size_t ld, size_t stride);
+        void unpack(T* dst, size_t ld, size_t stride) const;
+
+        T& operator()(size_t b, size_t r, size_t c) { return data[index(b, r, c)]; }
+        const T& operator()(size_t b, size_t r, size_t c) const { return data[index(b, r, c)]; }
+
+        size_t count() const { return num; }
+        size_t rows() const { return num_rows; }
+        size_t cols() const { return num_cols; }
+        size_t groups() const { return (num + LANES - 1) / LANES; }
+
+        // rows * cols * LANES values for matrices [g * LANES, g * LANES + LANES)
+        T* group(size_t g) { return data.data() + g * num_rows * num_cols * LANES; }
+        const T* group(size_t g) const { return data.data() + g * num_rows * num_cols * LANES; }
+
+    private:
+
+        std::vector<T, MatrixAllocator<T>> data;
+        size_t num, num_rows, num_cols;
+
+        size_t index(size_t b, size_t r, size_t c) const {
+            return ((b / LANES) * num_rows * num_cols + r * num_cols + c) * LANES + b % LANES;
+        }
+
+    };
+
+    // C[i] = A[i] * B[i] for every i. throws std::invalid_argument if the
+    // counts or inner sizes dont match, or if C is A or B (C gets written
+    // while they are still read), C is resized to fit
+    template <typename T>
+    void multiply(const Interleaved<T>& A, const Interleaved<T>& B, Interleaved<T>& C, size_t threads = 0);
+
+    template <typename T>
+    void add(const Interleaved<T>& A, const Interleaved<T>& B, Interleaved<T>& C, size_t threads = 0);
+
+    template <typename T>
+    void transpose(const Interleaved<T>& A, Interleaved<T>& C, size_t threads = 0);
+
+    // C[i] = alpha * A[i] * B[i] + beta * C[i] for i in [0, count), A[i]
+    // m x k, B[i] k x n. like gemm::multiply, C isnt read when beta is 0
+    template <typename T>
+    void multiply(size_t count, size_t m, size_t n, size_t k,
+                  T alpha, const T* A, size_t lda, size_t stride_a,
+                  const T* B, size_t ldb, size_t stride_b,
+                  T beta, T* C, size_t ldc, size_t stride_c,
+                  size_t threads = 0);
+
+    // C[i] = A[i] + B[i], all rows x cols
+    template <typename T>
+    void add(size_t count, size_t rows, size_t cols,
+             const T* A, size_t lda, size_t stride_a,
+             const T* B, size_t ldb, size_t stride_b,
+             T* C, size_t ldc, size_t stride_c,
+             size_t threads = 0);
+
+    // C[i] = A[i]^T, A[i] rows x cols
+    template <typename T>
+    void transpose(size_t count, size_t rows, size_t cols,
+                   const T* A, size_t lda, size_t stride_a,
+                   T* C, size_t ldc, size_t stride_c,
+                   size_t threads = 0);
+
+}
+
+#endif
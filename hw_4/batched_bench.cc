@@ -0,0 +1,66 @@
+#include "batched.h"
+#include "matrix.h"
+#include "benchmark/benchmark.h"
+#include <vector>
+
+namespace {
+
+    constexpr size_t COUNT = 10000;
+
+    // 2*n^3 flops per product, COUNT products per iteration
+    void set_flops(benchmark::State& state, size_t n) {
+        state.counters["GFLOP/s"] = benchmark::Counter(
+            2.0 * n * n * n * COUNT, benchmark::Counter::kIsIterationInvariantRate,
+            benchmark::Counter::kIs1000);
+    }
+
+    // the baseline, one Matrix product per pair
+    void BM_LoopMatrix(benchmark::State& state) {
+        size_t n = state.range(0);
+        std::vector<Matrix> A(COUNT, Matrix(n, n, 1.5)), B(COUNT, Matrix(n, n, 0.5));
+        std::vector<Matrix> C(COUNT, Matrix(n, n));
+        for (auto _ : state) {
+            for (size_t i = 0; i < COUNT; i++) {
+                C[i] = A[i] * B[i];
+            }
+            benchmark::DoNotOptimize(&C[0](0, 0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK(BM_LoopMatrix)->Arg(8)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+
+    template <typename T>
+    void BM_BatchedStrided(benchmark::State& state) {
+        size_t n = state.range(0);
+        std::vector<T> A(COUNT * n * n, T(1.5)), B(COUNT * n * n, T(0.5)), C(COUNT * n * n);
+        for (auto _ : state) {
+            batched::multiply<T>(COUNT, n, n, n, T(1), A.data(), n, n * n, B.data(), n, n * n,
+                                 T(0), C.data(), n, n * n);
+            benchmark::DoNotOptimize(C.data());
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK_TEMPLATE(BM_BatchedStrided, double)->Arg(8)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+    BENCHMARK_TEMPLATE(BM_BatchedStrided, float)->Arg(8)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+
+    // already interleaved, no packing
+    template <typename T>
+    void BM_BatchedInterleaved(benchmark::State& state) {
+        size_t n = state.range(0);
+        std::vector<T> src(COUNT * n * n, T(1.5));
+        auto A = batched::Interleaved<T>::pack(COUNT, n, n, src.data(), n, n * n);
+        auto B = A;
+        batched::Interleaved<T> C(COUNT, n, n);
+        for (auto _ : state) {
+            batched::multiply(A, B, C);
+            benchmark::DoNotOptimize(C.group(0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK_TEMPLATE(BM_BatchedInterleaved, double)->Arg(8)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+    BENCHMARK_TEMPLATE(BM_BatchedInterleaved, float)->Arg(8)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+
+}
@@ -0,0 +1,264 @@
+#include "decomposition.h"
+#include "gemm.h"
+#include "transpose.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// row[i] -= scale * src[i] for i in [0, n)
+void axpy_row(double* row, const double* src, double scale, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        row[i] -= scale * src[i];
+    }
+}
+
+// B = L^-1 B, L lower triangular n x n. unit means the diagonal is
+// taken as 1 (the L of an LU) instead of read
+void forward_substitute(const double* L, size_t ldl, bool unit,
+                        double* B, size_t n, size_t nrhs) {
+    for (size_t i = 0; i < n; i++) {
+        double* row = B + i * nrhs;
+        for (size_t r = 0; r < i; r++) {
+            axpy_row(row, B + r * nrhs, L[i * ldl + r], nrhs);
+        }
+        if (!unit) {
+            double d = L[i * ldl + i];
+            for (size_t c = 0; c < nrhs; c++) {
+                row[c] /= d;
+            }
+        }
+    }
+}
+
+// B = U^-1 B, U upper triangular. with transposed set, U is read as the
+// transpose of the lower triangle instead (the L^T of a Cholesky)
+void back_substitute(const double* U, size_t ldu, bool transposed,
+                     double* B, size_t n, size_t nrhs) {
+    for (size_t i = n; i-- > 0;) {
+        double* row = B + i * nrhs;
+        for (size_t r = i + 1; r < n; r++) {
+            double u = transposed ? U[r * ldu + i] : U[i * ldu + r];
+            axpy_row(row, B + r * nrhs, u, nrhs);
+        }
+        double d = U[i * ldu + i];
+        for (size_t c = 0; c < nrhs; c++) {
+            row[c] /= d;
+        }
+    }
+}
+
+void check_square(const Matrix& a, const char* what) {
+    if (!a.isSquare()) {
+        throw std::logic_error(what);
+    }
+}
+
+}
+
+/* ======= LU ======= */
+
+LU::LU(const Matrix& a) : lu(a), perm(a.rows()), sign(1), singular(false) {
+    check_square(a, "LU needs a square matrix");
+    size_t n = lu.rows();
+    double* A = lu.view().data();
+    for (size_t i = 0; i < n; i++) {
+        perm[i] = i;
+    }
+
+    for (size_t k = 0; k < n; k += NB) {
+        size_t kb = std::min(NB, n - k);
+
+        // factor the panel A[k:n, k:k+kb] column by column
+        for (size_t j = k; j < k + kb; j++) {
+            size_t p = j;
+            for (size_t i = j + 1; i < n; i++) {
+                if (std::fabs(A[i * n + j]) > std::fabs(A[p * n + j])) {
+                    p = i;
+                }
+            }
+            if (p != j) {
+                // swapping whole rows applies the pivot to the already
+                // factored L columns and the trailing matrix in one go
+                std::swap_ranges(A + j * n, A + j * n + n, A + p * n);
+                std::swap(perm[j], perm[p]);
+                sign = -sign;
+            }
+
+            double pivot = A[j * n + j];
+            if (pivot == 0.0) {
+                singular = true;
+                continue;
+            }
+            for (size_t i = j + 1; i < n; i++) {
+                double l = A[i * n + j] /= pivot;
+                // rank one update of the rest of the panel only
+                axpy_row(A + i * n + j + 1, A + j * n + j + 1, l, k + kb - j - 1);
+            }
+        }
+
+        size_t rest = n - k - kb;
+        if (rest == 0) {
+            break;
+        }
+
+        // U12 = L11^-1 A12
+        for (size_t i = k + 1; i < k + kb; i++) {
+            for (size_t r = k; r < i; r++) {
+                axpy_row(A + i * n + k + kb, A + r * n + k + kb, A[i * n + r], rest);
+            }
+        }
+
+        // A22 -= L21 * U12, the big one
+        gemm::multiply(rest, rest, kb,
+                       -1.0, A + (k + kb) * n + k, n,
+                       A + k * n + k + kb, n,
+                       1.0, A + (k + kb) * n + k + kb, n);
+    }
+}
+
+bool LU::isSingular() const {
+    return singular;
+}
+
+double LU::determinant() const {
+    if (singular) {
+        return 0.0;
+    }
+    double det = sign;
+    for (size_t i = 0; i < lu.rows(); i++) {
+        det *= lu(i, i);
+    }
+    return det;
+}
+
+Matrix LU::solve(const Matrix& b) const {
+    if (b.rows() != lu.rows()) {
+        throw std::invalid_argument("right hand side has the wrong number of rows");
+    }
+    if (singular) {
+        throw std::runtime_error("matrix is singular");
+    }
+    size_t n = lu.rows(), nrhs = b.cols();
+    Matrix x(n, nrhs);
+    for (size_t i = 0; i < n; i++) {
+        x.row(i) = b.row(perm[i]);
+    }
+    const double* A = lu.view().data();
+    forward_substitute(A, n, true, x.view().data(), n, nrhs);
+    back_substitute(A, n, false, x.view().data(), n, nrhs);
+    return x;
+}
+
+Matrix LU::inverse() const {
+    return solve(Matrix::identity(lu.rows()));
+}
+
+const Matrix& LU::factors() const {
+    return lu;
+}
+
+const std::vector<size_t>& LU::pivots() const {
+    return perm;
+}
+
+/* ======= Cholesky ======= */
+
+Cholesky::Cholesky(const Matrix& a) : L(a) {
+    check_square(a, "Cholesky needs a square matrix");
+    size_t n = L.rows();
+    double* A = L.view().data();
+    std::vector<double> panel_t;
+
+    for (size_t k = 0; k < n; k += NB) {
+        size_t kb = std::min(NB, n - k);
+
+        // L11 = chol(A11), earlier blocks are already subtracted off
+        for (size_t j = k; j < k + kb; j++) {
+            double d = A[j * n + j];
+            for (size_t p = k; p < j; p++) {
+                d -= A[j * n + p] * A[j * n + p];
+            }
+            if (!(d > 0.0)) {
+                throw std::domain_error("matrix is not positive definite");
+            }
+            d = std::sqrt(d);
+            A[j * n + j] = d;
+            for (size_t i = j + 1; i < k + kb; i++) {
+                double s = A[i * n + j];
+                for (size_t p = k; p < j; p++) {
+                    s -= A[i * n + p] * A[j * n + p];
+                }
+                A[i * n + j] = s / d;
+            }
+        }
+
+        size_t rest = n - k - kb;
+        if (rest == 0) {
+            break;
+        }
+
+        // L21 = A21 * L11^-T, one row at a time
+        for (size_t i = k + kb; i < n; i++) {
+            for (size_t j = k; j < k + kb; j++) {
+                double s = A[i * n + j];
+                for (size_t p = k; p < j; p++) {
+                    s -= A[i * n + p] * A[j * n + p];
+                }
+                A[i * n + j] = s / A[j * n + j];
+            }
+        }
+
+        // A22 -= L21 * L21^T. gemm wants B row-major, so L21 gets
+        // transposed into a scratch panel first. only the lower triangle
+        // of A22 is ever read, so only the block columns on and below
+        // the diagonal get updated, one gemm per UPDATE_WIDTH columns.
+        // that is about half the flops of updating all of A22
+        panel_t.resize(kb * rest);
+        transposition::out_of_place(A + (k + kb) * n + k, rest, kb, n, panel_t.data(), rest);
+        for (size_t jb = 0; jb < rest; jb += UPDATE_WIDTH) {
+            size_t w = std::min(UPDATE_WIDTH, rest - jb);
+            size_t row = k + kb + jb;
+            gemm::multiply(rest - jb, w, kb,
+                           -1.0, A + row * n + k, n,
+                           panel_t.data() + jb, rest,
+                           1.0, A + row * n + k + kb + jb, n);
+        }
+    }
+
+    // clear out whatever was left above the diagonal
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            A[i * n + j] = 0.0;
+        }
+    }
+}
+
+double Cholesky::determinant() const {
+    double det = 1.0;
+    for (size_t i = 0; i < L.rows(); i++) {
+        det *= L(i, i);
+    }
+    return det * det;
+}
+
+Matrix Cholesky::solve(const Matrix& b) const {
+    if (b.rows() != L.rows()) {
+        throw std::invalid_argument("right hand side has the wrong number of rows");
+    }
+    size_t n = L.rows();
+    Matrix x = b;
+    const double* A = L.view().data();
+    forward_substitute(A, n, false, x.view().data(), n, x.cols());
+    back_substitute(A, n, true, x.view().data(), n, x.cols());
+    return x;
+}
+
+Matrix Cholesky::inverse() const {
+    return solve(Matrix::identity(L.rows()));
+}
+
+const Matrix& Cholesky::factor() const {
+    return L;
+}
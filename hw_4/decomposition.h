@@ -0,0 +1,75 @@
+#ifndef DECOMPOSITION_H
+#define DECOMPOSITION_H
+
+#include <cstddef>
+#include <vector>
+#include "matrix.h"
+
+// Dense factorizations for solving linear systems. Both are blocked:
+// a narrow panel of NB columns is factored with plain loops, then the
+// rest of the matrix gets one big trailing update through the blocked
+// gemm kernel, which is where nearly all the flops end up.
+
+// P * A = L * U with partial (row) pivoting, for any square A.
+// Throws std::logic_error if A isnt square. A singular A still factors,
+// but solve() and inverse() then throw std::runtime_error.
+class LU {
+
+public:
+
+    static constexpr size_t NB = 64;  // panel width
+
+    explicit LU(const Matrix& a);
+
+    bool isSingular() const;
+    double determinant() const;
+
+    // X with A * X = B, B can have any number of columns
+    Matrix solve(const Matrix& b) const;
+    Matrix inverse() const;
+
+    // L (unit diagonal, not stored) and U packed into one matrix
+    const Matrix& factors() const;
+
+    // row i of the factored matrix came from row pivots()[i] of A
+    const std::vector<size_t>& pivots() const;
+
+private:
+
+    Matrix lu;
+    std::vector<size_t> perm;
+    int sign;          // +1 / -1 for an even / odd number of row swaps
+    bool singular;
+
+};
+
+// A = L * L^T for symmetric positive definite A, about half the work of
+// LU and no pivoting needed. Only the lower triangle of A is read.
+// Throws std::logic_error if A isnt square and std::domain_error if it
+// turns out not to be positive definite.
+class Cholesky {
+
+public:
+
+    static constexpr size_t NB = 64;
+    // block columns of the trailing update. the diagonal blocks get
+    // their upper triangle updated too, wider wastes more of that,
+    // narrower gives gemm less to work with
+    static constexpr size_t UPDATE_WIDTH = 128;
+
+    explicit Cholesky(const Matrix& a);
+
+    double determinant() const;
+    Matrix solve(const Matrix& b) const;
+    Matrix inverse() const;
+
+    // the lower triangular factor, zeros above the diagonal
+    const Matrix& factor() const;
+
+private:
+
+    Matrix L;
+
+};
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef FIXED_MATRIX_H
+#define FIXED_MATRIX_H
+
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include "matrix.h"
+
+// Matrix with its size baked into the type, for the little 2x2 / 3x3 /
+// 4x4 transforms. Storage is a plain array inside the object (no heap),
+// every loop has a compile time trip count and gets unrolled, and
+// adding a 2x3 to a 3x2 or multiplying mismatched sizes is a compile
+// error instead of an exception. Almost everything is constexpr.
+//
+// Converts to and from the dynamic Matrix, see to_matrix() and the
+// explicit Matrix constructor.
+
+namespace fixed_detail {
+
+    // f(0), f(1), ..., f(N - 1), expanded at compile time
+    template <typename F, size_t... Is>
+    constexpr void unroll(F&& f, std::index_sequence<Is...>) {
+        (f(Is), ...);
+    }
+
+    template <size_t N, typename F>
+    constexpr void unroll(F&& f) {
+        unroll(std::forward<F>(f), std::make_index_sequence<N>());
+    }
+
+}
+
+template <size_t R, size_t C>
+class FixedMatrix {
+
+    static_assert(R > 0 && C > 0, "FixedMatrix needs at least one row and column");
+
+public:
+
+    // constructors, zero filled by default like Matrix
+    constexpr FixedMatrix() : values{} {}
+
+    constexpr explicit FixedMatrix(double value) : values{} {
+        fill(value);
+    }
+
+    // {{1, 2}, {3, 4}}. short rows are padded with 0, too many rows or
+    // columns throws (or fails to compile in a constexpr context)
+    constexpr FixedMatrix(std::initializer_list<std::initializer_list<double>> list) : values{} {
+        if (list.size() > R) {
+            throw std::invalid_argument("too many rows for FixedMatrix");
+        }
+        size_t r = 0;
+        for (auto& row : list) {
+            if (row.size() > C) {
+                throw std::invalid_argument("too many columns for FixedMatrix");
+            }
+            size_t c = 0;
+            for (auto& val : row) {
+                values[r * C + c] = val;
+                c++;
+            }
+            r++;
+        }
+    }
+
+    // from a dynamic Matrix (or a view of one), sizes checked at runtime
+    template <typename T>
+    explicit FixedMatrix(const BasicMatrixView<T>& m) : values{} {
+        if (m.rows() != R || m.cols() != C) {
+            throw std::invalid_argument("matrix dimensions dont match FixedMatrix");
+        }
+        for (size_t r = 0; r < R; r++) {
+            for (size_t c = 0; c < C; c++) {
+                values[r * C + c] = m(r, c);
+            }
+        }
+    }
+
+    explicit FixedMatrix(const Matrix& m) : FixedMatrix(m.view()) {}
+
+    Matrix to_matrix() const {
+        Matrix res(R, C);
+        for (size_t r = 0; r < R; r++) {
+            for (size_t c = 0; c < C; c++) {
+                res(r, c) = values[r * C + c];
+            }
+        }
+        return res;
+    }
+
+    // views straight into the fixed storage, so these can be used with
+    // the dynamic Matrix operators without a copy
+    MatrixView view() { return MatrixView(values, R, C, C); }
+    ConstMatrixView view() const { return ConstMatrixView(values, R, C, C); }
+
+    // element access stuff
+    constexpr double& operator()(size_t row, size_t col) { return values[row * C + col]; }
+    constexpr const double& operator()(size_t row, size_t col) const { return values[row * C + col]; }
+
+    constexpr double& at(size_t row, size_t col) {
+        if (row >= R || col >= C) {
+            throw std::out_of_range("index out of range");
+        }
+        return values[row * C + col];
+    }
+
+    constexpr const double& at(size_t row, size_t col) const {
+        if (row >= R || col >= C) {
+            throw std::out_of_range("index out of range");
+        }
+        return values[row * C + col];
+    }
+
+    static constexpr size_t rows() { return R; }
+    static constexpr size_t cols() { return C; }
+    static constexpr bool isSquare() { return R == C; }
+
+    // operators, same size only
+    constexpr FixedMatrix operator+(const FixedMatrix& other) const {
+        FixedMatrix res;
+        fixed_detail::unroll<R * C>([&](size_t i) { res.values[i] = values[i] + other.values[i]; });
+        return res;
+    }
+
+    constexpr FixedMatrix operator-(const FixedMatrix& other) const {
+        FixedMatrix res;
+        fixed_detail::unroll<R * C>([&](size_t i) { res.values[i] = values[i] - other.values[i]; });
+        return res;
+    }
+
+    constexpr FixedMatrix operator*(double scalar) const {
+        FixedMatrix res;
+        fixed_detail::unroll<R * C>([&](size_t i) { res.values[i] = values[i] * scalar; });
+        return res;
+    }
+
+    constexpr friend FixedMatrix operator*(double scalar, const FixedMatrix& m) {
+        return m * scalar;
+    }
+
+    constexpr FixedMatrix operator/(double scalar) const {
+        FixedMatrix res;
+        fixed_detail::unroll<R * C>([&](size_t i) { res.values[i] = values[i] / scalar; });
+        return res;
+    }
+
+    constexpr FixedMatrix operator-() const {
+        FixedMatrix res;
+        fixed_detail::unroll<R * C>([&](size_t i) { res.values[i] = -values[i]; });
+        return res;
+    }
+
+    // (R x C) * (C x K), the inner sizes have to agree or it wont compile
+    template <size_t K>
+    constexpr FixedMatrix<R, K> operator*(const FixedMatrix<C, K>& other) const {
+        FixedMatrix<R, K> res;
+        fixed_detail::unroll<R * K>([&](size_t ij) {
+            size_t i = ij / K, j = ij % K;
+            double sum = 0;
+            fixed_detail::unroll<C>([&](size_t k) { sum += values[i * C + k] * other(k, j); });
+            res(i, j) = sum;
+        });
+        return res;
+    }
+
+    constexpr FixedMatrix& operator+=(const FixedMatrix& other) {
+        fixed_detail::unroll<R * C>([&](size_t i) { values[i] += other.values[i]; });
+        return *this;
+    }
+
+    constexpr FixedMatrix& operator-=(const FixedMatrix& other) {
+        fixed_detail::unroll<R * C>([&](size_t i) { values[i] -= other.values[i]; });
+        return *this;
+    }
+
+    constexpr FixedMatrix& operator*=(double scalar) {
+        fixed_detail::unroll<R * C>([&](size_t i) { values[i] *= scalar; });
+        return *this;
+    }
+
+    constexpr FixedMatrix& operator/=(double scalar) {
+        fixed_detail::unroll<R * C>([&](size_t i) { values[i] /= scalar; });
+        return *this;
+    }
+
+    // only square matrices can be multiplied in place
+    template <size_t K = C, typename = typename std::enable_if<K == R>::type>
+    constexpr FixedMatrix& operator*=(const FixedMatrix& other) {
+        *this = *this * other;
+        return *this;
+    }
+
+    // comparision, same EPSILON tolerance as Matrix
+    constexpr bool operator==(const FixedMatrix& other) const {
+        bool same = true;
+        fixed_detail::unroll<R * C>([&](size_t i) {
+            double d = values[i] - other.values[i];
+            same = same && !(d > EPSILON || -d > EPSILON);
+        });
+        return same;
+    }
+
+    constexpr bool operator!=(const FixedMatrix& other) const {
+        return !(*this == other);
+    }
+
+    // other operations
+    constexpr FixedMatrix<C, R> transpose() const {
+        FixedMatrix<C, R> res;
+        fixed_detail::unroll<R * C>([&](size_t i) { res(i % C, i / C) = values[i]; });
+        return res;
+    }
+
+    constexpr double trace() const {
+        static_assert(R == C, "trace needs a square matrix");
+        double sum = 0;
+        fixed_detail::unroll<R>([&](size_t i) { sum += values[i * C + i]; });
+        return sum;
+    }
+
+    constexpr FixedMatrix<(R < C ? R : C), 1> diagonal() const {
+        FixedMatrix<(R < C ? R : C), 1> res;
+        fixed_detail::unroll<(R < C ? R : C)>([&](size_t i) { res(i, 0) = values[i * C + i]; });
+        return res;
+    }
+
+    constexpr void fill(double value) {
+        fixed_detail::unroll<R * C>([&](size_t i) { values[i] = value; });
+    }
+
+    double norm() const {
+        double sum = 0;
+        fixed_detail::unroll<R * C>([&](size_t i) { sum += values[i] * values[i]; });
+        return std::sqrt(sum);
+    }
+
+    // static factory stuff
+    static constexpr FixedMatrix identity() {
+        static_assert(R == C, "identity needs a square matrix");
+        FixedMatrix res;
+        fixed_detail::unroll<R>([&](size_t i) { res.values[i * C + i] = 1.0; });
+        return res;
+    }
+
+    static constexpr FixedMatrix zeros() { return FixedMatrix(); }
+    static constexpr FixedMatrix ones() { return FixedMatrix(1.0); }
+
+private:
+
+    double values[R * C];
+    static constexpr double EPSILON = 1e-6;
+
+};
+
+using Matrix2 = FixedMatrix<2, 2>;
+using Matrix3 = FixedMatrix<3, 3>;
+using Matrix4 = FixedMatrix<4, 4>;
+
+#endif
@@ -0,0 +1,272 @@
+#include "gemm.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <complex>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__clang__)
+#define GEMM_CLONES __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#else
+#define GEMM_CLONES
+#endif
+
+namespace gemm {
+
+namespace {
+
+// Everything here is templated on three types: In for A and B, Acc for
+// the packed panels and the accumulator, Out for C. Normally they are
+// all the same, the mixed precision version packs float into double
+// panels, which costs nothing extra since packing copies anyway.
+
+// copy an mc x kc block of A into row panels of MR rows. each panel is
+// stored column by column (MR values per k) so the micro kernel reads
+// it front to back. short panels at the bottom get padded with zeros.
+template <typename In, typename Acc>
+void pack_A(size_t mc, size_t kc, const In* A, size_t lda, Acc* Ap) {
+    for (size_t i = 0; i < mc; i += MR) {
+        size_t mr = std::min(MR, mc - i);
+        for (size_t p = 0; p < kc; p++) {
+            for (size_t ii = 0; ii < mr; ii++) {
+                *Ap++ = Acc(A[(i + ii) * lda + p]);
+            }
+            for (size_t ii = mr; ii < MR; ii++) {
+                *Ap++ = Acc(0);
+            }
+        }
+    }
+}
+
+// same idea for a kc x nc block of B, column panels of NR wide
+template <typename In, typename Acc>
+void pack_B(size_t kc, size_t nc, const In* B, size_t ldb, Acc* Bp) {
+    for (size_t j = 0; j < nc; j += NR) {
+        size_t nr = std::min(NR, nc - j);
+        for (size_t p = 0; p < kc; p++) {
+            const In* row = B + p * ldb + j;
+            for (size_t jj = 0; jj < nr; jj++) {
+                *Bp++ = Acc(row[jj]);
+            }
+            for (size_t jj = nr; jj < NR; jj++) {
+                *Bp++ = Acc(0);
+            }
+        }
+    }
+}
+
+// the k loop of the MR x NR register tile, ab += A panel * B panel.
+// the accumulator is small enough that it stays in vector registers and
+// the loop is just broadcasts and multiply-adds
+template <typename Acc>
+inline __attribute__((always_inline)) void accumulate(size_t kc, const Acc* Ap, const Acc* Bp,
+                                                      Acc (&out)[MR][NR]) {
+    // a local tile, out could alias the panels as far as the compiler
+    // knows and would be stored back every iteration
+    Acc ab[MR][NR] = {};
+    for (size_t p = 0; p < kc; p++) {
+        // -O2 doesnt unroll these by itself, and rolled up the tile lives
+        // in memory instead of registers
+        #pragma GCC unroll 16
+        for (size_t i = 0; i < MR; i++) {
+            Acc a = Ap[i];
+            #pragma GCC unroll 16
+            for (size_t j = 0; j < NR; j++) {
+                ab[i][j] += a * Bp[j];
+            }
+        }
+        Ap += MR;
+        Bp += NR;
+    }
+    for (size_t i = 0; i < MR; i++) {
+        for (size_t j = 0; j < NR; j++) {
+            out[i][j] = ab[i][j];
+        }
+    }
+}
+
+// the plain build is SSE2 only, two doubles per register and no fma.
+// double and float tiles get clones for AVX-512 and AVX2 + FMA picked at
+// load time, like BATCHED_CLONES in batched.cc. complex and anything
+// else use the template below as it is
+template <typename Acc>
+void accumulate_tile(size_t kc, const Acc* Ap, const Acc* Bp, Acc (&ab)[MR][NR]) {
+    accumulate(kc, Ap, Bp, ab);
+}
+
+GEMM_CLONES
+void accumulate_tile(size_t kc, const double* Ap, const double* Bp, double (&ab)[MR][NR]) {
+    accumulate(kc, Ap, Bp, ab);
+}
+
+GEMM_CLONES
+void accumulate_tile(size_t kc, const float* Ap, const float* Bp, float (&ab)[MR][NR]) {
+    accumulate(kc, Ap, Bp, ab);
+}
+
+// one MR x NR tile of C. mr/nr are the valid part of the tile at the edges.
+template <typename Acc, typename Out>
+void micro_kernel(size_t kc, const Acc* Ap, const Acc* Bp,
+                  Acc alpha, Acc beta, Out* C, size_t ldc,
+                  size_t mr, size_t nr) {
+    Acc ab[MR][NR];
+    accumulate_tile(kc, Ap, Bp, ab);
+
+    for (size_t i = 0; i < mr; i++) {
+        Out* c = C + i * ldc;
+        if (beta == Acc(0)) {
+            for (size_t j = 0; j < nr; j++) {
+                c[j] = Out(alpha * ab[i][j]);
+            }
+        } else {
+            for (size_t j = 0; j < nr; j++) {
+                c[j] = Out(alpha * ab[i][j] + beta * Acc(c[j]));
+            }
+        }
+    }
+}
+
+// C = beta * C, used when k == 0 so there is nothing to multiply
+template <typename Acc, typename Out>
+void scale(size_t m, size_t n, Acc beta, Out* C, size_t ldc) {
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            C[i * ldc + j] = (beta == Acc(0)) ? Out(0) : Out(beta * Acc(C[i * ldc + j]));
+        }
+    }
+}
+
+size_t round_up(size_t x, size_t to) {
+    return (x + to - 1) / to * to;
+}
+
+template <typename In, typename Acc, typename Out>
+void blocked(size_t m, size_t n, size_t k,
+             Acc alpha, const In* A, size_t lda,
+             const In* B, size_t ldb,
+             Acc beta, Out* C, size_t ldc,
+             size_t threads) {
+    if (m == 0 || n == 0) {
+        return;
+    }
+    if (k == 0 || alpha == Acc(0)) {
+        scale(m, n, beta, C, ldc);
+        return;
+    }
+    if (m * n * k < PARALLEL_MIN_WORK) {
+        threads = 1;
+    }
+
+    std::vector<Acc> Bp(KC * round_up(std::min(NC, n), NR));
+    size_t row_blocks = (m + MC - 1) / MC;
+
+    for (size_t jc = 0; jc < n; jc += NC) {
+        size_t nc = std::min(NC, n - jc);
+        for (size_t pc = 0; pc < k; pc += KC) {
+            size_t kc = std::min(KC, k - pc);
+            // only the first k block sees the callers beta, the rest
+            // accumulate on top of it
+            Acc b = (pc == 0) ? beta : Acc(1);
+
+            // B panel is packed once and shared, every thread packs its
+            // own blocks of A and owns a disjoint set of rows of C
+            pack_B(kc, nc, B + pc * ldb + jc, ldb, Bp.data());
+
+            parallel::for_range(row_blocks, 1, [&](size_t first, size_t last) {
+                std::vector<Acc> Ap(MC * KC);
+                for (size_t blk = first; blk < last; blk++) {
+                    size_t ic = blk * MC;
+                    size_t mc = std::min(MC, m - ic);
+                    pack_A(mc, kc, A + ic * lda + pc, lda, Ap.data());
+
+                    for (size_t jr = 0; jr < nc; jr += NR) {
+                        size_t nr = std::min(NR, nc - jr);
+                        for (size_t ir = 0; ir < mc; ir += MR) {
+                            size_t mr = std::min(MR, mc - ir);
+                            micro_kernel(kc, Ap.data() + ir * kc, Bp.data() + jr * kc,
+                                         alpha, b, C + (ic + ir) * ldc + jc + jr, ldc,
+                                         mr, nr);
+                        }
+                    }
+                }
+            }, threads);
+        }
+    }
+}
+
+}
+
+void multiply(size_t m, size_t n, size_t k,
+              double alpha, const double* A, size_t lda,
+              const double* B, size_t ldb,
+              double beta, double* C, size_t ldc,
+              size_t threads) {
+    blocked(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, threads);
+}
+
+void multiply(size_t m, size_t n, size_t k,
+              float alpha, const float* A, size_t lda,
+              const float* B, size_t ldb,
+              float beta, float* C, size_t ldc,
+              size_t threads) {
+    blocked(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, threads);
+}
+
+void multiply(size_t m, size_t n, size_t k,
+              std::complex<double> alpha, const std::complex<double>* A, size_t lda,
+              const std::complex<double>* B, size_t ldb,
+              std::complex<double> beta, std::complex<double>* C, size_t ldc,
+              size_t threads) {
+    blocked(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, threads);
+}
+
+void multiply_mixed(size_t m, size_t n, size_t k,
+                    double alpha, const float* A, size_t lda,
+                    const float* B, size_t ldb,
+                    double beta, float* C, size_t ldc,
+                    size_t threads) {
+    if (k <= KC) {
+        blocked(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, threads);
+        return;
+    }
+    // C gets revisited once per KC block, so a float C would round the
+    // running sum every time. accumulate into a double copy instead and
+    // round once at the end
+    std::vector<double> acc(m * n);
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            acc[i * n + j] = (beta == 0.0) ? 0.0 : beta * double(C[i * ldc + j]);
+        }
+    }
+    blocked(m, n, k, alpha, A, lda, B, ldb, 1.0, acc.data(), n, threads);
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            C[i * ldc + j] = float(acc[i * n + j]);
+        }
+    }
+}
+
+void multiply_mixed(size_t m, size_t n, size_t k,
+                    double alpha, const float* A, size_t lda,
+                    const float* B, size_t ldb,
+                    double beta, double* C, size_t ldc,
+                    size_t threads) {
+    blocked(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, threads);
+}
+
+void multiply_naive(size_t m, size_t n, size_t k,
+                    double alpha, const double* A, size_t lda,
+                    const double* B, size_t ldb,
+                    double beta, double* C, size_t ldc) {
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            double sum = 0;
+            for (size_t p = 0; p < k; p++) {
+                sum = sum + A[i * lda + p] * B[p * ldb + j];
+            }
+            double old = (beta == 0.0) ? 0.0 : beta * C[i * ldc + j];
+            C[i * ldc + j] = alpha * sum + old;
+        }
+    }
+}
+
+}
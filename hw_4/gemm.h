@@ -0,0 +1,77 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <complex>
+#include <cstddef>
+
+// General matrix multiply on raw row-major buffers:
+//
+//     C = alpha * A * B + beta * C
+//
+// A is m x k, B is k x n, C is m x n. lda/ldb/ldc are the row strides
+// (number of doubles between the start of consecutive rows), so the
+// routines also work on sub-blocks of a bigger matrix. When beta is 0
+// C is never read, so it can hold garbage.
+namespace gemm {
+
+    // cache blocking parameters. MC x KC block of A should sit in L2,
+    // a KC x NR sliver of B in L1, and NC wide panels of B in L3.
+    constexpr size_t MR = 4;
+    constexpr size_t NR = 8;
+    constexpr size_t MC = 96;
+    constexpr size_t KC = 256;
+    constexpr size_t NC = 4096;
+
+    // below this many multiply-adds (m*n*k) multiply stays on one thread
+    constexpr size_t PARALLEL_MIN_WORK = 64 * 64 * 64;
+
+    // blocked, packed kernel. this is what Matrix::operator* uses.
+    // MC row blocks of C are spread over `threads` pool threads
+    // (0 means parallel::num_threads())
+    void multiply(size_t m, size_t n, size_t k,
+                  double alpha, const double* A, size_t lda,
+                  const double* B, size_t ldb,
+                  double beta, double* C, size_t ldc,
+                  size_t threads = 0);
+
+    // same kernel for the other Matrix scalar types
+    void multiply(size_t m, size_t n, size_t k,
+                  float alpha, const float* A, size_t lda,
+                  const float* B, size_t ldb,
+                  float beta, float* C, size_t ldc,
+                  size_t threads = 0);
+
+    void multiply(size_t m, size_t n, size_t k,
+                  std::complex<double> alpha, const std::complex<double>* A, size_t lda,
+                  const std::complex<double>* B, size_t ldb,
+                  std::complex<double> beta, std::complex<double>* C, size_t ldc,
+                  size_t threads = 0);
+
+    // mixed precision: float A and B, but the panels get widened to
+    // double while they are packed, so every product and the whole k
+    // reduction happens in double. C only gets rounded once at the end
+    // (or not at all with the double C version), which for k > KC means
+    // an m x n double scratch copy of C. Same memory traffic for A and B
+    // as plain float, about the accuracy of plain double.
+    void multiply_mixed(size_t m, size_t n, size_t k,
+                        double alpha, const float* A, size_t lda,
+                        const float* B, size_t ldb,
+                        double beta, float* C, size_t ldc,
+                        size_t threads = 0);
+
+    void multiply_mixed(size_t m, size_t n, size_t k,
+                        double alpha, const float* A, size_t lda,
+                        const float* B, size_t ldb,
+                        double beta, double* C, size_t ldc,
+                        size_t threads = 0);
+
+    // textbook i-j-k triple loop (the old operator*), kept around as a
+    // reference and for benchmarking against
+    void multiply_naive(size_t m, size_t n, size_t k,
+                        double alpha, const double* A, size_t lda,
+                        const double* B, size_t ldb,
+                        double beta, double* C, size_t ldc);
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "gemm.h"
+#include "matrix.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    // 2*n^3 flops per square multiply, reported as a rate
+    void set_flops(benchmark::State& state, size_t n) {
+        state.counters["GFLOP/s"] = benchmark::Counter(
+            2.0 * n * n * n, benchmark::Counter::kIsIterationInvariantRate,
+            benchmark::Counter::kIs1000);
+    }
+
+    void BM_GemmNaive(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.5), B(n, n, 0.5), C(n, n);
+        for (auto _ : state) {
+            gemm::multiply_naive(n, n, n, 1.0, &A(0, 0), n, &B(0, 0), n,
+                                 0.0, &C(0, 0), n);
+            benchmark::DoNotOptimize(&C(0, 0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK(BM_GemmNaive)->RangeMultiplier(2)->Range(64, 1024)
+        ->Unit(benchmark::kMillisecond);
+
+    void BM_GemmBlocked(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.5), B(n, n, 0.5), C(n, n);
+        for (auto _ : state) {
+            gemm::multiply(n, n, n, 1.0, &A(0, 0), n, &B(0, 0), n,
+                           0.0, &C(0, 0), n);
+            benchmark::DoNotOptimize(&C(0, 0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK(BM_GemmBlocked)->RangeMultiplier(2)->Range(64, 2048)
+        ->Unit(benchmark::kMillisecond);
+
+    void BM_GemmFloat(benchmark::State& state) {
+        size_t n = state.range(0);
+        FloatMatrix A(n, n, 1.5f), B(n, n, 0.5f), C(n, n);
+        for (auto _ : state) {
+            gemm::multiply(n, n, n, 1.0f, &A(0, 0), n, &B(0, 0), n,
+                           0.0f, &C(0, 0), n);
+            benchmark::DoNotOptimize(&C(0, 0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK(BM_GemmFloat)->RangeMultiplier(4)->Range(128, 2048)
+        ->Unit(benchmark::kMillisecond);
+
+    // float in and out, double inside
+    void BM_GemmMixed(benchmark::State& state) {
+        size_t n = state.range(0);
+        FloatMatrix A(n, n, 1.5f), B(n, n, 0.5f), C(n, n);
+        for (auto _ : state) {
+            gemm::multiply_mixed(n, n, n, 1.0, &A(0, 0), n, &B(0, 0), n,
+                                 0.0, &C(0, 0), n);
+            benchmark::DoNotOptimize(&C(0, 0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK(BM_GemmMixed)->RangeMultiplier(4)->Range(128, 2048)
+        ->Unit(benchmark::kMillisecond);
+
+}
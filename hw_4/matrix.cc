@@ -1,15 +1,84 @@
 #include "matrix.h"
+#include "decomposition.h"
+#include "gemm.h"
+#include "simd.h"
+#include "transpose.h"
+#include "thread_pool.h"
 #include <algorithm>
+#include <utility>
 
-Matrix::Matrix() : num_rows(0), num_cols(0) {}
+namespace {
 
-Matrix::Matrix(size_t rows, size_t cols) 
-    : num_rows(rows), num_cols(cols), data(rows * cols, 0.0) {}
+// runs a flat kernel over [0, n), split across the pool for big matrices
+template <typename Kernel>
+void for_chunks(size_t n, Kernel kernel) {
+    parallel::for_range(n, parallel::ELEMENTWISE_GRAIN, [&](size_t begin, size_t end) {
+        kernel(begin, end - begin);
+    });
+}
+
+// the flat loops. float and double have simd kernels, complex gets the
+// plain loop
+template <typename T>
+constexpr bool has_simd = std::is_same<T, double>::value || std::is_same<T, float>::value;
+
+template <typename T>
+void flat_add(const T* a, const T* b, T* out, size_t n) {
+    if constexpr (has_simd<T>) {
+        simd::add(a, b, out, n);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = a[i] + b[i];
+        }
+    }
+}
+
+template <typename T>
+void flat_sub(const T* a, const T* b, T* out, size_t n) {
+    if constexpr (has_simd<T>) {
+        simd::sub(a, b, out, n);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = a[i] - b[i];
+        }
+    }
+}
+
+template <typename T>
+void flat_scale(const T* a, T s, T* out, size_t n) {
+    if constexpr (has_simd<T>) {
+        simd::scale(a, s, out, n);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = a[i] * s;
+        }
+    }
+}
+
+template <typename T>
+void flat_fill(T* out, T value, size_t n) {
+    if constexpr (has_simd<T>) {
+        simd::fill(out, value, n);
+    } else {
+        std::fill(out, out + n, value);
+    }
+}
 
-Matrix::Matrix(size_t rows, size_t cols, double value)
-    : num_rows(rows), num_cols(cols), data(rows * cols, value) {}
+}
 
-Matrix::Matrix(std::initializer_list<std::initializer_list<double>> list) {
+template <typename T>
+BasicMatrix<T>::BasicMatrix() : num_rows(0), num_cols(0) {}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(size_t rows, size_t cols)
+    : data(rows * cols, T(0)), num_rows(rows), num_cols(cols) {}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(size_t rows, size_t cols, T value)
+    : data(rows * cols, value), num_rows(rows), num_cols(cols) {}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(std::initializer_list<std::initializer_list<T>> list) {
     num_rows = list.size();
     num_cols = 0;
 
@@ -20,7 +89,7 @@ Matrix::Matrix(std::initializer_list<std::initializer_list<double>> list) {
         }
     }
 
-    data.resize(num_rows * num_cols, 0.0);
+    data.resize(num_rows * num_cols, T(0));
 
     size_t r = 0;
     for (auto& row : list) {
@@ -33,10 +102,20 @@ Matrix::Matrix(std::initializer_list<std::initializer_list<double>> list) {
     }
 }
 
-Matrix::Matrix(const Matrix& other) 
-    : num_rows(other.num_rows), num_cols(other.num_cols), data(other.data) {}
+template <typename T>
+BasicMatrix<T>::BasicMatrix(const BasicMatrix& other)
+    : data(other.data), num_rows(other.num_rows), num_cols(other.num_cols) {}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(BasicMatrix&& other) noexcept
+    : data(std::move(other.data)), num_rows(other.num_rows), num_cols(other.num_cols) {
+    other.data.clear();
+    other.num_rows = 0;
+    other.num_cols = 0;
+}
 
-Matrix& Matrix::operator=(const Matrix& other) {
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(const BasicMatrix& other) {
     if (this != &other) {
         num_rows = other.num_rows;
         num_cols = other.num_cols;
@@ -45,214 +124,367 @@ Matrix& Matrix::operator=(const Matrix& other) {
     return *this;
 }
 
-double& Matrix::operator()(size_t row, size_t col) {
+// take over the buffer, other ends up empty like after the move constructor
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(BasicMatrix&& other) noexcept {
+    if (this != &other) {
+        data = std::move(other.data);
+        num_rows = other.num_rows;
+        num_cols = other.num_cols;
+        other.data.clear();
+        other.num_rows = 0;
+        other.num_cols = 0;
+    }
+    return *this;
+}
+
+template <typename T>
+void BasicMatrix<T>::swap(BasicMatrix& other) noexcept {
+    data.swap(other.data);
+    std::swap(num_rows, other.num_rows);
+    std::swap(num_cols, other.num_cols);
+}
+
+template <typename T>
+T& BasicMatrix<T>::operator()(size_t row, size_t col) {
     return data[row * num_cols + col];
 }
 
-const double& Matrix::operator()(size_t row, size_t col) const {
+template <typename T>
+const T& BasicMatrix<T>::operator()(size_t row, size_t col) const {
     return data[row * num_cols + col];
 }
 
-double& Matrix::at(size_t row, size_t col) {
+template <typename T>
+T& BasicMatrix<T>::at(size_t row, size_t col) {
     if (row >= num_rows || col >= num_cols) {
         throw std::out_of_range("index out of range");
     }
     return data[row * num_cols + col];
 }
 
-const double& Matrix::at(size_t row, size_t col) const {
+template <typename T>
+const T& BasicMatrix<T>::at(size_t row, size_t col) const {
     if (row >= num_rows || col >= num_cols) {
         throw std::out_of_range("index out of range");
     }
     return data[row * num_cols + col];
 }
 
-size_t Matrix::rows() const { return num_rows; }
-size_t Matrix::cols() const { return num_cols; }
-bool Matrix::isEmpty() const { return num_rows == 0 || num_cols == 0; }
-bool Matrix::isSquare() const { return num_rows == num_cols; }
+template <typename T>
+typename BasicMatrix<T>::View BasicMatrix<T>::view() {
+    return View(data.data(), num_rows, num_cols, num_cols);
+}
 
-Matrix Matrix::operator+(const Matrix& other) const {
-    if (num_rows != other.num_rows || num_cols != other.num_cols) {
-        throw std::invalid_argument("cant add matrices with different dimensions");
-    }
-    Matrix res(num_rows, num_cols);
-    for (size_t i = 0; i < data.size(); i++) {
-        res.data[i] = data[i] + other.data[i];
-    }
-    return res;
+template <typename T>
+typename BasicMatrix<T>::ConstView BasicMatrix<T>::view() const {
+    return ConstView(data.data(), num_rows, num_cols, num_cols);
 }
 
-Matrix Matrix::operator-(const Matrix& other) const {
-    if (num_rows != other.num_rows || num_cols != other.num_cols) {
-        throw std::invalid_argument("cant subtract matrices with different dimensions");
-    }
-    Matrix res(num_rows, num_cols);
-    for (size_t i = 0; i < data.size(); i++) {
-        res.data[i] = data[i] - other.data[i];
-    }
-    return res;
+template <typename T>
+typename BasicMatrix<T>::View BasicMatrix<T>::row(size_t r) { return view().row(r); }
+template <typename T>
+typename BasicMatrix<T>::ConstView BasicMatrix<T>::row(size_t r) const { return view().row(r); }
+template <typename T>
+typename BasicMatrix<T>::View BasicMatrix<T>::col(size_t c) { return view().col(c); }
+template <typename T>
+typename BasicMatrix<T>::ConstView BasicMatrix<T>::col(size_t c) const { return view().col(c); }
+
+template <typename T>
+typename BasicMatrix<T>::View BasicMatrix<T>::block(size_t r, size_t c, size_t rows, size_t cols) {
+    return view().block(r, c, rows, cols);
+}
+
+template <typename T>
+typename BasicMatrix<T>::ConstView BasicMatrix<T>::block(size_t r, size_t c, size_t rows, size_t cols) const {
+    return view().block(r, c, rows, cols);
+}
+
+template <typename T>
+typename BasicMatrix<T>::View BasicMatrix<T>::diagonal_view() { return view().diagonal(); }
+template <typename T>
+typename BasicMatrix<T>::ConstView BasicMatrix<T>::diagonal_view() const { return view().diagonal(); }
+
+template <typename T>
+size_t BasicMatrix<T>::rows() const { return num_rows; }
+template <typename T>
+size_t BasicMatrix<T>::cols() const { return num_cols; }
+template <typename T>
+bool BasicMatrix<T>::isEmpty() const { return num_rows == 0 || num_cols == 0; }
+template <typename T>
+bool BasicMatrix<T>::isSquare() const { return num_rows == num_cols; }
+
+template <typename T>
+std::pmr::memory_resource* BasicMatrix<T>::resource() const { return data.get_allocator().resource(); }
+
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::operator*(const BasicMatrix& other) const {
+    return multiply(other, 0);
 }
 
-Matrix Matrix::operator*(const Matrix& other) const {
-    if (num_cols != other.num_rows) {
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::multiply(const BasicMatrix& other, size_t threads) const {
+    return ::multiply<T>(view(), other.view(), threads);
+}
+
+template <typename T>
+BasicMatrix<T> multiply(BasicMatrixView<const T> lhs, BasicMatrixView<const T> rhs, size_t threads) {
+    if (lhs.cols() != rhs.rows()) {
         throw std::invalid_argument("matrix dimensions dont work for multiply");
     }
-    Matrix res(num_rows, other.num_cols);
-    for (size_t i = 0; i < num_rows; i++) {
-        for (size_t j = 0; j < other.num_cols; j++) {
-            double sum = 0;
-            for (size_t k = 0; k < num_cols; k++) {
-                sum = sum + data[i * num_cols + k] * other.data[k * other.num_cols + j];
-            }
-            res.data[i * other.num_cols + j] = sum;
-        }
-    }
+    BasicMatrix<T> res(lhs.rows(), rhs.cols());
+    // blocked kernel in gemm.cc, the naive triple loop thrashes cache
+    // once the matrices get big
+    gemm::multiply(lhs.rows(), rhs.cols(), lhs.cols(),
+                   T(1), lhs.data(), lhs.stride(),
+                   rhs.data(), rhs.stride(),
+                   T(0), res.view().data(), res.cols(), threads);
     return res;
 }
 
-Matrix Matrix::operator*(double scalar) const {
-    Matrix res(num_rows, num_cols);
-    for (size_t i = 0; i < data.size(); i++) {
-        res.data[i] = data[i] * scalar;
+template <typename Out>
+BasicMatrix<Out> multiply_mixed(BasicMatrixView<const float> lhs, BasicMatrixView<const float> rhs,
+                                size_t threads) {
+    if (lhs.cols() != rhs.rows()) {
+        throw std::invalid_argument("matrix dimensions dont work for multiply");
     }
+    BasicMatrix<Out> res(lhs.rows(), rhs.cols());
+    gemm::multiply_mixed(lhs.rows(), rhs.cols(), lhs.cols(),
+                         1.0, lhs.data(), lhs.stride(),
+                         rhs.data(), rhs.stride(),
+                         0.0, res.view().data(), res.cols(), threads);
     return res;
 }
 
-// need this so we can write 2.0 * A
-Matrix operator*(double scalar, const Matrix& m) {
-    return m * scalar;
+template <typename T>
+void BasicMatrix<T>::assign(const BinaryExpr<MatrixRef<T>, MatrixRef<T>, expr_ops::Add>& expr) {
+    const T* a = expr.left().data();
+    const T* b = expr.right().data();
+    T* out = data.data();
+    for_chunks(data.size(), [=](size_t i, size_t n) { flat_add(a + i, b + i, out + i, n); });
 }
 
-Matrix Matrix::operator/(double scalar) const {
-    // just let it happen, if scalar is 0 youll get inf which is fine i think
-    Matrix res(num_rows, num_cols);
-    for (size_t i = 0; i < data.size(); i++) {
-        res.data[i] = data[i] / scalar;
-    }
-    return res;
+template <typename T>
+void BasicMatrix<T>::assign(const BinaryExpr<MatrixRef<T>, MatrixRef<T>, expr_ops::Sub>& expr) {
+    const T* a = expr.left().data();
+    const T* b = expr.right().data();
+    T* out = data.data();
+    for_chunks(data.size(), [=](size_t i, size_t n) { flat_sub(a + i, b + i, out + i, n); });
 }
 
-Matrix Matrix::operator-() const {
-    Matrix res(num_rows, num_cols);
-    for (size_t i = 0; i < data.size(); i++) {
-        res.data[i] = -data[i];
-    }
-    return res;
+template <typename T>
+void BasicMatrix<T>::assign(const UnaryExpr<MatrixRef<T>, expr_ops::Scale<T>>& expr) {
+    const T* a = expr.operand().data();
+    T s = expr.operation().s;
+    T* out = data.data();
+    for_chunks(data.size(), [=](size_t i, size_t n) { flat_scale(a + i, s, out + i, n); });
 }
 
-Matrix& Matrix::operator+=(const Matrix& other) {
-    *this = *this + other;
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator+=(const BasicMatrix& other) {
+    if (num_rows != other.num_rows || num_cols != other.num_cols) {
+        throw std::invalid_argument("cant add matrices with different dimensions");
+    }
+    const T* b = other.data.data();
+    T* out = data.data();
+    for_chunks(data.size(), [=](size_t i, size_t n) { flat_add(out + i, b + i, out + i, n); });
     return *this;
 }
 
-Matrix& Matrix::operator-=(const Matrix& other) {
-    *this = *this - other;
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator-=(const BasicMatrix& other) {
+    if (num_rows != other.num_rows || num_cols != other.num_cols) {
+        throw std::invalid_argument("cant subtract matrices with different dimensions");
+    }
+    const T* b = other.data.data();
+    T* out = data.data();
+    for_chunks(data.size(), [=](size_t i, size_t n) { flat_sub(out + i, b + i, out + i, n); });
     return *this;
 }
 
-Matrix& Matrix::operator*=(const Matrix& other) {
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator*=(const BasicMatrix& other) {
+    // the product cant be done in place, but the result buffer gets
+    // moved in rather than copied
     *this = *this * other;
     return *this;
 }
 
-Matrix& Matrix::operator*=(double scalar) {
-    for (size_t i = 0; i < data.size(); i++) {
-        data[i] = data[i] * scalar;
-    }
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator*=(T scalar) {
+    T* out = data.data();
+    for_chunks(data.size(), [=](size_t i, size_t n) { flat_scale(out + i, scalar, out + i, n); });
     return *this;
 }
 
-Matrix& Matrix::operator/=(double scalar) {
-    for (size_t i = 0; i < data.size(); i++) {
-        data[i] = data[i] / scalar;
-    }
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator/=(T scalar) {
+    parallel::for_range(data.size(), parallel::ELEMENTWISE_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            data[i] = data[i] / scalar;
+        }
+    });
     return *this;
 }
 
 // use epsilon so floating point doesnt mess things up
-bool Matrix::operator==(const Matrix& other) const {
+template <typename T>
+bool BasicMatrix<T>::operator==(const BasicMatrix& other) const {
     if (num_rows != other.num_rows || num_cols != other.num_cols) {
         return false;
     }
-    for (size_t i = 0; i < data.size(); i++) {
-        if (std::fabs(data[i] - other.data[i]) > EPSILON) {
-            return false;
+    if constexpr (std::is_same<T, double>::value) {
+        return simd::all_close(data.data(), other.data.data(), data.size(), EPSILON);
+    } else {
+        for (size_t i = 0; i < data.size(); i++) {
+            if (std::abs(data[i] - other.data[i]) > EPSILON) {
+                return false;
+            }
         }
+        return true;
     }
-    return true;
 }
 
-bool Matrix::operator!=(const Matrix& other) const {
+template <typename T>
+bool BasicMatrix<T>::operator!=(const BasicMatrix& other) const {
     return !(*this == other);
 }
 
-Matrix Matrix::transpose() const {
-    Matrix res(num_cols, num_rows);
-    for (size_t r = 0; r < num_rows; r++) {
-        for (size_t c = 0; c < num_cols; c++) {
-            res.data[c * num_rows + r] = data[r * num_cols + c];
-        }
-    }
+// recursive blocked kernel in transpose.h, the plain double loop misses
+// on every write once the matrix is bigger than cache
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::transpose() const {
+    BasicMatrix res(num_cols, num_rows);
+    transposition::out_of_place(data.data(), num_rows, num_cols, num_cols,
+                                res.data.data(), num_rows);
     return res;
 }
 
-double Matrix::trace() const {
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::transpose_in_place() {
+    if (isSquare()) {
+        transposition::in_place(data.data(), num_rows, num_cols);
+    } else {
+        // non square needs a scratch buffer anyway, just swap it in
+        *this = transpose();
+    }
+    return *this;
+}
+
+template <typename T>
+T BasicMatrix<T>::trace() const {
     if (!isSquare()) {
         throw std::logic_error("trace needs a square matrix");
     }
-    double sum = 0;
-    for (size_t i = 0; i < num_rows; i++) {
-        sum = sum + data[i * num_cols + i];
+    if constexpr (std::is_same<T, double>::value) {
+        return simd::strided_sum(data.data(), num_rows, num_cols + 1);
+    } else {
+        T sum = T(0);
+        for (size_t i = 0; i < num_rows; i++) {
+            sum += data[i * num_cols + i];
+        }
+        return sum;
     }
-    return sum;
 }
 
-// get the diagonal elements as a column vector
-Matrix Matrix::diagonal() const {
-    size_t n = std::min(num_rows, num_cols);
-    Matrix res(n, 1);
-    for (size_t i = 0; i < n; i++) {
-        res.data[i] = data[i * num_cols + i];
+// get the diagonal elements as a column vector. diagonal_view() gives
+// the same thing without the copy
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::diagonal() const {
+    return BasicMatrix(diagonal_view());
+}
+
+template <typename T>
+void BasicMatrix<T>::fill(T value) {
+    T* out = data.data();
+    for_chunks(data.size(), [=](size_t i, size_t n) { flat_fill(out + i, value, n); });
+}
+
+template <typename T>
+double BasicMatrix<T>::norm() const {
+    if constexpr (has_simd<T>) {
+        return std::sqrt(simd::sum_squares(data.data(), data.size()));
+    } else {
+        double sum = 0;
+        for (const T& x : data) {
+            sum += std::norm(x);  // |x|^2
+        }
+        return std::sqrt(sum);
+    }
+}
+
+// LU only exists for double, float matrices get widened for it
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::solve(const BasicMatrix& b) const {
+    if constexpr (std::is_same<T, double>::value) {
+        return LU(*this).solve(b);
+    } else if constexpr (std::is_same<T, float>::value) {
+        return BasicMatrix(LU(Matrix(*this)).solve(Matrix(b)));
+    } else {
+        throw std::logic_error("solve isnt implemented for complex matrices");
     }
-    return res;
 }
 
-void Matrix::fill(double value) {
-    for (size_t i = 0; i < data.size(); i++) {
-        data[i] = value;
+template <typename T>
+T BasicMatrix<T>::determinant() const {
+    if constexpr (std::is_same<T, double>::value) {
+        return LU(*this).determinant();
+    } else if constexpr (std::is_same<T, float>::value) {
+        return T(LU(Matrix(*this)).determinant());
+    } else {
+        throw std::logic_error("determinant isnt implemented for complex matrices");
     }
 }
 
-double Matrix::norm() const {
-    double sum = 0;
-    for (size_t i = 0; i < data.size(); i++) {
-        sum = sum + data[i] * data[i];
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::inverse() const {
+    if constexpr (std::is_same<T, double>::value) {
+        return LU(*this).inverse();
+    } else if constexpr (std::is_same<T, float>::value) {
+        return BasicMatrix(LU(Matrix(*this)).inverse());
+    } else {
+        throw std::logic_error("inverse isnt implemented for complex matrices");
     }
-    return std::sqrt(sum);
 }
 
-Matrix Matrix::identity(size_t n) {
-    Matrix res(n, n);
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::identity(size_t n) {
+    BasicMatrix res(n, n);
     for (size_t i = 0; i < n; i++) {
-        res.data[i * n + i] = 1.0;
+        res.data[i * n + i] = T(1);
     }
     return res;
 }
 
-Matrix Matrix::zeros(size_t rows, size_t cols) {
-    return Matrix(rows, cols);
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::zeros(size_t rows, size_t cols) {
+    return BasicMatrix(rows, cols);
 }
 
-Matrix Matrix::ones(size_t rows, size_t cols) {
-    return Matrix(rows, cols, 1.0);
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::ones(size_t rows, size_t cols) {
+    return BasicMatrix(rows, cols, T(1));
 }
 
-Matrix Matrix::diagonal(const std::vector<double>& diag) {
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::diagonal(const std::vector<T>& diag) {
     size_t n = diag.size();
-    Matrix res(n, n);
+    BasicMatrix res(n, n);
     for (size_t i = 0; i < n; i++) {
         res.data[i * n + i] = diag[i];
     }
     return res;
 }
+
+// the scalar types Matrix is compiled for, see the top of matrix.h
+template class BasicMatrix<float>;
+template class BasicMatrix<double>;
+template class BasicMatrix<std::complex<double>>;
+
+template FloatMatrix multiply(BasicMatrixView<const float>, BasicMatrixView<const float>, size_t);
+template Matrix multiply(BasicMatrixView<const double>, BasicMatrixView<const double>, size_t);
+template ComplexMatrix multiply(BasicMatrixView<const std::complex<double>>,
+                                BasicMatrixView<const std::complex<double>>, size_t);
+
+template FloatMatrix multiply_mixed<float>(BasicMatrixView<const float>, BasicMatrixView<const float>, size_t);
+template Matrix multiply_mixed<double>(BasicMatrixView<const float>, BasicMatrixView<const float>, size_t);
@@ -6,68 +6,327 @@
 #include <stdexcept>
 #include <initializer_list>
 #include <cmath>
+#include <complex>
+#include <type_traits>
+#include "matrix_allocator.h"
+#include "matrix_expr.h"
+#include "matrix_view.h"
+#include "thread_pool.h"
 
-class Matrix {
+template <typename T>
+class MatrixRef;
+
+// Dense row-major matrix of T. Everything is implemented once in
+// matrix.cc and compiled for float, double and std::complex<double>
+// (Matrix, FloatMatrix and ComplexMatrix below), other types wont link.
+//
+// a Matrix is itself a (leaf) expression, so it can be assigned or
+// added into views like any other expression
+template <typename T>
+class BasicMatrix : public MatrixExpr<BasicMatrix<T>> {
 
 public:
 
+    using value_type = T;
+    using View = BasicMatrixView<T>;
+    using ConstView = BasicMatrixView<const T>;
+
     // constructors
-    Matrix();
-    Matrix(size_t rows, size_t cols);
-    Matrix(size_t rows, size_t cols, double value);
-    Matrix(std::initializer_list<std::initializer_list<double>> list);
-    Matrix(const Matrix& other);
+    BasicMatrix();
+    BasicMatrix(size_t rows, size_t cols);
+    BasicMatrix(size_t rows, size_t cols, T value);
+    BasicMatrix(std::initializer_list<std::initializer_list<T>> list);
+    BasicMatrix(const BasicMatrix& other);
+    BasicMatrix(BasicMatrix&& other) noexcept;  // other is left as an empty 0x0 matrix
 
-    Matrix& operator=(const Matrix& other);
+    // evaluate a lazy elementwise expression, see matrix_expr.h. this is
+    // also how to convert between scalar types: FloatMatrix f = m;
+    template <typename E>
+    BasicMatrix(const MatrixExpr<E>& expr);
+
+    BasicMatrix& operator=(const BasicMatrix& other);
+    BasicMatrix& operator=(BasicMatrix&& other) noexcept;
+    template <typename E>
+    BasicMatrix& operator=(const MatrixExpr<E>& expr);
 
     // element access stuff
-    double& operator()(size_t row, size_t col);
-    const double& operator()(size_t row, size_t col) const;
-    double& at(size_t row, size_t col);  // throws if out of bounds
-    const double& at(size_t row, size_t col) const;
+    T& operator()(size_t row, size_t col);
+    const T& operator()(size_t row, size_t col) const;
+    T& at(size_t row, size_t col);  // throws if out of bounds
+    const T& at(size_t row, size_t col) const;
+
+    // zero-copy views into this matrix, see matrix_view.h. they are
+    // valid until the matrix is resized, moved from or destroyed
+    View view();
+    ConstView view() const;
+    View row(size_t r);
+    ConstView row(size_t r) const;
+    View col(size_t c);
+    ConstView col(size_t c) const;
+    View block(size_t r, size_t c, size_t rows, size_t cols);  // throws if out of bounds
+    ConstView block(size_t r, size_t c, size_t rows, size_t cols) const;
+    View diagonal_view();
+    ConstView diagonal_view() const;
+
+    operator View() { return view(); }
+    operator ConstView() const { return view(); }
+
+    void swap(BasicMatrix& other) noexcept;
+    friend void swap(BasicMatrix& a, BasicMatrix& b) noexcept { a.swap(b); }
 
     size_t rows() const;
     size_t cols() const;
     bool isEmpty() const;
     bool isSquare() const;
+    std::pmr::memory_resource* resource() const;  // where the storage came from
+
+    // operators. +, -, scalar * and / are lazy free functions at the
+    // bottom of this file, the matrix product is computed right away
+    BasicMatrix operator*(const BasicMatrix& other) const;
+    BasicMatrix multiply(const BasicMatrix& other, size_t threads) const;  // 0 = parallel::num_threads()
 
-    // operators
-    Matrix operator+(const Matrix& other) const;
-    Matrix operator-(const Matrix& other) const;
-    Matrix operator*(const Matrix& other) const;
-    Matrix operator*(double scalar) const;
-    friend Matrix operator*(double scalar, const Matrix& m);
-    Matrix operator/(double scalar) const;
-    Matrix operator-() const;
-
-    Matrix& operator+=(const Matrix& other);
-    Matrix& operator-=(const Matrix& other);
-    Matrix& operator*=(const Matrix& other);
-    Matrix& operator*=(double scalar);
-    Matrix& operator/=(double scalar);
+    // these update in place, no temporary gets allocated
+    BasicMatrix& operator+=(const BasicMatrix& other);
+    BasicMatrix& operator-=(const BasicMatrix& other);
+    template <typename E>
+    BasicMatrix& operator+=(const MatrixExpr<E>& expr);
+    template <typename E>
+    BasicMatrix& operator-=(const MatrixExpr<E>& expr);
+    BasicMatrix& operator*=(const BasicMatrix& other);
+    BasicMatrix& operator*=(T scalar);
+    BasicMatrix& operator/=(T scalar);
 
     // comparision
-    bool operator==(const Matrix& other) const;
-    bool operator!=(const Matrix& other) const;
+    bool operator==(const BasicMatrix& other) const;
+    bool operator!=(const BasicMatrix& other) const;
 
     // other operations
-    Matrix transpose() const;
-    double trace() const;
-    Matrix diagonal() const;
-    void fill(double value);
-    double norm() const;   // frobenius
+    BasicMatrix transpose() const;
+    BasicMatrix& transpose_in_place();  // no extra buffer when square
+    T trace() const;
+    BasicMatrix diagonal() const;
+    void fill(T value);
+    double norm() const;   // frobenius, always summed in double
+
+    // linear algebra through a blocked LU, see decomposition.h. these
+    // throw std::logic_error if the matrix isnt square and solve /
+    // inverse throw std::runtime_error if it is singular. float goes
+    // through double, complex isnt supported and throws std::logic_error
+    BasicMatrix solve(const BasicMatrix& b) const;  // X with (*this) * X = b
+    T determinant() const;
+    BasicMatrix inverse() const;
 
     // static factory stuff
-    static Matrix identity(size_t n);
-    static Matrix zeros(size_t rows, size_t cols);
-    static Matrix ones(size_t rows, size_t cols);
-    static Matrix diagonal(const std::vector<double>& diag);
+    static BasicMatrix identity(size_t n);
+    static BasicMatrix zeros(size_t rows, size_t cols);
+    static BasicMatrix ones(size_t rows, size_t cols);
+    static BasicMatrix diagonal(const std::vector<T>& diag);
 
 private:
-    std::vector<double> data;
+    std::vector<T, MatrixAllocator<T>> data;  // 64-byte aligned, see matrix_allocator.h
     size_t num_rows;
     size_t num_cols;
-    static constexpr double EPSILON = 1e-6;
+    // float only has ~7 significant digits, so 1e-6 would be too strict
+    static constexpr double EPSILON = std::is_same<T, float>::value ? 1e-4 : 1e-6;
+
+    friend class MatrixRef<T>;
+
+    // whole-matrix assignment from an expression. the plain A + B,
+    // A - B and A * s shapes go to the simd kernels, anything else
+    // runs the generic fused loop
+    template <typename E>
+    void assign(const E& expr);
+    void assign(const BinaryExpr<MatrixRef<T>, MatrixRef<T>, expr_ops::Add>& expr);
+    void assign(const BinaryExpr<MatrixRef<T>, MatrixRef<T>, expr_ops::Sub>& expr);
+    void assign(const UnaryExpr<MatrixRef<T>, expr_ops::Scale<T>>& expr);
+
+    // out[i] = op(out[i], expr[i]) over the whole matrix, in parallel
+    // when its big enough
+    template <typename E, typename Op>
+    void apply(const MatrixExpr<E>& expr, Op op);
+};
+
+using Matrix = BasicMatrix<double>;
+using FloatMatrix = BasicMatrix<float>;
+using ComplexMatrix = BasicMatrix<std::complex<double>>;
+
+// leaf of an expression tree, points at a Matrix's storage
+template <typename T>
+class MatrixRef : public MatrixExpr<MatrixRef<T>> {
+
+public:
+
+    MatrixRef(const BasicMatrix<T>& m) : ptr(m.data.data()), r(m.num_rows), c(m.num_cols) {}
+
+    size_t rows() const { return r; }
+    size_t cols() const { return c; }
+    T operator()(size_t row, size_t col) const { return ptr[row * c + col]; }
+    const T* data() const { return ptr; }
+
+private:
+
+    const T* ptr;
+    size_t r, c;
+
+};
+
+template <typename T>
+template <typename E, typename Op>
+void BasicMatrix<T>::apply(const MatrixExpr<E>& expr, Op op) {
+    evaluate_into(data.data(), num_cols, expr.self(), op);
+}
+
+template <typename T>
+template <typename E>
+void BasicMatrix<T>::assign(const E& expr) {
+    apply(expr, [](auto, auto x) { return x; });
+}
+
+template <typename T>
+template <typename E>
+BasicMatrix<T>::BasicMatrix(const MatrixExpr<E>& expr)
+    : data(expr.size()), num_rows(expr.rows()), num_cols(expr.cols()) {
+    assign(expr.self());
+}
+
+// each output element only depends on the same element of the inputs,
+// so A = A + B is fine even though A is read while its written. if the
+// shape changes the expression might be reading a view of this matrix
+// (A = A.row(0) * 2.0), so it gets built into a new buffer instead.
+template <typename T>
+template <typename E>
+BasicMatrix<T>& BasicMatrix<T>::operator=(const MatrixExpr<E>& expr) {
+    if (num_rows != expr.rows() || num_cols != expr.cols()) {
+        return *this = BasicMatrix(expr);
+    }
+    assign(expr.self());
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+BasicMatrix<T>& BasicMatrix<T>::operator+=(const MatrixExpr<E>& expr) {
+    if (num_rows != expr.rows() || num_cols != expr.cols()) {
+        throw std::invalid_argument("cant add matrices with different dimensions");
+    }
+    apply(expr, [](auto a, auto x) { return a + x; });
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+BasicMatrix<T>& BasicMatrix<T>::operator-=(const MatrixExpr<E>& expr) {
+    if (num_rows != expr.rows() || num_cols != expr.cols()) {
+        throw std::invalid_argument("cant subtract matrices with different dimensions");
+    }
+    apply(expr, [](auto a, auto x) { return a - x; });
+    return *this;
+}
+
+extern template class BasicMatrix<float>;
+extern template class BasicMatrix<double>;
+extern template class BasicMatrix<std::complex<double>>;
+
+/* ======= lazy elementwise operators ======= */
+
+template <typename T>
+struct is_basic_matrix : std::false_type {};
+
+template <typename T>
+struct is_basic_matrix<BasicMatrix<T>> : std::true_type {};
+
+// anything that can appear in an expression: a Matrix or an expression node
+template <typename T>
+struct is_matrix_operand
+    : std::integral_constant<bool, is_basic_matrix<T>::value ||
+                                   std::is_base_of<MatrixExpr<T>, T>::value> {};
+
+// what gets stored in the tree for an operand, a Matrix becomes a MatrixRef
+template <typename T>
+struct expr_node {
+    using type = T;
+};
+
+template <typename T>
+struct expr_node<BasicMatrix<T>> {
+    using type = MatrixRef<T>;
 };
 
+template <typename T>
+using expr_node_t = typename expr_node<T>::type;
+
+// scalar type of an operand, scalars in A * s get converted to this
+template <typename T>
+using operand_value_t = expr_value_t<expr_node_t<T>>;
+
+template <typename L, typename R>
+using enable_if_operands_t =
+    typename std::enable_if<is_matrix_operand<L>::value && is_matrix_operand<R>::value>::type;
+
+template <typename T>
+using enable_if_operand_t = typename std::enable_if<is_matrix_operand<T>::value>::type;
+
+template <typename L, typename R, typename = enable_if_operands_t<L, R>>
+BinaryExpr<expr_node_t<L>, expr_node_t<R>, expr_ops::Add> operator+(const L& lhs, const R& rhs) {
+    return {lhs, rhs};
+}
+
+template <typename L, typename R, typename = enable_if_operands_t<L, R>>
+BinaryExpr<expr_node_t<L>, expr_node_t<R>, expr_ops::Sub> operator-(const L& lhs, const R& rhs) {
+    return {lhs, rhs};
+}
+
+template <typename T, typename = enable_if_operand_t<T>>
+UnaryExpr<expr_node_t<T>, expr_ops::Scale<operand_value_t<T>>> operator*(const T& m, operand_value_t<T> scalar) {
+    return {m, {scalar}};
+}
+
+// need this so we can write 2.0 * A
+template <typename T, typename = enable_if_operand_t<T>>
+UnaryExpr<expr_node_t<T>, expr_ops::Scale<operand_value_t<T>>> operator*(operand_value_t<T> scalar, const T& m) {
+    return {m, {scalar}};
+}
+
+template <typename T, typename = enable_if_operand_t<T>>
+UnaryExpr<expr_node_t<T>, expr_ops::Divide<operand_value_t<T>>> operator/(const T& m, operand_value_t<T> scalar) {
+    return {m, {scalar}};
+}
+
+template <typename T, typename = enable_if_operand_t<T>>
+UnaryExpr<expr_node_t<T>, expr_ops::Negate> operator-(const T& m) {
+    return {m, expr_ops::Negate{}};
+}
+
+/* ======= matrix product ======= */
+
+// A * B on anything strided, a Matrix or a view of one. the blocked
+// gemm takes row strides so sub-blocks dont need to be copied out
+template <typename T>
+BasicMatrix<T> multiply(BasicMatrixView<const T> lhs, BasicMatrixView<const T> rhs, size_t threads = 0);
+
+// float inputs, double accumulation, see gemm::multiply_mixed. Out is
+// float to keep the memory savings or double to keep all the precision
+template <typename Out = float>
+BasicMatrix<Out> multiply_mixed(BasicMatrixView<const float> lhs, BasicMatrixView<const float> rhs,
+                                size_t threads = 0);
+
+// what a product operand looks like to multiply(): matrices and views
+// pass straight through, other expressions ((A + B) * C) are not
+// elementwise any more so they get evaluated into a Matrix first
+template <typename T>
+BasicMatrixView<const T> as_strided(const BasicMatrix<T>& m) { return m.view(); }
+
+template <typename T>
+BasicMatrixView<const typename std::remove_const<T>::type> as_strided(const BasicMatrixView<T>& v) { return v; }
+
+template <typename E>
+BasicMatrix<expr_value_t<E>> as_strided(const MatrixExpr<E>& expr) { return BasicMatrix<expr_value_t<E>>(expr); }
+
+// Matrix * Matrix is the member operator*, this covers everything else.
+// both sides need the same scalar type
+template <typename L, typename R, typename = enable_if_operands_t<L, R>>
+BasicMatrix<operand_value_t<L>> operator*(const L& lhs, const R& rhs) {
+    return multiply<operand_value_t<L>>(as_strided(lhs), as_strided(rhs));
+}
+
 #endif
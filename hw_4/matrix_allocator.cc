@@ -0,0 +1,235 @@
+#include "matrix_allocator.h"
+#include <atomic>
+
+namespace {
+
+std::atomic<std::pmr::memory_resource*> global_resource{nullptr};
+thread_local std::pmr::memory_resource* scoped_resource = nullptr;
+
+constexpr size_t NUM_CLASSES = 23;  // 2^6 .. 2^28 bytes
+
+size_t size_class(size_t bytes) {
+    size_t cls = 0;
+    size_t size = matrix_memory::PoolResource::MIN_POOLED_BYTES;
+    while (size < bytes) {
+        size <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+size_t class_bytes(size_t cls) {
+    return matrix_memory::PoolResource::MIN_POOLED_BYTES << cls;
+}
+
+}
+
+namespace matrix_memory::detail {
+
+// what the thread caches need from a pool. they hold on to it, so it
+// outlives a PoolResource that is destroyed while other threads still
+// cache its buffers
+struct PoolState {
+    std::pmr::memory_resource* upstream;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> outstanding{0};
+    std::atomic<size_t> cached{0};
+
+    explicit PoolState(std::pmr::memory_resource* upstream) : upstream(upstream) {}
+};
+
+}
+
+namespace {
+
+using matrix_memory::detail::PoolState;
+
+// one pool's free lists on one thread, fixed size so the pool itself
+// never allocates
+struct CacheSlot {
+    std::shared_ptr<PoolState> pool;
+    void* free_lists[NUM_CLASSES][matrix_memory::PoolResource::MAX_CACHED_PER_CLASS];
+    size_t counts[NUM_CLASSES] = {};
+
+    // everything back upstream, the slot is free again after. returns
+    // the bytes released
+    size_t release() {
+        size_t bytes = 0;
+        for (size_t cls = 0; cls < NUM_CLASSES; cls++) {
+            for (size_t i = 0; i < counts[cls]; i++) {
+                pool->upstream->deallocate(free_lists[cls][i], class_bytes(cls), matrix_memory::ALIGNMENT);
+                bytes += class_bytes(cls);
+            }
+            counts[cls] = 0;
+        }
+        pool->cached -= bytes;
+        pool.reset();
+        return bytes;
+    }
+};
+
+// all of a thread's caches. whatever is still cached when the thread
+// exits goes back upstream
+struct ThreadCache {
+    CacheSlot slots[matrix_memory::PoolResource::MAX_POOLS_PER_THREAD];
+    size_t bytes = 0;  // in all the slots, kept under MAX_CACHED_BYTES
+
+    CacheSlot* find(const PoolState* pool) {
+        for (CacheSlot& slot : slots) {
+            if (slot.pool.get() == pool) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    // the slot for pool, or a new one. a slot whose pool is gone (only
+    // this cache still holds its state) gets emptied and reused.
+    // nullptr when every slot is busy with a live pool
+    CacheSlot* claim(const std::shared_ptr<PoolState>& pool) {
+        if (CacheSlot* slot = find(pool.get())) {
+            return slot;
+        }
+        for (CacheSlot& slot : slots) {
+            if (slot.pool && slot.pool.use_count() == 1) {
+                bytes -= slot.release();
+            }
+            if (!slot.pool) {
+                slot.pool = pool;
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    ~ThreadCache();
+};
+
+thread_local ThreadCache cache;
+
+// set once this threads cache is gone, so matrices freed even later
+// (other thread_locals, statics on the main thread) skip it
+thread_local bool cache_gone = false;
+
+ThreadCache::~ThreadCache() {
+    for (CacheSlot& slot : slots) {
+        if (slot.pool) {
+            slot.release();
+        }
+    }
+    cache_gone = true;
+}
+
+}
+
+namespace matrix_memory {
+
+    std::pmr::memory_resource* resource() {
+        if (scoped_resource) {
+            return scoped_resource;
+        }
+        std::pmr::memory_resource* r = global_resource.load();
+        return r ? r : std::pmr::new_delete_resource();
+    }
+
+    std::pmr::memory_resource* set_default_resource(std::pmr::memory_resource* r) {
+        std::pmr::memory_resource* previous = global_resource.exchange(r);
+        return previous ? previous : std::pmr::new_delete_resource();
+    }
+
+    ScopedResource::ScopedResource(std::pmr::memory_resource* r) : previous(scoped_resource) {
+        scoped_resource = r;
+    }
+
+    ScopedResource::~ScopedResource() {
+        scoped_resource = previous;
+    }
+
+    PoolResource::PoolResource(std::pmr::memory_resource* upstream)
+        : state(std::make_shared<detail::PoolState>(upstream)) {}
+
+    PoolResource::~PoolResource() {
+        trim();
+    }
+
+    PoolStats PoolResource::stats() const {
+        return {state->hits.load(), state->misses.load(), state->outstanding.load(), state->cached.load()};
+    }
+
+    void PoolResource::reset_stats() {
+        state->hits = 0;
+        state->misses = 0;
+    }
+
+    void PoolResource::trim() {
+        if (cache_gone) {
+            return;
+        }
+        if (CacheSlot* slot = cache.find(state.get())) {
+            cache.bytes -= slot->release();
+        }
+    }
+
+    void* PoolResource::do_allocate(size_t bytes, size_t alignment) {
+        // every class is a power of two of at least 64 bytes, and
+        // upstream gets asked for the same alignment, so anything up to
+        // ALIGNMENT can share a class. the rest goes straight through
+        // but still counts
+        bool pooled = bytes <= MAX_POOLED_BYTES && alignment <= ALIGNMENT;
+        size_t cls = pooled ? size_class(bytes) : 0;
+        size_t size = pooled ? class_bytes(cls) : bytes;
+        state->outstanding += size;
+        if (pooled && !cache_gone) {
+            CacheSlot* slot = cache.find(state.get());
+            if (slot && slot->counts[cls] > 0) {
+                void* p = slot->free_lists[cls][--slot->counts[cls]];
+                cache.bytes -= size;
+                state->cached -= size;
+                state->hits++;
+                return p;
+            }
+        }
+        state->misses++;
+        try {
+            return state->upstream->allocate(size, pooled ? ALIGNMENT : alignment);
+        } catch (...) {
+            state->outstanding -= size;
+            throw;
+        }
+    }
+
+    void PoolResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+        bool pooled = bytes <= MAX_POOLED_BYTES && alignment <= ALIGNMENT;
+        if (!pooled) {
+            state->outstanding -= bytes;
+            state->upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        size_t cls = size_class(bytes);
+        size_t size = class_bytes(cls);
+        state->outstanding -= size;
+        if (!cache_gone && cache.bytes + size <= MAX_CACHED_BYTES) {
+            CacheSlot* slot = cache.claim(state);
+            if (slot && slot->counts[cls] < MAX_CACHED_PER_CLASS) {
+                slot->free_lists[cls][slot->counts[cls]++] = p;
+                cache.bytes += size;
+                state->cached += size;
+                return;
+            }
+        }
+        state->upstream->deallocate(p, size, ALIGNMENT);
+    }
+
+    bool PoolResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return this == &other;
+    }
+
+    PoolResource& pool() {
+        // never destroyed, matrices in other statics may still give
+        // buffers back to it on the way out
+        static PoolResource* shared = new PoolResource();
+        return *shared;
+    }
+
+}
@@ -0,0 +1,147 @@
+#ifndef MATRIX_ALLOCATOR_H
+#define MATRIX_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+// Where Matrix storage comes from.
+//
+// Every Matrix buffer is 64-byte aligned (a cache line, and a full
+// AVX-512 register) and comes out of a std::pmr::memory_resource, so
+// callers can plug in their own. By default thats plain aligned
+// new/delete. matrix_memory::pool() is a size-class pool that keeps
+// freed buffers in a per-thread cache, so loops that keep making
+// same-shaped temporaries stop hitting malloc.
+//
+//     matrix_memory::ScopedResource use(&matrix_memory::pool());
+//     for (...) { C = A * B; ... }
+
+namespace matrix_memory {
+
+    constexpr size_t ALIGNMENT = 64;
+
+    // resource new matrices get. a ScopedResource on this thread wins,
+    // then whatever set_default_resource installed, then aligned new/delete
+    std::pmr::memory_resource* resource();
+
+    // install a resource for every thread, returns the previous one.
+    // nullptr goes back to aligned new/delete
+    std::pmr::memory_resource* set_default_resource(std::pmr::memory_resource* r);
+
+    // use r for matrices created on this thread until this goes out of scope
+    class ScopedResource {
+    public:
+        explicit ScopedResource(std::pmr::memory_resource* r);
+        ~ScopedResource();
+        ScopedResource(const ScopedResource&) = delete;
+        ScopedResource& operator=(const ScopedResource&) = delete;
+    private:
+        std::pmr::memory_resource* previous;
+    };
+
+    struct PoolStats {
+        size_t hits;               // allocations served from a cache
+        size_t misses;             // allocations that went to the upstream resource
+        size_t bytes_outstanding;  // handed out and not given back yet
+        size_t bytes_cached;       // sitting in thread caches
+    };
+
+    namespace detail {
+        struct PoolState;
+    }
+
+    // Power-of-two size classes from 64 bytes up to MAX_POOLED_BYTES,
+    // bigger requests go straight through. Freed buffers stay in a cache
+    // of the thread that freed them, kept apart for each pool: up to
+    // MAX_CACHED_PER_CLASS buffers per class, and no more than
+    // MAX_CACHED_BYTES for all the pools a thread caches for together.
+    // A thread caches for MAX_POOLS_PER_THREAD pools at most, frees for
+    // any more go back upstream. What a thread still caches goes back
+    // when it exits, so upstream has to outlive every thread that used
+    // the pool (or have them trim()).
+    class PoolResource : public std::pmr::memory_resource {
+
+    public:
+
+        static constexpr size_t MIN_POOLED_BYTES = 64;
+        static constexpr size_t MAX_POOLED_BYTES = size_t(1) << 28;
+        static constexpr size_t MAX_CACHED_PER_CLASS = 8;
+        static constexpr size_t MAX_CACHED_BYTES = size_t(1) << 28;
+        static constexpr size_t MAX_POOLS_PER_THREAD = 4;
+
+        explicit PoolResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+        // gives back this thread's cache, other threads give theirs
+        // back when they exit
+        ~PoolResource();
+
+        // this pool's numbers only, never another pool's
+        PoolStats stats() const;
+        // zero hits and misses. bytes_outstanding and bytes_cached are
+        // what is out there right now, not counters, they stay
+        void reset_stats();
+
+        // give this thread's cached buffers back to upstream. other
+        // threads keep theirs
+        void trim();
+
+    private:
+
+        std::shared_ptr<detail::PoolState> state;
+
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    };
+
+    // the shared pool, lives for the whole program
+    PoolResource& pool();
+
+}
+
+// std allocator over a memory_resource that always asks for
+// matrix_memory::ALIGNMENT. it follows its buffer on move and swap, so
+// moving a Matrix never reallocates, while a copy picks up whatever
+// resource() is current and copy assignment reuses the buffer it has.
+template <typename T>
+class MatrixAllocator {
+
+public:
+
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    MatrixAllocator() noexcept : res(matrix_memory::resource()) {}
+    MatrixAllocator(std::pmr::memory_resource* r) noexcept : res(r) {}
+    template <typename U>
+    MatrixAllocator(const MatrixAllocator<U>& other) noexcept : res(other.resource()) {}
+
+    MatrixAllocator select_on_container_copy_construction() const noexcept {
+        return MatrixAllocator();
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(res->allocate(n * sizeof(T), matrix_memory::ALIGNMENT));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        res->deallocate(p, n * sizeof(T), matrix_memory::ALIGNMENT);
+    }
+
+    std::pmr::memory_resource* resource() const noexcept { return res; }
+
+    template <typename U>
+    bool operator==(const MatrixAllocator<U>& other) const noexcept { return res == other.resource(); }
+    template <typename U>
+    bool operator!=(const MatrixAllocator<U>& other) const noexcept { return res != other.resource(); }
+
+private:
+
+    std::pmr::memory_resource* res;
+
+};
+
+#endif
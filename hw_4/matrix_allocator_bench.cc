@@ -0,0 +1,35 @@
+#include "matrix.h"
+#include "matrix_allocator.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    // a loop that keeps making same-shaped temporaries, the case the
+    // pool is for. small sizes are where malloc shows up the most
+    void temporaries(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.0), B(n, n, 2.0);
+        for (auto _ : state) {
+            Matrix C = A + B;
+            Matrix D = C * 0.5;
+            benchmark::DoNotOptimize(D.view().data());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * 2);
+    }
+
+    void BM_TemporariesDefault(benchmark::State& state) {
+        temporaries(state);
+    }
+    BENCHMARK(BM_TemporariesDefault)->RangeMultiplier(4)->Range(4, 256);
+
+    void BM_TemporariesPooled(benchmark::State& state) {
+        matrix_memory::PoolResource& pool = matrix_memory::pool();
+        matrix_memory::ScopedResource use(&pool);
+        pool.reset_stats();
+        temporaries(state);
+        matrix_memory::PoolStats stats = pool.stats();
+        state.counters["hit_rate"] = double(stats.hits) / double(stats.hits + stats.misses);
+    }
+    BENCHMARK(BM_TemporariesPooled)->RangeMultiplier(4)->Range(4, 256);
+
+}
@@ -0,0 +1,60 @@
+#include "matrix.h"
+#include "benchmark/benchmark.h"
+
+// Matrix level API, the numbers a user of the class sees (allocation of
+// the result and the thread pool dispatch included). The kernels
+// underneath have their own benchmarks in gemm_bench, transpose_bench
+// and simd_bench. Sizes go from a few cache lines to well past L3.
+namespace {
+
+    void BM_MatrixMultiply(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.5), B(n, n, 0.5);
+        for (auto _ : state) {
+            Matrix C = A * B;
+            benchmark::DoNotOptimize(&C(0, 0));
+        }
+        state.counters["GFLOP/s"] = benchmark::Counter(
+            2.0 * n * n * n, benchmark::Counter::kIsIterationInvariantRate,
+            benchmark::Counter::kIs1000);
+    }
+    BENCHMARK(BM_MatrixMultiply)->RangeMultiplier(4)->Range(8, 2048)
+        ->Unit(benchmark::kMicrosecond);
+
+    // each element is read once and written once
+    void BM_MatrixTranspose(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.5);
+        for (auto _ : state) {
+            Matrix T = A.transpose();
+            benchmark::DoNotOptimize(&T(0, 0));
+        }
+        state.SetBytesProcessed(int64_t(state.iterations()) * 2 * n * n * sizeof(double));
+    }
+    BENCHMARK(BM_MatrixTranspose)->RangeMultiplier(8)->Range(16, 4096)
+        ->Unit(benchmark::kMicrosecond);
+
+    void BM_MatrixTransposeInPlace(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.5);
+        for (auto _ : state) {
+            A.transpose_in_place();
+            benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(int64_t(state.iterations()) * 2 * n * n * sizeof(double));
+    }
+    BENCHMARK(BM_MatrixTransposeInPlace)->RangeMultiplier(8)->Range(16, 4096)
+        ->Unit(benchmark::kMicrosecond);
+
+    void BM_MatrixNorm(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.5);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(A.norm());
+        }
+        state.SetBytesProcessed(int64_t(state.iterations()) * n * n * sizeof(double));
+    }
+    BENCHMARK(BM_MatrixNorm)->RangeMultiplier(8)->Range(16, 4096)
+        ->Unit(benchmark::kMicrosecond);
+
+}
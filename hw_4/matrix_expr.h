@@ -0,0 +1,149 @@
+#ifndef MATRIX_EXPR_H
+#define MATRIX_EXPR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "thread_pool.h"
+
+// Expression templates for the elementwise Matrix operators.
+//
+// A + B * 2.0 - C doesnt compute anything by itself, it builds a small
+// tree of these nodes. The work happens when the tree gets assigned to
+// a Matrix (or used in +=, -=), which runs a single loop over the
+// output and evaluates the whole tree per element. So no temporaries.
+//
+// Nodes are indexed like the matrix itself, expr(r, c), so a leaf can be
+// a whole Matrix or a strided MatrixView into one. Leaves only hold a
+// pointer into the Matrix they came from, so dont keep an expression
+// around (e.g. in an `auto`) longer than its operands.
+//
+// Nothing here assumes double, a node returns whatever its operands
+// combine to (float + float is float, float + double is double).
+
+template <typename E>
+class MatrixExpr {
+
+public:
+
+    const E& self() const { return static_cast<const E&>(*this); }
+
+    size_t rows() const { return self().rows(); }
+    size_t cols() const { return self().cols(); }
+    size_t size() const { return rows() * cols(); }
+    auto operator()(size_t r, size_t c) const { return self()(r, c); }
+
+};
+
+// the scalar type an expression evaluates to
+template <typename E>
+using expr_value_t = typename std::decay<decltype(std::declval<const E&>()(size_t(0), size_t(0)))>::type;
+
+// lhs op rhs, elementwise. dimensions are checked when the node is built
+// so A + D throws right away, same as the old eager operators did
+template <typename L, typename R, typename Op>
+class BinaryExpr : public MatrixExpr<BinaryExpr<L, R, Op>> {
+
+public:
+
+    BinaryExpr(const L& l, const R& r) : lhs(l), rhs(r) {
+        if (l.rows() != r.rows() || l.cols() != r.cols()) {
+            throw std::invalid_argument(Op::mismatch);
+        }
+    }
+
+    size_t rows() const { return lhs.rows(); }
+    size_t cols() const { return lhs.cols(); }
+    auto operator()(size_t r, size_t c) const { return Op::apply(lhs(r, c), rhs(r, c)); }
+
+    const L& left() const { return lhs; }
+    const R& right() const { return rhs; }
+
+private:
+
+    // held by value, leaves are just a pointer and a few sizes
+    L lhs;
+    R rhs;
+
+};
+
+// op(expr) elementwise, where op can carry a scalar
+template <typename E, typename Op>
+class UnaryExpr : public MatrixExpr<UnaryExpr<E, Op>> {
+
+public:
+
+    UnaryExpr(const E& e, Op o) : expr(e), op(o) {}
+
+    size_t rows() const { return expr.rows(); }
+    size_t cols() const { return expr.cols(); }
+    auto operator()(size_t r, size_t c) const { return op(expr(r, c)); }
+
+    const E& operand() const { return expr; }
+    const Op& operation() const { return op; }
+
+private:
+
+    E expr;
+    Op op;
+
+};
+
+// out(r, c) = op(out(r, c), expr(r, c)) over a block with row stride ld.
+// this is the one loop every expression ends up in, split by rows
+// across the pool when the block is big enough
+template <typename T, typename E, typename Op>
+void evaluate_into(T* out, size_t ld, const E& expr, Op op) {
+    size_t rows = expr.rows(), cols = expr.cols();
+    size_t grain = std::max<size_t>(1, parallel::ELEMENTWISE_GRAIN / std::max<size_t>(1, cols));
+    parallel::for_range(rows, grain, [&](size_t first, size_t last) {
+        for (size_t r = first; r < last; r++) {
+            T* row = out + r * ld;
+            for (size_t c = 0; c < cols; c++) {
+                row[c] = op(row[c], expr(r, c));
+            }
+        }
+    });
+}
+
+namespace expr_ops {
+
+    struct Add {
+        static constexpr const char* mismatch = "cant add matrices with different dimensions";
+        template <typename A, typename B>
+        static auto apply(A a, B b) { return a + b; }
+    };
+
+    struct Sub {
+        static constexpr const char* mismatch = "cant subtract matrices with different dimensions";
+        template <typename A, typename B>
+        static auto apply(A a, B b) { return a - b; }
+    };
+
+    // the scalar is stored as the element type of the expression, so
+    // a float matrix times 2.0 stays float
+    template <typename S>
+    struct Scale {
+        S s;
+        template <typename X>
+        auto operator()(X x) const { return x * s; }
+    };
+
+    template <typename S>
+    struct Divide {
+        // just let it happen, if s is 0 youll get inf which is fine i think
+        S s;
+        template <typename X>
+        auto operator()(X x) const { return x / s; }
+    };
+
+    struct Negate {
+        template <typename X>
+        auto operator()(X x) const { return -x; }
+    };
+
+}
+
+#endif
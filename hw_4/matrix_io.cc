@@ -0,0 +1,323 @@
+#include "matrix_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// headers and payloads go to disk as they are in memory and the payload
+// is mapped straight in as doubles, which only matches the format on a
+// little endian host
+#if defined(__BYTE_ORDER__)
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "matrix_io files are little endian, big endian hosts arent supported");
+#endif
+
+namespace {
+
+const char MAGIC[8] = {'M', 'A', 'T', 'X', 'B', 'I', 'N', '\0'};
+constexpr uint64_t PRIME = 0x100000001b3ULL;
+constexpr uint64_t SEED = 0xcbf29ce484222325ULL;
+
+// streaming version of matrix_io::checksum, so the payload of a strided
+// view can be fed in a row at a time. word k always goes to lane k % 4,
+// however the input is split up
+struct Checksum {
+    uint64_t lanes[4] = {SEED, SEED ^ 1, SEED ^ 2, SEED ^ 3};
+    uint64_t words = 0;
+    uint64_t tail = 0;
+    size_t tail_bytes = 0;
+
+    void update(const void* data, size_t bytes) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        // finish a word left over from the last call
+        while (tail_bytes != 0 && bytes > 0) {
+            tail |= uint64_t(*p++) << (8 * tail_bytes);
+            bytes--;
+            if (++tail_bytes == 8) {
+                mix(tail);
+                tail = 0;
+                tail_bytes = 0;
+            }
+        }
+        for (; bytes >= 8; bytes -= 8, p += 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            mix(w);
+        }
+        for (; bytes > 0; bytes--) {
+            tail |= uint64_t(*p++) << (8 * tail_bytes++);
+        }
+    }
+
+    void mix(uint64_t w) {
+        uint64_t& h = lanes[words++ & 3];
+        h = (h ^ w) * PRIME;
+        h ^= h >> 29;
+    }
+
+    uint64_t digest() const {
+        uint64_t h = SEED;
+        for (uint64_t lane : lanes) {
+            h = (h ^ lane) * PRIME;
+        }
+        h = (h ^ tail ^ tail_bytes) * PRIME;
+        h = (h ^ words) * PRIME;
+        return h ^ (h >> 32);
+    }
+};
+
+uint64_t header_checksum(const matrix_io::Header& h) {
+    return matrix_io::checksum(&h, offsetof(matrix_io::Header, header_checksum));
+}
+
+[[noreturn]] void fail(const std::string& path, const std::string& what) {
+    throw std::runtime_error(path + ": " + what);
+}
+
+constexpr size_t WRITE_BUFFER_BYTES = size_t(1) << 20;
+
+// write retries short writes and interrupts
+bool write_all(int fd, const char* data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, data, bytes);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        bytes -= size_t(n);
+    }
+    return true;
+}
+
+std::string directory_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+}
+
+namespace matrix_io {
+
+    uint64_t checksum(const void* data, size_t bytes) {
+        Checksum c;
+        c.update(data, bytes);
+        return c.digest();
+    }
+
+    void save(const std::string& path, ConstMatrixView m, size_t alignment) {
+        if (alignment < 8 || (alignment & (alignment - 1)) != 0) {
+            throw std::invalid_argument("alignment has to be a power of two, at least 8");
+        }
+        Header h = {};
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.dtype = DTYPE_FLOAT64;
+        h.rows = m.rows();
+        h.cols = m.cols();
+        h.alignment = alignment;
+        h.payload_offset = (HEADER_SIZE + alignment - 1) / alignment * alignment;
+
+        Checksum payload;
+        for (size_t r = 0; r < m.rows(); r++) {
+            payload.update(m.data() + r * m.stride(), m.cols() * sizeof(double));
+        }
+        h.payload_checksum = payload.digest();
+        h.header_checksum = header_checksum(h);
+
+        // a temporary of our own next to path, so concurrent saves dont
+        // share one and the rename stays on the same file system
+        std::string tmp = path + ".XXXXXX";
+        int fd = ::mkstemp(&tmp[0]);
+        if (fd < 0) {
+            fail(tmp, "cant create temporary file");
+        }
+        auto abandon = [&](const std::string& what) {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            fail(tmp, what);
+        };
+        // mkstemp makes it 0600, give it the usual 0644
+        if (::fchmod(fd, 0644) != 0) {
+            abandon("cant set permissions");
+        }
+
+        // the rows go out through a buffer, one write per row would be a
+        // system call per row for tall thin matrices
+        std::vector<char> buffer;
+        buffer.reserve(WRITE_BUFFER_BYTES);
+        auto flush = [&]() {
+            if (!write_all(fd, buffer.data(), buffer.size())) {
+                abandon("write failed");
+            }
+            buffer.clear();
+        };
+        auto put = [&](const void* data, size_t bytes) {
+            const char* p = static_cast<const char*>(data);
+            while (bytes > 0) {
+                size_t n = std::min(bytes, WRITE_BUFFER_BYTES - buffer.size());
+                buffer.insert(buffer.end(), p, p + n);
+                p += n;
+                bytes -= n;
+                if (buffer.size() == WRITE_BUFFER_BYTES) {
+                    flush();
+                }
+            }
+        };
+        put(&h, sizeof(h));
+        buffer.resize(buffer.size() + (h.payload_offset - HEADER_SIZE), 0);
+        for (size_t r = 0; r < m.rows(); r++) {
+            put(m.data() + r * m.stride(), m.cols() * sizeof(double));
+        }
+        flush();
+
+        // the data has to be on disk before the rename is, or a power
+        // cut can leave path pointing at an empty or short file
+        if (::fsync(fd) != 0) {
+            abandon("fsync failed");
+        }
+        if (::close(fd) != 0) {
+            ::unlink(tmp.c_str());
+            fail(tmp, "close failed");
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            ::unlink(tmp.c_str());
+            fail(path, "cant rename temporary file into place");
+        }
+        // and the rename itself only lasts once the directory is synced
+        int dir = ::open(directory_of(path).c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir < 0) {
+            fail(path, "cant open directory to sync it");
+        }
+        int synced = ::fsync(dir);
+        ::close(dir);
+        if (synced != 0) {
+            fail(path, "fsync of directory failed");
+        }
+    }
+
+    Matrix load(const std::string& path) {
+        MappedMatrix mapped(path);
+        return Matrix(mapped.view());
+    }
+
+    /* ======= MappedMatrix ======= */
+
+    MappedMatrix::MappedMatrix(const std::string& path, bool verify_payload) : base(nullptr), length(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fail(path, "cant open for reading");
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            fail(path, "cant stat");
+        }
+        if (size_t(st.st_size) < HEADER_SIZE) {
+            ::close(fd);
+            fail(path, "too short for a matrix header");
+        }
+        length = st.st_size;
+        base = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // the mapping keeps the file alive
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            fail(path, "mmap failed");
+        }
+
+        // from here on unmap before throwing, the destructor wont run
+        try {
+            const Header& h = header();
+            if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) {
+                fail(path, "not a matrix file");
+            }
+            if (h.header_checksum != header_checksum(h)) {
+                fail(path, "header checksum mismatch");
+            }
+            if (h.version != VERSION) {
+                fail(path, "unsupported version " + std::to_string(h.version));
+            }
+            if (h.dtype != DTYPE_FLOAT64) {
+                fail(path, "unsupported dtype " + std::to_string(h.dtype));
+            }
+            if (h.alignment < 8 || (h.alignment & (h.alignment - 1)) != 0 ||
+                h.payload_offset < HEADER_SIZE || h.payload_offset % h.alignment != 0) {
+                fail(path, "bad payload alignment");
+            }
+            if (h.cols != 0 && h.rows > (UINT64_MAX / sizeof(double)) / h.cols) {
+                fail(path, "dimensions overflow");
+            }
+            uint64_t payload = h.rows * h.cols * sizeof(double);
+            if (h.payload_offset > length || payload > length - h.payload_offset) {
+                fail(path, "file is truncated");
+            }
+            if (verify_payload && !verify()) {
+                fail(path, "payload checksum mismatch");
+            }
+        } catch (...) {
+            unmap();
+            throw;
+        }
+    }
+
+    MappedMatrix::~MappedMatrix() {
+        unmap();
+    }
+
+    MappedMatrix::MappedMatrix(MappedMatrix&& other) noexcept : base(other.base), length(other.length) {
+        other.base = nullptr;
+        other.length = 0;
+    }
+
+    MappedMatrix& MappedMatrix::operator=(MappedMatrix&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            base = std::exchange(other.base, nullptr);
+            length = std::exchange(other.length, 0);
+        }
+        return *this;
+    }
+
+    void MappedMatrix::unmap() {
+        if (base) {
+            ::munmap(base, length);
+            base = nullptr;
+            length = 0;
+        }
+    }
+
+    const Header& MappedMatrix::header() const {
+        if (!base) {
+            throw std::logic_error("MappedMatrix was moved from");
+        }
+        return *static_cast<const Header*>(base);
+    }
+
+    ConstMatrixView MappedMatrix::view() const {
+        const Header& h = header();
+        const double* payload = reinterpret_cast<const double*>(static_cast<const char*>(base) + h.payload_offset);
+        return ConstMatrixView(payload, h.rows, h.cols, h.cols);
+    }
+
+    size_t MappedMatrix::rows() const { return header().rows; }
+    size_t MappedMatrix::cols() const { return header().cols; }
+
+    bool MappedMatrix::verify() const {
+        const Header& h = header();
+        const char* payload = static_cast<const char*>(base) + h.payload_offset;
+        return checksum(payload, h.rows * h.cols * sizeof(double)) == h.payload_checksum;
+    }
+
+}
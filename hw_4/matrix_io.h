@@ -0,0 +1,104 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "matrix.h"
+
+// Binary Matrix files. A file is a 64 byte header followed by the raw
+// row-major doubles, starting at an offset that is a multiple of the
+// header's alignment (64 by default), so a mapped file lines up with
+// cache lines just like a Matrix does.
+//
+//     offset  size  field
+//          0     8  magic "MATXBIN\0"
+//          8     4  version (1)
+//         12     4  dtype (1 = little endian float64)
+//         16     8  rows
+//         24     8  cols
+//         32     8  alignment of the payload
+//         40     8  payload offset
+//         48     8  payload checksum
+//         56     8  header checksum, over bytes 0..55
+//
+// All integers are little endian. Nothing gets byte swapped, the header
+// and payload are written and mapped as they are in memory, so this
+// only builds for little endian hosts (a static_assert in matrix_io.cc
+// says so on a big endian one). The header checksum is checked on
+// every open, the payload one only when asked for since it means
+// reading the whole file. Anything wrong with a file throws
+// std::runtime_error.
+namespace matrix_io {
+
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t DTYPE_FLOAT64 = 1;
+    constexpr size_t HEADER_SIZE = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t dtype;
+        uint64_t rows;
+        uint64_t cols;
+        uint64_t alignment;
+        uint64_t payload_offset;
+        uint64_t payload_checksum;
+        uint64_t header_checksum;
+    };
+    static_assert(sizeof(Header) == HEADER_SIZE, "Header has to be exactly 64 bytes");
+
+    // write m (a Matrix or any view of one) to path. it goes into a
+    // temporary file of its own in the same directory, which is synced
+    // to disk, renamed over path, and then the directory is synced too.
+    // so even after a crash or a power cut path is either the old file
+    // or the whole new one, and saves to the same path at the same time
+    // dont get in each other's way (the last rename wins)
+    void save(const std::string& path, ConstMatrixView m, size_t alignment = 64);
+
+    // read a file into a new Matrix, the payload is copied once
+    Matrix load(const std::string& path);
+
+    // checksum used for both the header and the payload, four
+    // independent multiply-xor lanes so it runs at memory speed
+    uint64_t checksum(const void* data, size_t bytes);
+
+    // A file mapped read-only into memory. Opening only reads the
+    // header, pages of the payload come in as they get touched, and
+    // view() points straight into the mapping without copying. The view
+    // is valid for as long as this object is.
+    class MappedMatrix {
+
+    public:
+
+        // verify = also check the payload checksum right away
+        explicit MappedMatrix(const std::string& path, bool verify = false);
+        ~MappedMatrix();
+
+        MappedMatrix(MappedMatrix&& other) noexcept;
+        MappedMatrix& operator=(MappedMatrix&& other) noexcept;
+        MappedMatrix(const MappedMatrix&) = delete;
+        MappedMatrix& operator=(const MappedMatrix&) = delete;
+
+        ConstMatrixView view() const;
+        operator ConstMatrixView() const { return view(); }
+
+        size_t rows() const;
+        size_t cols() const;
+        const Header& header() const;
+
+        // recompute the payload checksum and compare
+        bool verify() const;
+
+    private:
+
+        void* base;
+        size_t length;
+
+        void unmap();
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,49 @@
+#include "matrix_io.h"
+#include "benchmark/benchmark.h"
+#include <cstdio>
+#include <string>
+
+namespace {
+
+    const std::string PATH = "/tmp/matrix_io_bench.bin";
+
+    void set_bytes(benchmark::State& state, size_t n) {
+        state.SetBytesProcessed(int64_t(state.iterations()) * n * n * sizeof(double));
+    }
+
+    void BM_Save(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.0);
+        for (auto _ : state) {
+            matrix_io::save(PATH, A);
+        }
+        set_bytes(state, n);
+    }
+    BENCHMARK(BM_Save)->Arg(256)->Arg(2048)->Unit(benchmark::kMillisecond);
+
+    // read everything into a new Matrix
+    void BM_Load(benchmark::State& state) {
+        size_t n = state.range(0);
+        matrix_io::save(PATH, Matrix(n, n, 1.0));
+        for (auto _ : state) {
+            Matrix A = matrix_io::load(PATH);
+            benchmark::DoNotOptimize(A.view().data());
+        }
+        set_bytes(state, n);
+    }
+    BENCHMARK(BM_Load)->Arg(256)->Arg(2048)->Unit(benchmark::kMillisecond);
+
+    // just the mapping and header check, this is what a job pays at startup
+    void BM_Map(benchmark::State& state) {
+        size_t n = state.range(0);
+        matrix_io::save(PATH, Matrix(n, n, 1.0));
+        for (auto _ : state) {
+            matrix_io::MappedMatrix m(PATH, state.range(1) != 0);
+            benchmark::DoNotOptimize(m.view().data());
+        }
+        set_bytes(state, n);
+        std::remove(PATH.c_str());
+    }
+    BENCHMARK(BM_Map)->Args({2048, 0})->Args({2048, 1})->Unit(benchmark::kMicrosecond);
+
+}
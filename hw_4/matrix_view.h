@@ -0,0 +1,127 @@
+#ifndef MATRIX_VIEW_H
+#define MATRIX_VIEW_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include "matrix_expr.h"
+
+// Non-owning window onto a block of a row-major matrix: a pointer to
+// the first element, the block size and the row stride of the matrix
+// underneath. Getting a row, column, block or the diagonal of a Matrix
+// this way costs nothing, and views work as operands of the lazy
+// elementwise operators and of the matrix product.
+//
+// T is double for a writable view (MatrixView) or const double for a
+// read-only one (ConstMatrixView), or the float / complex versions of
+// those for the other Matrix types. Copying a view copies the window,
+// but assigning to a writable view writes the elements through it:
+//
+//     A.row(0) = A.row(1) * 2.0;
+//
+// A view is only good while the matrix it points into is alive and
+// hasnt been resized. Assigning between overlapping views of the same
+// matrix isnt supported, copy one side into a Matrix first.
+template <typename T>
+class BasicMatrixView : public MatrixExpr<BasicMatrixView<T>> {
+
+public:
+
+    using value_type = typename std::remove_const<T>::type;
+
+    BasicMatrixView() : ptr(nullptr), num_rows(0), num_cols(0), row_stride(0) {}
+    BasicMatrixView(T* data, size_t rows, size_t cols, size_t stride)
+        : ptr(data), num_rows(rows), num_cols(cols), row_stride(stride) {}
+    BasicMatrixView(const BasicMatrixView& other) = default;
+
+    // MatrixView -> ConstMatrixView
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    BasicMatrixView(const BasicMatrixView<U>& other)
+        : ptr(other.data()), num_rows(other.rows()), num_cols(other.cols()), row_stride(other.stride()) {}
+
+    // element-wise copy, see above
+    BasicMatrixView& operator=(const BasicMatrixView& other) {
+        return *this = static_cast<const MatrixExpr<BasicMatrixView>&>(other);
+    }
+
+    template <typename E>
+    BasicMatrixView& operator=(const MatrixExpr<E>& expr) {
+        check_dims(expr.rows(), expr.cols());
+        evaluate_into(ptr, row_stride, expr.self(), [](auto, auto x) { return x; });
+        return *this;
+    }
+
+    template <typename E>
+    BasicMatrixView& operator+=(const MatrixExpr<E>& expr) {
+        check_dims(expr.rows(), expr.cols());
+        evaluate_into(ptr, row_stride, expr.self(), [](auto a, auto x) { return a + x; });
+        return *this;
+    }
+
+    template <typename E>
+    BasicMatrixView& operator-=(const MatrixExpr<E>& expr) {
+        check_dims(expr.rows(), expr.cols());
+        evaluate_into(ptr, row_stride, expr.self(), [](auto a, auto x) { return a - x; });
+        return *this;
+    }
+
+    BasicMatrixView& operator*=(value_type scalar) {
+        evaluate_into(ptr, row_stride, *this, [scalar](auto a, auto) { return a * scalar; });
+        return *this;
+    }
+
+    void fill(value_type value) {
+        evaluate_into(ptr, row_stride, *this, [value](auto, auto) { return value; });
+    }
+
+    size_t rows() const { return num_rows; }
+    size_t cols() const { return num_cols; }
+    size_t stride() const { return row_stride; }
+    T* data() const { return ptr; }
+    bool isEmpty() const { return num_rows == 0 || num_cols == 0; }
+
+    T& operator()(size_t r, size_t c) const { return ptr[r * row_stride + c]; }
+
+    T& at(size_t r, size_t c) const {
+        if (r >= num_rows || c >= num_cols) {
+            throw std::out_of_range("index out of range");
+        }
+        return ptr[r * row_stride + c];
+    }
+
+    // sub-views, relative to this one
+    BasicMatrixView row(size_t r) const { return block(r, 0, 1, num_cols); }
+    BasicMatrixView col(size_t c) const { return block(0, c, num_rows, 1); }
+
+    BasicMatrixView block(size_t r, size_t c, size_t rows, size_t cols) const {
+        if (r + rows > num_rows || c + cols > num_cols) {
+            throw std::out_of_range("block out of range");
+        }
+        return BasicMatrixView(ptr + r * row_stride + c, rows, cols, row_stride);
+    }
+
+    // the diagonal as an n x 1 column, stepping stride + 1 per row
+    BasicMatrixView diagonal() const {
+        size_t n = num_rows < num_cols ? num_rows : num_cols;
+        return BasicMatrixView(ptr, n, 1, row_stride + 1);
+    }
+
+private:
+
+    T* ptr;
+    size_t num_rows;
+    size_t num_cols;
+    size_t row_stride;
+
+    void check_dims(size_t rows, size_t cols) const {
+        if (rows != num_rows || cols != num_cols) {
+            throw std::invalid_argument("view dimensions dont match");
+        }
+    }
+
+};
+
+using MatrixView = BasicMatrixView<double>;
+using ConstMatrixView = BasicMatrixView<const double>;
+
+#endif
@@ -0,0 +1,703 @@
+#include "simd.h"
+#include <atomic>
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+namespace {
+
+/* ======= portable fallback ======= */
+
+namespace scalar {
+
+// templated so the float versions share them
+
+template <typename T>
+void add(const T* a, const T* b, T* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] + b[i];
+    }
+}
+
+template <typename T>
+void sub(const T* a, const T* b, T* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] - b[i];
+    }
+}
+
+template <typename T>
+void scale(const T* a, T s, T* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] * s;
+    }
+}
+
+template <typename T>
+void fill(T* out, T value, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = value;
+    }
+}
+
+// always sums in double, floats get widened first
+template <typename T>
+double sum_squares(const T* a, size_t n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        double x0 = a[i], x1 = a[i + 1], x2 = a[i + 2], x3 = a[i + 3];
+        s0 += x0 * x0;
+        s1 += x1 * x1;
+        s2 += x2 * x2;
+        s3 += x3 * x3;
+    }
+    for (; i < n; i++) {
+        double x = a[i];
+        s0 += x * x;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+bool all_close(const double* a, const double* b, size_t n, double eps) {
+    for (size_t i = 0; i < n; i++) {
+        if (std::fabs(a[i] - b[i]) > eps) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+T sum(const T* a, size_t n) {
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i];
+        s1 += a[i + 1];
+        s2 += a[i + 2];
+        s3 += a[i + 3];
+    }
+    for (; i < n; i++) {
+        s0 += a[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+template <typename T>
+size_t find(const T* a, size_t n, T value) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] == value) {
+            return i;
+        }
+    }
+    return n;
+}
+
+}
+
+#ifdef SIMD_X86
+
+/* ======= AVX2 + FMA, 4 doubles per register ======= */
+
+namespace avx2 {
+
+__attribute__((target("avx2,fma")))
+void add(const double* a, const double* b, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    scalar::add(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void sub(const double* a, const double* b, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    scalar::sub(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void scale(const double* a, double s, double* out, size_t n) {
+    __m256d vs = _mm256_set1_pd(s);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), vs));
+    }
+    scalar::scale(a + i, s, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void fill(double* out, double value, size_t n) {
+    __m256d v = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, v);
+    }
+    scalar::fill(out + i, value, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+double sum_squares(const double* a, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(),
+            s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256d x0 = _mm256_loadu_pd(a + i), x1 = _mm256_loadu_pd(a + i + 4),
+                x2 = _mm256_loadu_pd(a + i + 8), x3 = _mm256_loadu_pd(a + i + 12);
+        s0 = _mm256_fmadd_pd(x0, x0, s0);
+        s1 = _mm256_fmadd_pd(x1, x1, s1);
+        s2 = _mm256_fmadd_pd(x2, x2, s2);
+        s3 = _mm256_fmadd_pd(x3, x3, s3);
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        s0 = _mm256_fmadd_pd(x, x, s0);
+    }
+    __m256d s = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, s);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalar::sum_squares(a + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+bool all_close(const double* a, const double* b, size_t n, double eps) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d veps = _mm256_set1_pd(eps);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d diff = _mm256_andnot_pd(sign, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        // ordered compare, so NaN counts as close just like fabs(..) > eps does
+        if (_mm256_movemask_pd(_mm256_cmp_pd(diff, veps, _CMP_GT_OQ)) != 0) {
+            return false;
+        }
+    }
+    return scalar::all_close(a + i, b + i, n - i, eps);
+}
+
+__attribute__((target("avx2,fma")))
+double sum(const double* a, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(),
+            s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+        s2 = _mm256_add_pd(s2, _mm256_loadu_pd(a + i + 8));
+        s3 = _mm256_add_pd(s3, _mm256_loadu_pd(a + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalar::sum(a + i, n - i);
+}
+
+// two registers per compare, the match (if any) is in the 8 just loaded
+__attribute__((target("avx2,fma")))
+size_t find(const double* a, size_t n, double value) {
+    __m256d v = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int lo = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), v, _CMP_EQ_OQ));
+        int hi = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i + 4), v, _CMP_EQ_OQ));
+        if ((lo | hi) != 0) {
+            return i + __builtin_ctz(lo | (hi << 4));
+        }
+    }
+    return i + scalar::find(a + i, n - i, value);
+}
+
+/* ======= AVX2, 8 floats per register ======= */
+
+__attribute__((target("avx2,fma")))
+void add(const float* a, const float* b, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    scalar::add(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void sub(const float* a, const float* b, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    scalar::sub(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void scale(const float* a, float s, float* out, size_t n) {
+    __m256 vs = _mm256_set1_ps(s);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), vs));
+    }
+    scalar::scale(a + i, s, out + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+void fill(float* out, float value, size_t n) {
+    __m256 v = _mm256_set1_ps(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, v);
+    }
+    scalar::fill(out + i, value, n - i);
+}
+
+// widened to double before squaring, so a big float matrix doesnt lose
+// digits in the sum
+__attribute__((target("avx2,fma")))
+double sum_squares(const float* a, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(a + i);
+        __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+        __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+        s0 = _mm256_fmadd_pd(lo, lo, s0);
+        s1 = _mm256_fmadd_pd(hi, hi, s1);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalar::sum_squares(a + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+float sum(const float* a, size_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(),
+           s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm256_add_ps(s0, _mm256_loadu_ps(a + i));
+        s1 = _mm256_add_ps(s1, _mm256_loadu_ps(a + i + 8));
+        s2 = _mm256_add_ps(s2, _mm256_loadu_ps(a + i + 16));
+        s3 = _mm256_add_ps(s3, _mm256_loadu_ps(a + i + 24));
+    }
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_ps(s0, _mm256_loadu_ps(a + i));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+           ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) + scalar::sum(a + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+size_t find(const float* a, size_t n, float value) {
+    __m256 v = _mm256_set1_ps(value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int lo = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a + i), v, _CMP_EQ_OQ));
+        int hi = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a + i + 8), v, _CMP_EQ_OQ));
+        if ((lo | hi) != 0) {
+            return i + __builtin_ctz(lo | (hi << 8));
+        }
+    }
+    return i + scalar::find(a + i, n - i, value);
+}
+
+}
+
+/* ======= AVX-512, 8 doubles per register ======= */
+
+namespace avx512 {
+
+__attribute__((target("avx512f")))
+void add(const double* a, const double* b, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(out + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    }
+    scalar::add(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void sub(const double* a, const double* b, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(out + i, _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+    }
+    scalar::sub(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void scale(const double* a, double s, double* out, size_t n) {
+    __m512d vs = _mm512_set1_pd(s);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), vs));
+    }
+    scalar::scale(a + i, s, out + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void fill(double* out, double value, size_t n) {
+    __m512d v = _mm512_set1_pd(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(out + i, v);
+    }
+    scalar::fill(out + i, value, n - i);
+}
+
+__attribute__((target("avx512f")))
+double sum_squares(const double* a, size_t n) {
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd(),
+            s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512d x0 = _mm512_loadu_pd(a + i), x1 = _mm512_loadu_pd(a + i + 8),
+                x2 = _mm512_loadu_pd(a + i + 16), x3 = _mm512_loadu_pd(a + i + 24);
+        s0 = _mm512_fmadd_pd(x0, x0, s0);
+        s1 = _mm512_fmadd_pd(x1, x1, s1);
+        s2 = _mm512_fmadd_pd(x2, x2, s2);
+        s3 = _mm512_fmadd_pd(x3, x3, s3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m512d x = _mm512_loadu_pd(a + i);
+        s0 = _mm512_fmadd_pd(x, x, s0);
+    }
+    __m512d s = _mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3));
+    return _mm512_reduce_add_pd(s) + scalar::sum_squares(a + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+bool all_close(const double* a, const double* b, size_t n, double eps) {
+    const __m512d veps = _mm512_set1_pd(eps);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d diff = _mm512_abs_pd(_mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+        if (_mm512_cmp_pd_mask(diff, veps, _CMP_GT_OQ) != 0) {
+            return false;
+        }
+    }
+    return scalar::all_close(a + i, b + i, n - i, eps);
+}
+
+__attribute__((target("avx512f")))
+double sum(const double* a, size_t n) {
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd(),
+            s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm512_add_pd(s0, _mm512_loadu_pd(a + i));
+        s1 = _mm512_add_pd(s1, _mm512_loadu_pd(a + i + 8));
+        s2 = _mm512_add_pd(s2, _mm512_loadu_pd(a + i + 16));
+        s3 = _mm512_add_pd(s3, _mm512_loadu_pd(a + i + 24));
+    }
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm512_add_pd(s0, _mm512_loadu_pd(a + i));
+    }
+    __m512d s = _mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3));
+    return _mm512_reduce_add_pd(s) + scalar::sum(a + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+size_t find(const double* a, size_t n, double value) {
+    __m512d v = _mm512_set1_pd(value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned lo = _mm512_cmp_pd_mask(_mm512_loadu_pd(a + i), v, _CMP_EQ_OQ);
+        unsigned hi = _mm512_cmp_pd_mask(_mm512_loadu_pd(a + i + 8), v, _CMP_EQ_OQ);
+        if ((lo | hi) != 0) {
+            return i + __builtin_ctz(lo | (hi << 8));
+        }
+    }
+    return i + scalar::find(a + i, n - i, value);
+}
+
+/* ======= AVX-512, 16 floats per register ======= */
+
+__attribute__((target("avx512f")))
+void add(const float* a, const float* b, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    }
+    scalar::add(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void sub(const float* a, const float* b, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    }
+    scalar::sub(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void scale(const float* a, float s, float* out, size_t n) {
+    __m512 vs = _mm512_set1_ps(s);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(a + i), vs));
+    }
+    scalar::scale(a + i, s, out + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void fill(float* out, float value, size_t n) {
+    __m512 v = _mm512_set1_ps(value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(out + i, v);
+    }
+    scalar::fill(out + i, value, n - i);
+}
+
+__attribute__((target("avx512f")))
+double sum_squares(const float* a, size_t n) {
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512d lo = _mm512_cvtps_pd(_mm256_loadu_ps(a + i));
+        __m512d hi = _mm512_cvtps_pd(_mm256_loadu_ps(a + i + 8));
+        s0 = _mm512_fmadd_pd(lo, lo, s0);
+        s1 = _mm512_fmadd_pd(hi, hi, s1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(s0, s1)) + scalar::sum_squares(a + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+float sum(const float* a, size_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(),
+           s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        s0 = _mm512_add_ps(s0, _mm512_loadu_ps(a + i));
+        s1 = _mm512_add_ps(s1, _mm512_loadu_ps(a + i + 16));
+        s2 = _mm512_add_ps(s2, _mm512_loadu_ps(a + i + 32));
+        s3 = _mm512_add_ps(s3, _mm512_loadu_ps(a + i + 48));
+    }
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm512_add_ps(s0, _mm512_loadu_ps(a + i));
+    }
+    __m512 s = _mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3));
+    return _mm512_reduce_add_ps(s) + scalar::sum(a + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+size_t find(const float* a, size_t n, float value) {
+    __m512 v = _mm512_set1_ps(value);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        unsigned lo = _mm512_cmp_ps_mask(_mm512_loadu_ps(a + i), v, _CMP_EQ_OQ);
+        unsigned hi = _mm512_cmp_ps_mask(_mm512_loadu_ps(a + i + 16), v, _CMP_EQ_OQ);
+        if ((lo | hi) != 0) {
+            return i + __builtin_ctz(lo | (hi << 16));
+        }
+    }
+    return i + scalar::find(a + i, n - i, value);
+}
+
+}
+
+#endif
+
+/* ======= dispatch ======= */
+
+struct Kernels {
+    void (*add)(const double*, const double*, double*, size_t);
+    void (*sub)(const double*, const double*, double*, size_t);
+    void (*scale)(const double*, double, double*, size_t);
+    void (*fill)(double*, double, size_t);
+    double (*sum_squares)(const double*, size_t);
+    bool (*all_close)(const double*, const double*, size_t, double);
+    void (*add_f)(const float*, const float*, float*, size_t);
+    void (*sub_f)(const float*, const float*, float*, size_t);
+    void (*scale_f)(const float*, float, float*, size_t);
+    void (*fill_f)(float*, float, size_t);
+    double (*sum_squares_f)(const float*, size_t);
+    double (*sum)(const double*, size_t);
+    size_t (*find)(const double*, size_t, double);
+    float (*sum_f)(const float*, size_t);
+    size_t (*find_f)(const float*, size_t, float);
+};
+
+const Kernels scalar_kernels = {
+    scalar::add, scalar::sub, scalar::scale, scalar::fill,
+    scalar::sum_squares, scalar::all_close,
+    scalar::add, scalar::sub, scalar::scale, scalar::fill, scalar::sum_squares,
+    scalar::sum, scalar::find, scalar::sum, scalar::find
+};
+
+#ifdef SIMD_X86
+const Kernels avx2_kernels = {
+    avx2::add, avx2::sub, avx2::scale, avx2::fill,
+    avx2::sum_squares, avx2::all_close,
+    avx2::add, avx2::sub, avx2::scale, avx2::fill, avx2::sum_squares,
+    avx2::sum, avx2::find, avx2::sum, avx2::find
+};
+
+const Kernels avx512_kernels = {
+    avx512::add, avx512::sub, avx512::scale, avx512::fill,
+    avx512::sum_squares, avx512::all_close,
+    avx512::add, avx512::sub, avx512::scale, avx512::fill, avx512::sum_squares,
+    avx512::sum, avx512::find, avx512::sum, avx512::find
+};
+#endif
+
+Level detect() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return Level::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return Level::AVX2;
+    }
+#endif
+    return Level::Scalar;
+}
+
+std::atomic<const Kernels*>& current() {
+    static std::atomic<const Kernels*> table(nullptr);
+    return table;
+}
+
+const Kernels& kernels_for(Level level) {
+#ifdef SIMD_X86
+    if (level == Level::AVX512) {
+        return avx512_kernels;
+    }
+    if (level == Level::AVX2) {
+        return avx2_kernels;
+    }
+#endif
+    return scalar_kernels;
+}
+
+const Kernels& kernels() {
+    const Kernels* k = current().load(std::memory_order_relaxed);
+    if (k == nullptr) {
+        k = &kernels_for(detected());
+        current().store(k, std::memory_order_relaxed);
+    }
+    return *k;
+}
+
+}
+
+Level detected() {
+    static const Level level = detect();
+    return level;
+}
+
+Level active() {
+    const Kernels* k = &kernels();
+#ifdef SIMD_X86
+    if (k == &avx512_kernels) {
+        return Level::AVX512;
+    }
+    if (k == &avx2_kernels) {
+        return Level::AVX2;
+    }
+#endif
+    return Level::Scalar;
+}
+
+void set_level(Level level) {
+    if (static_cast<int>(level) > static_cast<int>(detected())) {
+        level = detected();
+    }
+    current().store(&kernels_for(level), std::memory_order_relaxed);
+}
+
+const char* level_name(Level level) {
+    switch (level) {
+        case Level::AVX512: return "avx512";
+        case Level::AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+void add(const double* a, const double* b, double* out, size_t n) {
+    kernels().add(a, b, out, n);
+}
+
+void sub(const double* a, const double* b, double* out, size_t n) {
+    kernels().sub(a, b, out, n);
+}
+
+void scale(const double* a, double s, double* out, size_t n) {
+    kernels().scale(a, s, out, n);
+}
+
+void fill(double* out, double value, size_t n) {
+    kernels().fill(out, value, n);
+}
+
+double sum_squares(const double* a, size_t n) {
+    return kernels().sum_squares(a, n);
+}
+
+double strided_sum(const double* a, size_t n, size_t stride) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i * stride];
+        s1 += a[(i + 1) * stride];
+        s2 += a[(i + 2) * stride];
+        s3 += a[(i + 3) * stride];
+    }
+    for (; i < n; i++) {
+        s0 += a[i * stride];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+bool all_close(const double* a, const double* b, size_t n, double eps) {
+    return kernels().all_close(a, b, n, eps);
+}
+
+double sum(const double* a, size_t n) {
+    return kernels().sum(a, n);
+}
+
+size_t find(const double* a, size_t n, double value) {
+    return kernels().find(a, n, value);
+}
+
+void add(const float* a, const float* b, float* out, size_t n) {
+    kernels().add_f(a, b, out, n);
+}
+
+void sub(const float* a, const float* b, float* out, size_t n) {
+    kernels().sub_f(a, b, out, n);
+}
+
+void scale(const float* a, float s, float* out, size_t n) {
+    kernels().scale_f(a, s, out, n);
+}
+
+void fill(float* out, float value, size_t n) {
+    kernels().fill_f(out, value, n);
+}
+
+double sum_squares(const float* a, size_t n) {
+    return kernels().sum_squares_f(a, n);
+}
+
+float sum(const float* a, size_t n) {
+    return kernels().sum_f(a, n);
+}
+
+size_t find(const float* a, size_t n, float value) {
+    return kernels().find_f(a, n, value);
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+
+// Vectorized kernels for the flat Matrix loops (fill, norm, ==, and the
+// simple add/sub/scale expressions). The best instruction set the CPU
+// supports is picked at runtime the first time a kernel is called, so
+// the binary still runs on machines without AVX. Everything has a
+// plain C++ fallback.
+namespace simd {
+
+    enum class Level { Scalar, AVX2, AVX512 };
+
+    // best level this CPU supports
+    Level detected();
+
+    // level the kernels are currently using
+    Level active();
+
+    // force a level, mostly for tests and benchmarks. asking for more
+    // than the CPU supports gets clamped to detected()
+    void set_level(Level level);
+
+    const char* level_name(Level level);
+
+    // out[i] = a[i] + b[i], a[i] - b[i], a[i] * s. out may alias a or b
+    void add(const double* a, const double* b, double* out, size_t n);
+    void sub(const double* a, const double* b, double* out, size_t n);
+    void scale(const double* a, double s, double* out, size_t n);
+
+    void fill(double* out, double value, size_t n);
+
+    // sum of a[i]^2, with several accumulators to hide fma latency
+    double sum_squares(const double* a, size_t n);
+
+    // a[0] + a[stride] + a[2 * stride] + ... (n terms), for trace. the
+    // loads are a cache line apart so this is not vectorized, it just
+    // splits the sum over independent accumulators
+    double strided_sum(const double* a, size_t n, size_t stride);
+
+    // true if |a[i] - b[i]| <= eps for every i. stops at the first
+    // vector with a mismatch in it
+    bool all_close(const double* a, const double* b, size_t n, double eps);
+
+    // a[0] + ... + a[n - 1], split over several accumulators so the
+    // order (and the last bits) differ from a plain loop
+    double sum(const double* a, size_t n);
+
+    // first i with a[i] == value, n if there isnt one
+    size_t find(const double* a, size_t n, double value);
+
+    // float versions, twice the elements per register. sum_squares still
+    // accumulates in double
+    void add(const float* a, const float* b, float* out, size_t n);
+    void sub(const float* a, const float* b, float* out, size_t n);
+    void scale(const float* a, float s, float* out, size_t n);
+    void fill(float* out, float value, size_t n);
+    double sum_squares(const float* a, size_t n);
+    float sum(const float* a, size_t n);
+    size_t find(const float* a, size_t n, float value);
+
+}
+
+#endif
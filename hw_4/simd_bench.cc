@@ -0,0 +1,77 @@
+#include "matrix.h"
+#include "simd.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    // args: number of elements, simd level
+    void set_bytes(benchmark::State& state, size_t bytes_per_iter) {
+        state.SetBytesProcessed(int64_t(state.iterations()) * bytes_per_iter);
+        state.SetLabel(simd::level_name(simd::active()));
+    }
+
+    bool use_level(benchmark::State& state) {
+        simd::Level level = static_cast<simd::Level>(state.range(1));
+        if (static_cast<int>(level) > static_cast<int>(simd::detected())) {
+            state.SkipWithError("not supported on this cpu");
+            return false;
+        }
+        simd::set_level(level);
+        return true;
+    }
+
+    void levels(benchmark::internal::Benchmark* b) {
+        for (int n : {1 << 10, 1 << 16, 1 << 22}) {
+            for (int level = 0; level <= 2; level++) {
+                b->Args({n, level});
+            }
+        }
+    }
+
+    void BM_Norm(benchmark::State& state) {
+        if (!use_level(state)) return;
+        size_t n = state.range(0);
+        Matrix A(n, 1, 1.25);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(A.norm());
+        }
+        set_bytes(state, n * sizeof(double));
+    }
+    BENCHMARK(BM_Norm)->Apply(levels);
+
+    void BM_Equal(benchmark::State& state) {
+        if (!use_level(state)) return;
+        size_t n = state.range(0);
+        Matrix A(n, 1, 1.25), B(n, 1, 1.25);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(A == B);
+        }
+        set_bytes(state, 2 * n * sizeof(double));
+    }
+    BENCHMARK(BM_Equal)->Apply(levels);
+
+    void BM_Fill(benchmark::State& state) {
+        if (!use_level(state)) return;
+        size_t n = state.range(0);
+        Matrix A(n, 1);
+        for (auto _ : state) {
+            A.fill(3.0);
+            benchmark::ClobberMemory();
+        }
+        set_bytes(state, n * sizeof(double));
+    }
+    BENCHMARK(BM_Fill)->Apply(levels);
+
+    void BM_Add(benchmark::State& state) {
+        if (!use_level(state)) return;
+        size_t n = state.range(0);
+        Matrix A(n, 1, 1.0), B(n, 1, 2.0), C(n, 1);
+        for (auto _ : state) {
+            C = A + B;
+            benchmark::ClobberMemory();
+        }
+        set_bytes(state, 3 * n * sizeof(double));
+    }
+    BENCHMARK(BM_Add)->Apply(levels);
+
+}
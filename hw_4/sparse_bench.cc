@@ -0,0 +1,53 @@
+#include "sparse_matrix.h"
+#include "benchmark/benchmark.h"
+#include <vector>
+
+namespace {
+
+    // n x n with about nnz_per_row entries per row, the kind of thing that
+    // doesnt fit as a dense Matrix at all past a few 10k rows
+    SparseMatrix random_sparse(size_t n, size_t nnz_per_row) {
+        std::vector<SparseMatrix::Triplet> t;
+        t.reserve(n * nnz_per_row);
+        size_t state = 12345;
+        for (size_t r = 0; r < n; r++) {
+            for (size_t k = 0; k < nnz_per_row; k++) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                t.push_back({r, (state >> 33) % n, 1.0});
+            }
+        }
+        return SparseMatrix(n, n, t);
+    }
+
+    void BM_SpMV(benchmark::State& state) {
+        size_t n = state.range(0);
+        SparseMatrix A = random_sparse(n, 10);
+        std::vector<double> x(n, 1.0);
+        for (auto _ : state) {
+            std::vector<double> y = A.multiply(x, state.range(1));
+            benchmark::DoNotOptimize(y.data());
+        }
+        state.counters["GFLOP/s"] = benchmark::Counter(
+            double(state.iterations()) * 2 * A.nonZeros() / 1e9, benchmark::Counter::kIsRate);
+    }
+    BENCHMARK(BM_SpMV)->Args({10000, 1})->Args({100000, 1})->Args({100000, 4})
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+    void BM_SpMM(benchmark::State& state) {
+        size_t n = state.range(0), k = 32;
+        SparseMatrix A = random_sparse(n, 10);
+        if (state.range(2)) {
+            A = A.to_csc();
+        }
+        Matrix X(n, k, 1.0);
+        for (auto _ : state) {
+            Matrix Y = A.multiply(X, state.range(1));
+            benchmark::DoNotOptimize(Y.view().data());
+        }
+        state.counters["GFLOP/s"] = benchmark::Counter(
+            double(state.iterations()) * 2 * A.nonZeros() * k / 1e9, benchmark::Counter::kIsRate);
+    }
+    BENCHMARK(BM_SpMM)->Args({100000, 1, 0})->Args({100000, 4, 0})->Args({100000, 1, 1})
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}
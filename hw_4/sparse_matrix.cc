@@ -0,0 +1,327 @@
+#include "sparse_matrix.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+using Format = SparseMatrix::Format;
+
+// build compressed arrays from coordinate lists (o[k], in[k], v[k]) in
+// any order: a counting sort on the outer index, then each segment gets
+// sorted on the inner index and duplicates are summed
+void compress(size_t outer_dim, const std::vector<size_t>& o, const std::vector<size_t>& in,
+              const std::vector<double>& v, std::vector<size_t>& outer,
+              std::vector<size_t>& inner, std::vector<double>& vals) {
+    size_t n = o.size();
+    outer.assign(outer_dim + 1, 0);
+    for (size_t k = 0; k < n; k++) {
+        outer[o[k] + 1]++;
+    }
+    for (size_t i = 0; i < outer_dim; i++) {
+        outer[i + 1] += outer[i];
+    }
+    std::vector<size_t> pos(outer.begin(), outer.end() - 1);
+    inner.resize(n);
+    vals.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        size_t p = pos[o[k]]++;
+        inner[p] = in[k];
+        vals[p] = v[k];
+    }
+
+    std::vector<std::pair<size_t, double>> segment;
+    size_t w = 0;
+    for (size_t i = 0; i < outer_dim; i++) {
+        size_t begin = outer[i], end = outer[i + 1];
+        if (!std::is_sorted(inner.begin() + begin, inner.begin() + end)) {
+            segment.clear();
+            for (size_t k = begin; k < end; k++) {
+                segment.emplace_back(inner[k], vals[k]);
+            }
+            std::stable_sort(segment.begin(), segment.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (size_t k = begin; k < end; k++) {
+                inner[k] = segment[k - begin].first;
+                vals[k] = segment[k - begin].second;
+            }
+        }
+        // outer[i] is only read above, so it can be rewritten now
+        outer[i] = w;
+        for (size_t k = begin; k < end; k++) {
+            if (w > outer[i] && inner[w - 1] == inner[k]) {
+                vals[w - 1] += vals[k];
+            } else {
+                inner[w] = inner[k];
+                vals[w] = vals[k];
+                w++;
+            }
+        }
+    }
+    outer[outer_dim] = w;
+    inner.resize(w);
+    vals.resize(w);
+}
+
+// out[0..n) += a * x[0..n)
+void axpy(double* out, const double* x, double a, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] += a * x[i];
+    }
+}
+
+// Y (rows x k, row stride k) = A * X (X row stride ldx), Y zeroed by
+// the caller
+void multiply_into(const SparseMatrix& a, const double* x, size_t ldx, size_t k,
+                   double* y, size_t threads) {
+    const size_t* outer = a.outer_index().data();
+    const size_t* inner = a.inner_index().data();
+    const double* vals = a.values().data();
+    size_t work = a.nonZeros() * k;
+    if (threads == 0) {
+        threads = parallel::num_threads();
+    }
+
+    if (a.format() == Format::CSR) {
+        // one piece per thread, each owns a disjoint set of output rows
+        size_t parts = std::max<size_t>(1, std::min(threads, work / SparseMatrix::PARALLEL_MIN_WORK));
+        std::vector<size_t> bounds = a.partition(parts);
+        parallel::for_range(parts, 1, [&](size_t begin, size_t end) {
+            for (size_t r = bounds[begin]; r < bounds[end]; r++) {
+                double* out = y + r * k;
+                for (size_t p = outer[r]; p < outer[r + 1]; p++) {
+                    axpy(out, x + inner[p] * ldx, vals[p], k);
+                }
+            }
+        }, parts);
+        return;
+    }
+
+    // CSC scatters column j of A into every row it touches, so the only
+    // safe split is over the columns of X
+    size_t min_cols = std::max<size_t>(1, (SparseMatrix::PARALLEL_MIN_WORK * k + work - 1) / std::max<size_t>(work, 1));
+    parallel::for_range(k, min_cols, [&](size_t c0, size_t c1) {
+        for (size_t j = 0; j < a.cols(); j++) {
+            const double* xj = x + j * ldx + c0;
+            for (size_t p = outer[j]; p < outer[j + 1]; p++) {
+                axpy(y + inner[p] * k + c0, xj, vals[p], c1 - c0);
+            }
+        }
+    }, threads);
+}
+
+}
+
+/* ======= constructors ======= */
+
+SparseMatrix::SparseMatrix() : SparseMatrix(0, 0) {}
+
+SparseMatrix::SparseMatrix(size_t rows, size_t cols)
+    : num_rows(rows), num_cols(cols), fmt(Format::CSR), outer(rows + 1, 0) {}
+
+SparseMatrix::SparseMatrix(size_t rows, size_t cols, const std::vector<Triplet>& triplets, Format format)
+    : num_rows(rows), num_cols(cols), fmt(format) {
+    std::vector<size_t> o, in;
+    std::vector<double> v;
+    o.reserve(triplets.size());
+    in.reserve(triplets.size());
+    v.reserve(triplets.size());
+    for (const Triplet& t : triplets) {
+        if (t.row >= rows || t.col >= cols) {
+            throw std::out_of_range("triplet index out of range");
+        }
+        o.push_back(format == Format::CSR ? t.row : t.col);
+        in.push_back(format == Format::CSR ? t.col : t.row);
+        v.push_back(t.value);
+    }
+    compress(outer_dim(), o, in, v, outer, inner, vals);
+}
+
+SparseMatrix::SparseMatrix(ConstMatrixView dense, Format format, double drop)
+    : num_rows(dense.rows()), num_cols(dense.cols()), fmt(Format::CSR), outer(dense.rows() + 1, 0) {
+    for (size_t r = 0; r < num_rows; r++) {
+        for (size_t c = 0; c < num_cols; c++) {
+            double x = dense(r, c);
+            if (std::fabs(x) > drop) {
+                inner.push_back(c);
+                vals.push_back(x);
+            }
+        }
+        outer[r + 1] = inner.size();
+    }
+    if (format == Format::CSC) {
+        *this = convert();
+    }
+}
+
+/* ======= conversions ======= */
+
+Matrix SparseMatrix::to_dense() const {
+    Matrix res(num_rows, num_cols);
+    for (size_t i = 0; i < outer_dim(); i++) {
+        for (size_t p = outer[i]; p < outer[i + 1]; p++) {
+            if (fmt == Format::CSR) {
+                res(i, inner[p]) = vals[p];
+            } else {
+                res(inner[p], i) = vals[p];
+            }
+        }
+    }
+    return res;
+}
+
+SparseMatrix SparseMatrix::convert() const {
+    std::vector<size_t> o(inner), in(inner.size());
+    for (size_t i = 0; i < outer_dim(); i++) {
+        for (size_t p = outer[i]; p < outer[i + 1]; p++) {
+            in[p] = i;
+        }
+    }
+    SparseMatrix res(num_rows, num_cols);
+    res.fmt = fmt == Format::CSR ? Format::CSC : Format::CSR;
+    compress(res.outer_dim(), o, in, vals, res.outer, res.inner, res.vals);
+    return res;
+}
+
+SparseMatrix SparseMatrix::to_csr() const {
+    return fmt == Format::CSR ? *this : convert();
+}
+
+SparseMatrix SparseMatrix::to_csc() const {
+    return fmt == Format::CSC ? *this : convert();
+}
+
+std::vector<SparseMatrix::Triplet> SparseMatrix::triplets() const {
+    if (fmt == Format::CSC) {
+        return convert().triplets();
+    }
+    std::vector<Triplet> res;
+    res.reserve(vals.size());
+    for (size_t r = 0; r < num_rows; r++) {
+        for (size_t p = outer[r]; p < outer[r + 1]; p++) {
+            res.push_back({r, inner[p], vals[p]});
+        }
+    }
+    return res;
+}
+
+SparseMatrix SparseMatrix::transpose() const {
+    SparseMatrix res(*this);
+    std::swap(res.num_rows, res.num_cols);
+    res.fmt = fmt == Format::CSR ? Format::CSC : Format::CSR;
+    return res;
+}
+
+/* ======= accessors ======= */
+
+size_t SparseMatrix::rows() const { return num_rows; }
+size_t SparseMatrix::cols() const { return num_cols; }
+size_t SparseMatrix::nonZeros() const { return vals.size(); }
+SparseMatrix::Format SparseMatrix::format() const { return fmt; }
+bool SparseMatrix::isEmpty() const { return num_rows == 0 || num_cols == 0; }
+
+const std::vector<size_t>& SparseMatrix::outer_index() const { return outer; }
+const std::vector<size_t>& SparseMatrix::inner_index() const { return inner; }
+const std::vector<double>& SparseMatrix::values() const { return vals; }
+
+double SparseMatrix::at(size_t row, size_t col) const {
+    if (row >= num_rows || col >= num_cols) {
+        throw std::out_of_range("index out of range");
+    }
+    size_t o = fmt == Format::CSR ? row : col;
+    size_t i = fmt == Format::CSR ? col : row;
+    auto begin = inner.begin() + outer[o], end = inner.begin() + outer[o + 1];
+    auto it = std::lower_bound(begin, end, i);
+    return it != end && *it == i ? vals[it - inner.begin()] : 0.0;
+}
+
+std::vector<size_t> SparseMatrix::partition(size_t parts) const {
+    if (parts == 0) {
+        throw std::invalid_argument("need at least one part");
+    }
+    size_t n = outer_dim();
+    std::vector<size_t> bounds(parts + 1, n);
+    bounds[0] = 0;
+    for (size_t p = 1; p < parts; p++) {
+        // first row starting at or after this parts share of the non-zeros
+        size_t target = nonZeros() * p / parts;
+        bounds[p] = std::lower_bound(outer.begin(), outer.begin() + n, target) - outer.begin();
+    }
+    return bounds;
+}
+
+/* ======= products ======= */
+
+std::vector<double> SparseMatrix::multiply(const std::vector<double>& x, size_t threads) const {
+    if (x.size() != num_cols) {
+        throw std::invalid_argument("vector size doesnt match the matrix");
+    }
+    std::vector<double> y(num_rows, 0.0);
+    multiply_into(*this, x.data(), 1, 1, y.data(), threads);
+    return y;
+}
+
+Matrix SparseMatrix::multiply(ConstMatrixView x, size_t threads) const {
+    if (x.rows() != num_cols) {
+        throw std::invalid_argument("matrix dimensions dont match for multiplication");
+    }
+    Matrix y(num_rows, x.cols());
+    if (x.cols() == 1 || x.stride() == x.cols()) {
+        multiply_into(*this, x.data(), x.stride(), x.cols(), y.view().data(), threads);
+    } else {
+        // the kernel wants whole contiguous rows of X, a column or block
+        // of a wider matrix gets packed first
+        Matrix packed(x);
+        multiply_into(*this, packed.view().data(), packed.cols(), packed.cols(), y.view().data(), threads);
+    }
+    return y;
+}
+
+std::vector<double> SparseMatrix::operator*(const std::vector<double>& x) const {
+    return multiply(x);
+}
+
+Matrix SparseMatrix::operator*(ConstMatrixView x) const {
+    return multiply(x);
+}
+
+SparseMatrix SparseMatrix::operator*(double scalar) const {
+    SparseMatrix res(*this);
+    for (double& v : res.vals) {
+        v *= scalar;
+    }
+    return res;
+}
+
+bool SparseMatrix::operator==(const SparseMatrix& other) const {
+    if (num_rows != other.num_rows || num_cols != other.num_cols) {
+        return false;
+    }
+    if (other.fmt != fmt) {
+        return *this == other.convert();
+    }
+    // walk both segments together, an entry missing on one side counts as 0
+    for (size_t i = 0; i < outer_dim(); i++) {
+        size_t p = outer[i], q = other.outer[i];
+        while (p < outer[i + 1] || q < other.outer[i + 1]) {
+            double a = 0.0, b = 0.0;
+            if (q == other.outer[i + 1] || (p < outer[i + 1] && inner[p] < other.inner[q])) {
+                a = vals[p++];
+            } else if (p == outer[i + 1] || other.inner[q] < inner[p]) {
+                b = other.vals[q++];
+            } else {
+                a = vals[p++];
+                b = other.vals[q++];
+            }
+            if (std::fabs(a - b) > EPSILON) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool SparseMatrix::operator!=(const SparseMatrix& other) const {
+    return !(*this == other);
+}
@@ -0,0 +1,115 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <cstddef>
+#include <vector>
+#include "matrix.h"
+
+// Compressed sparse matrix, only the non-zeros are stored.
+//
+// CSR keeps the entries row by row: outer_index() has rows() + 1
+// offsets, and the entries of row r are inner_index()[k] (the column)
+// and values()[k] for k in [outer_index()[r], outer_index()[r + 1]).
+// CSC is the same with rows and columns swapped. Within a row (column)
+// the entries are sorted and there are no duplicates.
+//
+// Products against dense matrices are row partitioned: the rows are
+// cut into one piece per thread with about the same number of
+// non-zeros each, so a few heavy rows dont leave the other threads
+// idle. A CSC matrix can only be split along the columns of the dense
+// side, so CSC * vector runs on one thread, convert with to_csr() first
+// if that matters.
+class SparseMatrix {
+
+public:
+
+    enum class Format { CSR, CSC };
+
+    struct Triplet {
+        size_t row;
+        size_t col;
+        double value;
+    };
+
+    // below this many multiply-adds per thread products stay serial
+    static constexpr size_t PARALLEL_MIN_WORK = 1 << 15;
+
+    // constructors
+    SparseMatrix();                          // empty 0x0
+    SparseMatrix(size_t rows, size_t cols);  // all zero CSR
+
+    // from (row, col, value) triplets in any order, duplicates get
+    // summed. throws std::out_of_range on an index outside the matrix
+    SparseMatrix(size_t rows, size_t cols, const std::vector<Triplet>& triplets,
+                 Format format = Format::CSR);
+
+    // from a dense matrix, keeping the entries with |x| > drop
+    explicit SparseMatrix(ConstMatrixView dense, Format format = Format::CSR, double drop = 0.0);
+
+    // conversions
+    Matrix to_dense() const;
+    SparseMatrix to_csr() const;  // returns a copy if its already CSR
+    SparseMatrix to_csc() const;
+    std::vector<Triplet> triplets() const;  // row major order
+
+    // the CSR arrays of A are the CSC arrays of A^T, so this is just a
+    // copy that reads them the other way. to_csr() on the result to get
+    // a CSR transpose
+    SparseMatrix transpose() const;
+
+    size_t rows() const;
+    size_t cols() const;
+    size_t nonZeros() const;
+    Format format() const;
+    bool isEmpty() const;
+
+    // element lookup with a binary search, 0 for entries that arent
+    // stored. throws std::out_of_range if out of bounds
+    double at(size_t row, size_t col) const;
+
+    // raw storage, see the top of the file
+    const std::vector<size_t>& outer_index() const;
+    const std::vector<size_t>& inner_index() const;
+    const std::vector<double>& values() const;
+
+    // row boundaries for splitting a CSR matrix into `parts` pieces with
+    // about the same number of non-zeros. parts + 1 entries, starts at 0
+    // and ends at rows(). (for CSC this splits the columns)
+    std::vector<size_t> partition(size_t parts) const;
+
+    // SpMV, y = A * x. throws std::invalid_argument on a size mismatch
+    std::vector<double> multiply(const std::vector<double>& x, size_t threads = 0) const;
+
+    // SpMM, Y = A * X for a dense X (a Matrix, or any view of one)
+    Matrix multiply(ConstMatrixView x, size_t threads = 0) const;
+
+    std::vector<double> operator*(const std::vector<double>& x) const;
+    Matrix operator*(ConstMatrixView x) const;
+
+    SparseMatrix operator*(double scalar) const;
+    friend SparseMatrix operator*(double scalar, const SparseMatrix& m) { return m * scalar; }
+
+    // same shape and the same entries, whatever the format. like Matrix
+    // this compares with an EPSILON tolerance
+    bool operator==(const SparseMatrix& other) const;
+    bool operator!=(const SparseMatrix& other) const;
+
+private:
+
+    size_t num_rows;
+    size_t num_cols;
+    Format fmt;
+    std::vector<size_t> outer;   // outer_dim() + 1 offsets
+    std::vector<size_t> inner;   // column (CSR) or row (CSC) of each entry
+    std::vector<double> vals;
+    static constexpr double EPSILON = 1e-6;
+
+    size_t outer_dim() const { return fmt == Format::CSR ? num_rows : num_cols; }
+    size_t inner_dim() const { return fmt == Format::CSR ? num_cols : num_rows; }
+
+    // the other format, same matrix
+    SparseMatrix convert() const;
+
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "strassen.h"
+#include "gemm.h"
+#include "simd.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+namespace strassen {
+
+namespace {
+
+constexpr size_t MIN_CUTOFF = 16;
+
+std::atomic<size_t> global_cutoff(DEFAULT_CUTOFF);
+
+size_t resolve(size_t cutoff) {
+    return cutoff != 0 ? cutoff : global_cutoff.load();
+}
+
+// how many times to halve before the smallest dimension is at or below
+// the cutoff
+size_t levels_for(size_t m, size_t n, size_t k, size_t cutoff) {
+    size_t s = std::min({m, n, k});
+    size_t levels = 0;
+    while (s > cutoff) {
+        s = (s + 1) / 2;
+        levels++;
+    }
+    return levels;
+}
+
+// x rounded up so it halves evenly `levels` times
+size_t padded(size_t x, size_t levels) {
+    size_t q = size_t(1) << levels;
+    return (x + q - 1) / q * q;
+}
+
+// the two temporaries of every level, X and Y
+size_t recursion_size(size_t m, size_t n, size_t k, size_t levels) {
+    size_t total = 0;
+    for (; levels > 0; levels--) {
+        m /= 2;
+        n /= 2;
+        k /= 2;
+        total += m * std::max(n, k) + k * n;
+    }
+    return total;
+}
+
+template <typename T>
+void add_blocks(size_t rows, size_t cols, const T* a, size_t lda, const T* b, size_t ldb, T* out, size_t ldo) {
+    for (size_t r = 0; r < rows; r++) {
+        simd::add(a + r * lda, b + r * ldb, out + r * ldo, cols);
+    }
+}
+
+template <typename T>
+void sub_blocks(size_t rows, size_t cols, const T* a, size_t lda, const T* b, size_t ldb, T* out, size_t ldo) {
+    for (size_t r = 0; r < rows; r++) {
+        simd::sub(a + r * lda, b + r * ldb, out + r * ldo, cols);
+    }
+}
+
+// m, n, k all halve evenly `levels` times. scratch has recursion_size
+// room, this level takes X and Y off the front and hands the rest down
+template <typename T>
+void recurse(size_t m, size_t n, size_t k,
+             const T* A, size_t lda, const T* B, size_t ldb, T* C, size_t ldc,
+             size_t levels, size_t threads, T* scratch) {
+    if (levels == 0) {
+        gemm::multiply(m, n, k, T(1), A, lda, B, ldb, T(0), C, ldc, threads);
+        return;
+    }
+    size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+    const T* A11 = A;
+    const T* A12 = A + k2;
+    const T* A21 = A + m2 * lda;
+    const T* A22 = A21 + k2;
+    const T* B11 = B;
+    const T* B12 = B + n2;
+    const T* B21 = B + k2 * ldb;
+    const T* B22 = B21 + n2;
+    T* C11 = C;
+    T* C12 = C + n2;
+    T* C21 = C + m2 * ldc;
+    T* C22 = C21 + n2;
+
+    // X is m2 x k2 for the S sums and m2 x n2 for P1, Y is k2 x n2
+    size_t ldx = std::max(n2, k2), ldy = n2;
+    T* X = scratch;
+    T* Y = X + m2 * ldx;
+    T* rest = Y + k2 * ldy;
+    auto product = [&](const T* a, size_t la, const T* b, size_t lb, T* c, size_t lc) {
+        recurse(m2, n2, k2, a, la, b, lb, c, lc, levels - 1, threads, rest);
+    };
+
+    sub_blocks(m2, k2, A11, lda, A21, lda, X, ldx);   // S3 = A11 - A21
+    sub_blocks(k2, n2, B22, ldb, B12, ldb, Y, ldy);   // T3 = B22 - B12
+    product(X, ldx, Y, ldy, C21, ldc);                // P7 = S3 T3
+    add_blocks(m2, k2, A21, lda, A22, lda, X, ldx);   // S1 = A21 + A22
+    sub_blocks(k2, n2, B12, ldb, B11, ldb, Y, ldy);   // T1 = B12 - B11
+    product(X, ldx, Y, ldy, C22, ldc);                // P5 = S1 T1
+    sub_blocks(m2, k2, X, ldx, A11, lda, X, ldx);     // S2 = S1 - A11
+    sub_blocks(k2, n2, B22, ldb, Y, ldy, Y, ldy);     // T2 = B22 - T1
+    product(X, ldx, Y, ldy, C12, ldc);                // P6 = S2 T2
+    sub_blocks(m2, k2, A12, lda, X, ldx, X, ldx);     // S4 = A12 - S2
+    product(X, ldx, B22, ldb, C11, ldc);              // P3 = S4 B22
+    product(A11, lda, B11, ldb, X, ldx);              // P1 = A11 B11, X is m2 x n2 now
+    add_blocks(m2, n2, X, ldx, C12, ldc, C12, ldc);   // U2 = P1 + P6
+    add_blocks(m2, n2, C12, ldc, C21, ldc, C21, ldc); // U3 = U2 + P7
+    add_blocks(m2, n2, C12, ldc, C22, ldc, C12, ldc); // U4 = U2 + P5
+    add_blocks(m2, n2, C21, ldc, C22, ldc, C22, ldc); // U7 = U3 + P5 = C22
+    add_blocks(m2, n2, C12, ldc, C11, ldc, C12, ldc); // U5 = U4 + P3 = C12
+    sub_blocks(k2, n2, Y, ldy, B21, ldb, Y, ldy);     // T4 = T2 - B21
+    product(A22, lda, Y, ldy, C11, ldc);              // P4 = A22 T4
+    sub_blocks(m2, n2, C21, ldc, C11, ldc, C21, ldc); // U6 = U3 - P4 = C21
+    product(A12, lda, B21, ldb, C11, ldc);            // P2 = A12 B21
+    add_blocks(m2, n2, X, ldx, C11, ldc, C11, ldc);   // U1 = P1 + P2 = C11
+}
+
+// copy a rows x cols block into a zeroed rows_p x cols_p one
+template <typename T>
+void pad_copy(size_t rows, size_t cols, const T* src, size_t ld, size_t rows_p, size_t cols_p, T* dst) {
+    std::fill(dst, dst + rows_p * cols_p, T(0));
+    for (size_t r = 0; r < rows; r++) {
+        std::copy(src + r * ld, src + r * ld + cols, dst + r * cols_p);
+    }
+}
+
+}
+
+size_t cutoff() {
+    return global_cutoff.load();
+}
+
+void set_cutoff(size_t n) {
+    if (n < MIN_CUTOFF) {
+        throw std::invalid_argument("strassen cutoff too small");
+    }
+    global_cutoff = n;
+}
+
+/* ======= Workspace ======= */
+
+template <typename T>
+size_t Workspace<T>::required(size_t m, size_t n, size_t k, size_t cutoff) {
+    size_t levels = levels_for(m, n, k, resolve(cutoff));
+    size_t mp = padded(m, levels), np = padded(n, levels), kp = padded(k, levels);
+    size_t total = recursion_size(mp, np, kp, levels);
+    if (mp != m || np != n || kp != k) {
+        total += mp * kp + kp * np + mp * np;
+    }
+    return total;
+}
+
+template <typename T>
+void Workspace<T>::reserve(size_t m, size_t n, size_t k, size_t cutoff) {
+    size_t size = required(m, n, k, cutoff);
+    if (size > buffer.size()) {
+        // nothing in there worth keeping, dont copy it over
+        buffer = std::vector<T, MatrixAllocator<T>>(size);
+    }
+}
+
+/* ======= multiply ======= */
+
+template <typename T>
+void multiply(size_t m, size_t n, size_t k,
+              const T* A, size_t lda, const T* B, size_t ldb,
+              T* C, size_t ldc,
+              size_t cutoff, size_t threads, Workspace<T>* workspace) {
+    cutoff = resolve(cutoff);
+    if (cutoff < MIN_CUTOFF) {
+        throw std::invalid_argument("strassen cutoff too small");
+    }
+    size_t levels = levels_for(m, n, k, cutoff);
+    if (levels == 0) {
+        gemm::multiply(m, n, k, T(1), A, lda, B, ldb, T(0), C, ldc, threads);
+        return;
+    }
+
+    Workspace<T> local;
+    if (!workspace) {
+        workspace = &local;
+    }
+    workspace->reserve(m, n, k, cutoff);
+    T* scratch = workspace->data();
+
+    size_t mp = padded(m, levels), np = padded(n, levels), kp = padded(k, levels);
+    if (mp == m && np == n && kp == k) {
+        recurse(m, n, k, A, lda, B, ldb, C, ldc, levels, threads, scratch);
+        return;
+    }
+    T* Ap = scratch;
+    T* Bp = Ap + mp * kp;
+    T* Cp = Bp + kp * np;
+    pad_copy(m, k, A, lda, mp, kp, Ap);
+    pad_copy(k, n, B, ldb, kp, np, Bp);
+    recurse(mp, np, kp, Ap, kp, Bp, np, Cp, np, levels, threads, Cp + mp * np);
+    for (size_t r = 0; r < m; r++) {
+        std::copy(Cp + r * np, Cp + r * np + n, C + r * ldc);
+    }
+}
+
+template <typename T>
+BasicMatrix<T> multiply(BasicMatrixView<const T> lhs, BasicMatrixView<const T> rhs,
+                        size_t cutoff, size_t threads) {
+    if (lhs.cols() != rhs.rows()) {
+        throw std::invalid_argument("matrix dimensions dont work for multiply");
+    }
+    BasicMatrix<T> res(lhs.rows(), rhs.cols());
+    multiply(lhs.rows(), rhs.cols(), lhs.cols(),
+             lhs.data(), lhs.stride(), rhs.data(), rhs.stride(),
+             res.view().data(), res.cols(), cutoff, threads);
+    return res;
+}
+
+template class Workspace<float>;
+template class Workspace<double>;
+
+template void multiply(size_t, size_t, size_t, const float*, size_t, const float*, size_t,
+                       float*, size_t, size_t, size_t, Workspace<float>*);
+template void multiply(size_t, size_t, size_t, const double*, size_t, const double*, size_t,
+                       double*, size_t, size_t, size_t, Workspace<double>*);
+template FloatMatrix multiply(BasicMatrixView<const float>, BasicMatrixView<const float>, size_t, size_t);
+template Matrix multiply(BasicMatrixView<const double>, BasicMatrixView<const double>, size_t, size_t);
+
+}
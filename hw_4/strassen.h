@@ -0,0 +1,97 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <cstddef>
+#include <vector>
+#include "matrix.h"
+#include "matrix_allocator.h"
+
+// Strassen-Winograd product for big matrices, C = A * B.
+//
+// Each level splits A, B and C into 2x2 blocks and gets the product
+// from 7 half size products and 15 block additions instead of 8
+// products, so every level saves 1/8 of the flops. Below the cutoff the
+// halves go to the blocked gemm::multiply, which is where all the time
+// is spent anyway (and where the threads are used).
+//
+// The operation order is the one from Boyer, Dumas, Pernet and Zhou
+// ("Memory efficient scheduling of Strassen-Winograd's matrix
+// multiplication algorithm"): the quadrants of C double as scratch, so a
+// level only needs two temporaries, (m/2 x max(n, k)/2) and (k/2 x n/2).
+// All of it comes out of one Workspace, nothing is allocated during the
+// recursion. If m, n, k dont halve evenly down to the cutoff the inputs
+// get copied into zero padded buffers (also in the workspace) first.
+//
+// Accuracy: it is not as accurate as the classical product. Each level
+// roughly doubles to triples the error (the sums before the products mix
+// entries of very different size), and the bound is only normwise, not
+// per element like the classical one. Measured on this machine with
+// uniform [-1, 1) doubles, max |C - exact| / n over 16 rows against a
+// long double reference:
+//
+//     n      cutoff  levels  strassen   classical  time vs classical
+//     2048   1024    1       5.4e-17    2.0e-17    0.92
+//     2048   512     2       3.0e-16    2.0e-17    0.81
+//     2048   128     4       9.9e-16    2.0e-17    0.69
+//     4096   1024    2       1.2e-16    1.5e-17    0.71
+//     4096   512     3       3.4e-16    1.5e-17    0.58
+//     4096   256     4       1.1e-15    1.5e-17    0.53
+//
+// so 1-2 decimal digits lost at the default cutoff. fine for most
+// things, but not what Matrix::operator* should do by default, so it
+// is opt in. float loses the same digits out of far fewer, be careful.
+namespace strassen {
+
+    // stop recursing once the smallest dimension is at or below this.
+    // what is best depends on where the blocked gemm tops out, run the
+    // BM_Strassen benchmarks with a few values to tune a machine
+    constexpr size_t DEFAULT_CUTOFF = 512;
+
+    // the cutoff used when none is passed. throws std::invalid_argument
+    // for cutoffs below 16, smaller than that is always slower
+    size_t cutoff();
+    void set_cutoff(size_t n);
+
+    // preallocated scratch memory for multiply. reuse one across calls
+    // of the same (or smaller) size and nothing gets allocated
+    template <typename T>
+    class Workspace {
+
+    public:
+
+        Workspace() = default;
+        Workspace(size_t m, size_t n, size_t k, size_t cutoff = 0) { reserve(m, n, k, cutoff); }
+
+        // number of T an m x n x k product needs, including padding
+        static size_t required(size_t m, size_t n, size_t k, size_t cutoff = 0);
+
+        // grow to fit an m x n x k product, never shrinks
+        void reserve(size_t m, size_t n, size_t k, size_t cutoff = 0);
+
+        size_t capacity() const { return buffer.size(); }
+        T* data() { return buffer.data(); }
+
+    private:
+
+        std::vector<T, MatrixAllocator<T>> buffer;
+
+    };
+
+    // C = A * B, A m x k, B k x n, row strides lda/ldb/ldc. C isnt read.
+    // cutoff 0 means cutoff(), threads 0 means parallel::num_threads().
+    // without a workspace one gets allocated for the call
+    template <typename T>
+    void multiply(size_t m, size_t n, size_t k,
+                  const T* A, size_t lda, const T* B, size_t ldb,
+                  T* C, size_t ldc,
+                  size_t cutoff = 0, size_t threads = 0, Workspace<T>* workspace = nullptr);
+
+    // same on matrices and views, throws std::invalid_argument if the
+    // inner dimensions dont match
+    template <typename T>
+    BasicMatrix<T> multiply(BasicMatrixView<const T> lhs, BasicMatrixView<const T> rhs,
+                            size_t cutoff = 0, size_t threads = 0);
+
+}
+
+#endif
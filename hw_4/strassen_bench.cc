@@ -0,0 +1,43 @@
+#include "strassen.h"
+#include "gemm.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+    // classical 2*n^3 flops, so the rates line up with BM_GemmBlocked
+    // even though strassen does fewer
+    void set_flops(benchmark::State& state, size_t n) {
+        state.counters["GFLOP/s"] = benchmark::Counter(
+            2.0 * n * n * n, benchmark::Counter::kIsIterationInvariantRate,
+            benchmark::Counter::kIs1000);
+    }
+
+    // args are n and the cutoff, run a few cutoffs per size to tune
+    void BM_Strassen(benchmark::State& state) {
+        size_t n = state.range(0), cutoff = state.range(1);
+        Matrix A(n, n, 1.5), B(n, n, 0.5), C(n, n);
+        strassen::Workspace<double> ws(n, n, n, cutoff);
+        for (auto _ : state) {
+            strassen::multiply(n, n, n, &A(0, 0), n, &B(0, 0), n, &C(0, 0), n, cutoff, 0, &ws);
+            benchmark::DoNotOptimize(&C(0, 0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK(BM_Strassen)->ArgsProduct({{1024, 2048, 4096}, {256, 512, 1024}})
+        ->Unit(benchmark::kMillisecond);
+
+    void BM_StrassenClassical(benchmark::State& state) {
+        size_t n = state.range(0);
+        Matrix A(n, n, 1.5), B(n, n, 0.5), C(n, n);
+        for (auto _ : state) {
+            gemm::multiply(n, n, n, 1.0, &A(0, 0), n, &B(0, 0), n, 0.0, &C(0, 0), n);
+            benchmark::DoNotOptimize(&C(0, 0));
+            benchmark::ClobberMemory();
+        }
+        set_flops(state, n);
+    }
+    BENCHMARK(BM_StrassenClassical)->Arg(1024)->Arg(2048)->Arg(4096)
+        ->Unit(benchmark::kMillisecond);
+
+}
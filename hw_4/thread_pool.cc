@@ -0,0 +1,184 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace {
+
+// set while a thread is running pool work, so nested calls go serial
+thread_local bool in_worker = false;
+
+}
+
+ThreadPool::ThreadPool(size_t num_workers) : stopping(false) {
+    reserve(num_workers);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return workers.size();
+}
+
+void ThreadPool::reserve(size_t num_workers) {
+    std::lock_guard<std::mutex> lock(mtx);
+    while (workers.size() < num_workers) {
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+void ThreadPool::worker_loop() {
+    in_worker = true;
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallel_for(size_t n, size_t num_chunks,
+                              const std::function<void(size_t, size_t)>& fn) {
+    num_chunks = std::min(num_chunks, n);
+    if (num_chunks <= 1 || in_worker) {
+        if (n > 0) {
+            fn(0, n);
+        }
+        return;
+    }
+
+    // bookkeeping shared between the caller and the queued chunks
+    struct Group {
+        std::mutex mtx;
+        std::condition_variable done;
+        size_t remaining;
+        std::exception_ptr error;
+    };
+    auto group = std::make_shared<Group>();
+    group->remaining = num_chunks - 1;
+
+    auto run_chunk = [group, &fn](size_t begin, size_t end) {
+        std::exception_ptr err;
+        try {
+            fn(begin, end);
+        } catch (...) {
+            err = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(group->mtx);
+        if (err && !group->error) {
+            group->error = err;
+        }
+        if (--group->remaining == 0) {
+            group->done.notify_one();
+        }
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t c = 1; c < num_chunks; c++) {
+            size_t begin = n * c / num_chunks, end = n * (c + 1) / num_chunks;
+            tasks.push([run_chunk, begin, end] { run_chunk(begin, end); });
+        }
+    }
+    cv.notify_all();
+
+    // first chunk on this thread while the workers do the rest
+    std::exception_ptr err;
+    try {
+        fn(0, n / num_chunks);
+    } catch (...) {
+        err = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> lock(group->mtx);
+    group->done.wait(lock, [&group] { return group->remaining == 0; });
+    if (err) {
+        std::rethrow_exception(err);
+    }
+    if (group->error) {
+        std::rethrow_exception(group->error);
+    }
+}
+
+namespace parallel {
+
+namespace {
+
+std::atomic<size_t> global_threads(0);
+thread_local size_t scoped_threads = 0;
+
+// asked once, hardware_concurrency is a syscall and this gets hit by
+// every elementwise op, even the tiny ones that never go parallel
+size_t hardware_threads() {
+    static const size_t n = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    return n;
+}
+
+}
+
+void set_num_threads(size_t n) {
+    global_threads = n;
+}
+
+size_t num_threads() {
+    if (scoped_threads != 0) {
+        return scoped_threads;
+    }
+    size_t n = global_threads.load();
+    return n != 0 ? n : hardware_threads();
+}
+
+ScopedThreads::ScopedThreads(size_t n) : previous(scoped_threads) {
+    scoped_threads = n;
+}
+
+ScopedThreads::~ScopedThreads() {
+    scoped_threads = previous;
+}
+
+ThreadPool& pool(size_t threads) {
+    // the caller always does one chunk itself, so threads - 1 workers
+    static ThreadPool shared(0);
+    if (threads > 1) {
+        shared.reserve(threads - 1);
+    }
+    return shared;
+}
+
+void for_range(size_t n, size_t min_work,
+               const std::function<void(size_t, size_t)>& fn,
+               size_t threads) {
+    if (threads == 0) {
+        threads = num_threads();
+    }
+    if (min_work > 0) {
+        threads = std::min(threads, n / min_work);
+    }
+    if (threads <= 1 || in_worker) {
+        if (n > 0) {
+            fn(0, n);
+        }
+        return;
+    }
+    pool(threads).parallel_for(n, threads, fn);
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that get reused for every parallel call,
+// so Matrix ops dont pay for spawning threads each time.
+class ThreadPool {
+
+public:
+
+    explicit ThreadPool(size_t num_workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const;
+
+    // add workers until there are at least num_workers of them
+    void reserve(size_t num_workers);
+
+    // split [0, n) into num_chunks contiguous pieces and run
+    // fn(begin, end) on each. the calling thread does one piece itself
+    // and blocks until all of them are done. if any piece throws, the
+    // first exception is rethrown here. called from inside a worker it
+    // just runs everything inline, since waiting on the queue from a
+    // worker could deadlock.
+    void parallel_for(size_t n, size_t num_chunks,
+                      const std::function<void(size_t, size_t)>& fn);
+
+private:
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping;
+
+    void worker_loop();
+
+};
+
+// Global thread count settings used by the Matrix kernels.
+namespace parallel {
+
+    // set the default thread count for every Matrix op. 0 means use
+    // std::thread::hardware_concurrency()
+    void set_num_threads(size_t n);
+
+    // thread count the next op on this thread will use
+    size_t num_threads();
+
+    // override the thread count for ops on the current thread until
+    // this goes out of scope, i.e. a per call setting:
+    //
+    //     { parallel::ScopedThreads t(4); C = A * B; }
+    class ScopedThreads {
+    public:
+        explicit ScopedThreads(size_t n);
+        ~ScopedThreads();
+    private:
+        size_t previous;
+    };
+
+    // the shared pool, grown on demand to fit the largest thread count asked for
+    ThreadPool& pool(size_t threads);
+
+    // run fn(begin, end) over [0, n) on up to `threads` threads (0 means
+    // num_threads()). it stays on the calling thread when the work is
+    // under min_work items per thread, or when we are already inside a
+    // pool worker, so small matrices dont pay the dispatch cost.
+    void for_range(size_t n, size_t min_work,
+                   const std::function<void(size_t, size_t)>& fn,
+                   size_t threads = 0);
+
+    // below this many elements per thread elementwise ops stay serial
+    constexpr size_t ELEMENTWISE_GRAIN = 1 << 15;
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <cstddef>
+#include <utility>
+
+// Cache-oblivious transpose kernels on raw row-major buffers.
+//
+// The naive loop reads rows and writes columns, so once a column of the
+// output spans more pages than the TLB / more lines than L1 holds,
+// every write misses. Here the larger dimension keeps getting halved
+// until the block is BLOCK x BLOCK or smaller, then that block is done
+// with the plain loop. Source rows and destination rows of such a
+// block both stay in cache, whatever the cache sizes happen to be.
+//
+// lds / ldd are the row strides of src / dst, so these also work on
+// sub-blocks. Templated so the same kernel works for any element type.
+namespace transposition {
+
+    constexpr size_t BLOCK = 32;
+
+    // dst (cols x rows) = transpose of src (rows x cols)
+    template <typename T>
+    void out_of_place(const T* src, size_t rows, size_t cols, size_t lds,
+                      T* dst, size_t ldd) {
+        if (rows <= BLOCK && cols <= BLOCK) {
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t c = 0; c < cols; c++) {
+                    dst[c * ldd + r] = src[r * lds + c];
+                }
+            }
+        } else if (rows >= cols) {
+            size_t half = rows / 2;
+            out_of_place(src, half, cols, lds, dst, ldd);
+            out_of_place(src + half * lds, rows - half, cols, lds, dst + half, ldd);
+        } else {
+            size_t half = cols / 2;
+            out_of_place(src, rows, half, lds, dst, ldd);
+            out_of_place(src + half, rows, cols - half, lds, dst + half * ldd, ldd);
+        }
+    }
+
+    // swap a (rows x cols) with the transpose of b (cols x rows), used
+    // for the off-diagonal blocks of the in-place version
+    template <typename T>
+    void swap_transposed(T* a, T* b, size_t rows, size_t cols, size_t ld) {
+        if (rows <= BLOCK && cols <= BLOCK) {
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t c = 0; c < cols; c++) {
+                    std::swap(a[r * ld + c], b[c * ld + r]);
+                }
+            }
+        } else if (rows >= cols) {
+            size_t half = rows / 2;
+            swap_transposed(a, b, half, cols, ld);
+            swap_transposed(a + half * ld, b + half, rows - half, cols, ld);
+        } else {
+            size_t half = cols / 2;
+            swap_transposed(a, b, rows, half, ld);
+            swap_transposed(a + half, b + half * ld, rows, cols - half, ld);
+        }
+    }
+
+    // transpose the n x n block at a in place
+    template <typename T>
+    void in_place(T* a, size_t n, size_t ld) {
+        if (n <= BLOCK) {
+            for (size_t r = 0; r < n; r++) {
+                for (size_t c = r + 1; c < n; c++) {
+                    std::swap(a[r * ld + c], a[c * ld + r]);
+                }
+            }
+            return;
+        }
+        // [A B; C D] -> [A' C'; B' D']
+        size_t half = n / 2;
+        in_place(a, half, ld);
+        in_place(a + half * ld + half, n - half, ld);
+        swap_transposed(a + half, a + half * ld, half, n - half, ld);
+    }
+
+    // the plain double loop, for comparison in the benchmarks
+    template <typename T>
+    void naive(const T* src, size_t rows, size_t cols, size_t lds,
+               T* dst, size_t ldd) {
+        for (size_t r = 0; r < rows; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                dst[c * ldd + r] = src[r * lds + c];
+            }
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+#include "transpose.h"
+#include "benchmark/benchmark.h"
+#include <vector>
+
+namespace {
+
+    // shapes: square, tall-skinny and short-wide, all 2^22 doubles (32MB)
+    void shapes(benchmark::internal::Benchmark* b) {
+        b->Args({2048, 2048});
+        b->Args({1 << 16, 64});
+        b->Args({64, 1 << 16});
+        b->Args({1 << 18, 16});
+        b->Args({16, 1 << 18});
+        b->Args({1000, 1000});
+    }
+
+    void set_bytes(benchmark::State& state, size_t n) {
+        // each element is read once and written once
+        state.SetBytesProcessed(int64_t(state.iterations()) * 2 * n * sizeof(double));
+    }
+
+    void BM_TransposeNaive(benchmark::State& state) {
+        size_t rows = state.range(0), cols = state.range(1);
+        std::vector<double> src(rows * cols, 1.0), dst(rows * cols);
+        for (auto _ : state) {
+            transposition::naive(src.data(), rows, cols, cols, dst.data(), rows);
+            benchmark::ClobberMemory();
+        }
+        set_bytes(state, rows * cols);
+    }
+    BENCHMARK(BM_TransposeNaive)->Apply(shapes)->Unit(benchmark::kMillisecond);
+
+    void BM_TransposeBlocked(benchmark::State& state) {
+        size_t rows = state.range(0), cols = state.range(1);
+        std::vector<double> src(rows * cols, 1.0), dst(rows * cols);
+        for (auto _ : state) {
+            transposition::out_of_place(src.data(), rows, cols, cols, dst.data(), rows);
+            benchmark::ClobberMemory();
+        }
+        set_bytes(state, rows * cols);
+    }
+    BENCHMARK(BM_TransposeBlocked)->Apply(shapes)->Unit(benchmark::kMillisecond);
+
+    void BM_TransposeInPlace(benchmark::State& state) {
+        size_t n = state.range(0);
+        std::vector<double> a(n * n, 1.0);
+        for (auto _ : state) {
+            transposition::in_place(a.data(), n, n);
+            benchmark::ClobberMemory();
+        }
+        set_bytes(state, n * n);
+    }
+    BENCHMARK(BM_TransposeInPlace)->Arg(1000)->Arg(2048)->Unit(benchmark::kMillisecond);
+
+}
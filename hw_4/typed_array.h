@@ -2,19 +2,146 @@
 #define TYPED_ARRAY
 
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "simd.h"
+#include "thread_pool.h"
 
+// what a TypedArray does with memory freed by pops. Manual keeps it
+// until shrink_to_fit, Auto halves the buffer whenever a pop leaves it
+// a quarter full (never below INITIAL_CAPACITY). halving at a quarter
+// instead of a half means push/pop at the boundary cant thrash
+enum class ShrinkPolicy { Manual, Auto };
+
+// inline capacity when none is given: as many elements as fit in a
+// cache line, at least one
 template <typename ElementType>
-class TypedArray {
+constexpr int default_inline_capacity = sizeof(ElementType) >= 64 ? 1 : int(64 / sizeof(ElementType));
+
+namespace typed_array_detail {
+
+    // room for N elements inside the TypedArray itself. a base class so
+    // the N = 0 one takes no space (no [[no_unique_address]] in C++17)
+    template <typename ElementType, int N>
+    struct InlineBuffer {
+        ElementType* inline_data() { return reinterpret_cast<ElementType*>(bytes); }
+        alignas(ElementType) unsigned char bytes[N * sizeof(ElementType)];
+    };
+
+    template <typename ElementType>
+    struct InlineBuffer<ElementType, 0> {
+        ElementType* inline_data() { return nullptr; }
+    };
+
+    // the allocator, as a base class too so std::allocator and other
+    // empty ones take no space
+    template <typename Allocator>
+    struct AllocatorHolder : Allocator {
+        explicit AllocatorHolder(const Allocator& alloc) : Allocator(alloc) {}
+        Allocator& allocator() { return *this; }
+        const Allocator& allocator() const { return *this; }
+    };
+
+}
+
+// A double ended array on a circular buffer. Element i lives at slot
+// (head + i) % capacity, so pushing and popping at either end never
+// moves anything and a queue (push at the back, pop at the front)
+// keeps reusing the same slots instead of growing. The buffer only
+// grows when it is actually full, and then doubles.
+//
+// The first InlineCapacity elements live inside the object, an array
+// that never gets longer than that never touches the heap. Moving one
+// of those moves the elements one by one instead of stealing a pointer.
+// InlineCapacity 0 is the plain all-heap layout, INITIAL_CAPACITY
+// allocated up front.
+//
+// The heap buffer comes from Allocator, pmr::TypedArray below takes a
+// std::pmr::memory_resource. Copies, moves and swaps follow the
+// allocator's propagate_on_container_* traits like the std containers.
+// Elements are placement new'd into the buffer, not built through the
+// allocator, so a pmr::TypedArray of pmr strings doesnt hand its
+// resource down to the strings.
+template <typename ElementType,
+          int InlineCapacity = default_inline_capacity<ElementType>,
+          typename Allocator = std::allocator<ElementType>>
+class TypedArray : private typed_array_detail::InlineBuffer<ElementType, InlineCapacity>,
+                   private typed_array_detail::AllocatorHolder<Allocator> {
+
+    static_assert(InlineCapacity >= 0, "inline capacity cant be negative");
+    static_assert(std::is_same<typename Allocator::value_type, ElementType>::value,
+                  "allocator has to allocate ElementType");
+    static_assert(std::is_same<typename std::allocator_traits<Allocator>::pointer, ElementType*>::value,
+                  "allocators with fancy pointers arent supported");
+
+    template <bool Const>
+    class Iterator;
+
+    template <typename T, int N, typename A>
+    friend class TypedArray;
+
+    using AllocTraits = std::allocator_traits<Allocator>;
 
 public:
 
+    using value_type = ElementType;
+    using allocator_type = Allocator;
+    using size_type = int;
+    using difference_type = std::ptrdiff_t;
+    using reference = ElementType&;
+    using const_reference = const ElementType&;
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    static constexpr int INLINE_CAPACITY = InlineCapacity;
+
+    // moving can only throw if the elements have to be moved one at a
+    // time out of the inline buffer and their move throws
+    static constexpr bool NOTHROW_MOVE =
+        InlineCapacity == 0 || std::is_nothrow_move_constructible<ElementType>::value;
+
+    // move assignment can also end up moving the elements one by one
+    // when the allocators differ and dont propagate
+    static constexpr bool NOTHROW_MOVE_ASSIGN =
+        NOTHROW_MOVE && (AllocTraits::propagate_on_container_move_assignment::value ||
+                         AllocTraits::is_always_equal::value);
+
+    // what map(f) gives back, same allocator for the new element type
+    template <typename F>
+    using mapped_type = TypedArray<
+        typename std::decay<typename std::invoke_result<F&, const ElementType&>::type>::type,
+        default_inline_capacity<typename std::decay<typename std::invoke_result<F&, const ElementType&>::type>::type>,
+        typename AllocTraits::template rebind_alloc<
+            typename std::decay<typename std::invoke_result<F&, const ElementType&>::type>::type>>;
+
     TypedArray();
+    explicit TypedArray(const Allocator& alloc);
+    TypedArray(std::initializer_list<ElementType> values, const Allocator& alloc = Allocator());
     TypedArray(const TypedArray& other);
+    TypedArray(const TypedArray& other, const Allocator& alloc);
+    TypedArray(TypedArray&& other) noexcept(NOTHROW_MOVE);
+    // moves the elements one by one unless alloc == other's allocator
+    TypedArray(TypedArray&& other, const Allocator& alloc);
 
     // Copy constructor
     TypedArray& operator=(const TypedArray& other);
+    TypedArray& operator=(TypedArray&& other) noexcept(NOTHROW_MOVE_ASSIGN);
+
+    void swap(TypedArray& other) noexcept(NOTHROW_MOVE);
 
     // Destructor
     ~TypedArray();
@@ -23,6 +150,7 @@ public:
     ElementType &get(int index);
     ElementType &safe_get(int index) const;
     int size() const;
+    int capacity() const;
 
     // Setters
     void set(int index, ElementType value);
@@ -32,235 +160,1179 @@ public:
     void push_front(const ElementType &value);
     ElementType pop();
     ElementType pop_front();
-    TypedArray concat(const TypedArray& other);
+    TypedArray concat(const TypedArray& other) const &;
+    TypedArray concat(const TypedArray& other) &&;
     TypedArray& reverse();
 
+    // bulk algorithms, run straight on the buffer a run at a time instead
+    // of through get/set. once there are parallel::ELEMENTWISE_GRAIN
+    // elements per thread they get split over the thread pool, so f, pred,
+    // op and comp can be called from several threads at once and in any
+    // order, same rules as the std::execution::par algorithms.
+    //
+    // map: a new array of f(x) for every x, in order
+    template <typename F>
+    mapped_type<F> map(F f) const;
+    // a new array of the elements pred is true for, in order
+    template <typename Pred>
+    TypedArray filter(Pred pred) const;
+    // init combined with every element. the elements get grouped and
+    // reordered, so op has to be associative and commutative (like
+    // std::reduce), float sums can come out slightly different from a
+    // plain left to right loop
+    template <typename T, typename Op = std::plus<>>
+    T reduce(T init, Op op = Op()) const;
+    // not stable. unwraps the buffer first, like data()
+    template <typename Compare = std::less<>>
+    TypedArray& sort(Compare comp = Compare());
+    // index of the first element equal to value / matching pred, -1 if
+    // there isnt one
+    int find(const ElementType& value) const;
+    template <typename Pred>
+    int find_if(Pred pred) const;
+
+    // bulk versions. the size is worked out once (for forward iterators)
+    // so there is at most one reallocation. prepend keeps the order of
+    // the range, [1, 2] prepended to [3] is [1, 2, 3]
+    template <typename InputIt>
+    void append(InputIt first, InputIt last);
+    template <typename InputIt>
+    void prepend(InputIt first, InputIt last);
+    void append(std::initializer_list<ElementType> values) { append(values.begin(), values.end()); }
+    void prepend(std::initializer_list<ElementType> values) { prepend(values.begin(), values.end()); }
+
+    // remove the elements at [first, last). whichever side of the gap is
+    // shorter gets moved over. throws std::range_error on a bad range
+    void erase(int first, int last);
+    void clear();
+
+    // make room for n elements in total without reallocating
+    void reserve(int n);
+    // give back whatever isnt used by the elements
+    void shrink_to_fit();
+    void set_shrink_policy(ShrinkPolicy policy);
+
     // operator overload for concatenation
-    TypedArray operator+(const TypedArray& other);
+    TypedArray operator+(const TypedArray& other) const &;
+    TypedArray operator+(const TypedArray& other) &&;
+
+    // random access iterators, usable with anything in <algorithm>. they
+    // follow the wraparound so they arent contiguous, data() is for that.
+    // no range checks, same as operator[]
+    iterator begin() { return iterator(buffer, buffer_size, head, 0); }
+    iterator end() { return iterator(buffer, buffer_size, head, count); }
+    const_iterator begin() const { return const_iterator(buffer, buffer_size, head, 0); }
+    const_iterator end() const { return const_iterator(buffer, buffer_size, head, count); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    ElementType& operator[](int index) { return buffer[index_to_offset(index)]; }
+    const ElementType& operator[](int index) const { return buffer[index_to_offset(index)]; }
+    bool empty() const { return count == 0; }
+
+    // the elements as one plain array of size(). if they wrap around the
+    // end of the buffer they get unwrapped first, which is O(n) but only
+    // happens again after the ends have moved past the buffer edge.
+    // invalidates iterators when it does
+    ElementType* data();
+
+    // true while the elements are in the inline buffer
+    bool is_inline() const;
+
+    Allocator get_allocator() const { return this->allocator(); }
+
+    template <typename T, int N, typename A>
+    friend std::ostream &operator<<(std::ostream &os, const TypedArray<T, N, A> &array);
 
 private:
 
-    int capacity,
-        origin,
-        end;
+    // raw storage, only the count slots starting at head (wrapping
+    // around the end) hold constructed elements. everything else is
+    // uninitialized memory
+    ElementType * buffer;
+
+    int buffer_size,
+        head,
+        count;
 
-    ElementType * buffer;   
+    ShrinkPolicy shrink_policy;
 
-    const int INITIAL_CAPACITY = 10;
+    static constexpr int INITIAL_CAPACITY = 10;
 
     int index_to_offset(int index) const;
-    int offset_to_index(int offset) const;
-    bool out_of_buffer(int offset) const;
-    void extend_buffer(void);    
+    template <typename F>
+    void for_each_run(F f) const;
+    template <typename F>
+    void for_each_run(int first, int last, F f) const;
+    static int pieces(int n);
+    template <typename F>
+    static void for_each_piece(int n, int pieces, F f);
+    template <typename Match>
+    int find_with(Match match) const;
+    void construct_back(const ElementType* src, int n);
+    void grow(int min_capacity);
+    void reallocate(int new_capacity);
+    void unwrap_inline();
+    void maybe_shrink();
+
+    ElementType* allocate(int n);
+    void deallocate(ElementType* p, int n);
+    template <typename Source>
+    void construct_from(Source& other);
+    void destroy_all();
+    void relocate_to(ElementType* dst);
+    void take(TypedArray& other);
+    void reset();
 
 };
 
-template <typename ElementType>
-TypedArray<ElementType>::TypedArray() {
-    buffer = new ElementType[INITIAL_CAPACITY]();
-    capacity = INITIAL_CAPACITY;    
-    origin = capacity / 2;
-    end = origin;    
+// element index plus where the buffer wraps. comparing iterators of
+// different arrays is undefined, same as for the standard containers
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <bool Const>
+class TypedArray<ElementType, InlineCapacity, Allocator>::Iterator {
+
+public:
+
+    using iterator_category = std::random_access_iterator_tag;
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type = ElementType;
+    using difference_type = std::ptrdiff_t;
+    using pointer = typename std::conditional<Const, const ElementType*, ElementType*>::type;
+    using reference = typename std::conditional<Const, const ElementType&, ElementType&>::type;
+
+    Iterator() : base(nullptr), wrap(0), head(0), index(0) {}
+    Iterator(pointer base, int wrap, int head, difference_type index)
+        : base(base), wrap(wrap), head(head), index(index) {}
+
+    // iterator -> const_iterator
+    template <bool C = Const, typename = typename std::enable_if<C>::type>
+    Iterator(const Iterator<false>& other)
+        : base(other.base), wrap(other.wrap), head(other.head), index(other.index) {}
+
+    reference operator*() const {
+        difference_type offset = head + index;
+        return base[offset >= wrap ? offset - wrap : offset];
+    }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    Iterator& operator++() { index++; return *this; }
+    Iterator& operator--() { index--; return *this; }
+    Iterator operator++(int) { Iterator old = *this; index++; return old; }
+    Iterator operator--(int) { Iterator old = *this; index--; return old; }
+    Iterator& operator+=(difference_type n) { index += n; return *this; }
+    Iterator& operator-=(difference_type n) { index -= n; return *this; }
+    friend Iterator operator+(Iterator it, difference_type n) { return it += n; }
+    friend Iterator operator+(difference_type n, Iterator it) { return it += n; }
+    friend Iterator operator-(Iterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const Iterator& a, const Iterator& b) { return a.index - b.index; }
+
+    friend bool operator==(const Iterator& a, const Iterator& b) { return a.index == b.index; }
+    friend bool operator!=(const Iterator& a, const Iterator& b) { return a.index != b.index; }
+    friend bool operator<(const Iterator& a, const Iterator& b) { return a.index < b.index; }
+    friend bool operator>(const Iterator& a, const Iterator& b) { return a.index > b.index; }
+    friend bool operator<=(const Iterator& a, const Iterator& b) { return a.index <= b.index; }
+    friend bool operator>=(const Iterator& a, const Iterator& b) { return a.index >= b.index; }
+
+private:
+
+    friend class Iterator<!Const>;
+
+    pointer base;
+    int wrap, head;
+    difference_type index;
+
+};
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray() : TypedArray(Allocator()) {}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(const Allocator& alloc)
+    : typed_array_detail::AllocatorHolder<Allocator>(alloc),
+      buffer(nullptr), buffer_size(0), head(0), count(0), shrink_policy(ShrinkPolicy::Manual) {
+    if (InlineCapacity > 0) {
+        reset();
+    } else {
+        buffer = allocate(INITIAL_CAPACITY);
+        buffer_size = INITIAL_CAPACITY;
+    }
 }
 
-// Copy constructor: i.e TypedArray b(a) where a is a TypedArray
-template <typename ElementType>
-TypedArray<ElementType>::TypedArray(const TypedArray& other) : TypedArray() {
-    *this = other;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(std::initializer_list<ElementType> values, const Allocator& alloc)
+    : TypedArray(alloc) {
+    append(values.begin(), values.end());
 }
 
-// Assignment operator: i.e TypedArray b = a 
-template <typename ElementType>
-TypedArray<ElementType>& TypedArray<ElementType>::operator=(const TypedArray<ElementType>& other) {
+// Copy constructor: i.e TypedArray b(a) where a is a TypedArray. the
+// allocator is whatever select_on_container_copy_construction says,
+// for a pmr one thats the default resource and not a's
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(const TypedArray& other)
+    : TypedArray(other, AllocTraits::select_on_container_copy_construction(other.allocator())) {}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(const TypedArray& other, const Allocator& alloc)
+    : typed_array_detail::AllocatorHolder<Allocator>(alloc),
+      buffer(nullptr), buffer_size(0), head(0), count(0), shrink_policy(other.shrink_policy) {
+    construct_from(other);
+}
+
+// Move constructor: steals the buffer, and the allocator it came from.
+// other is left empty, on its inline buffer if it has one, otherwise
+// with no buffer at all (it allocates again the next time something is
+// added)
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(TypedArray&& other) noexcept(NOTHROW_MOVE)
+    : typed_array_detail::AllocatorHolder<Allocator>(other.allocator()),
+      buffer(nullptr), buffer_size(0), head(0), count(0), shrink_policy(other.shrink_policy) {
+    take(other);
+}
+
+// a buffer from a different allocator cant be taken over, alloc would
+// have to free it later
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::TypedArray(TypedArray&& other, const Allocator& alloc)
+    : typed_array_detail::AllocatorHolder<Allocator>(alloc),
+      buffer(nullptr), buffer_size(0), head(0), count(0), shrink_policy(other.shrink_policy) {
+    if (this->allocator() == other.allocator()) {
+        take(other);
+    } else {
+        construct_from(other);
+        other.clear();
+    }
+}
+
+// Assignment operator: i.e TypedArray b = a. copy first so a throwing
+// element copy leaves us untouched, the copy already has the allocator
+// we end up with
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>& TypedArray<ElementType, InlineCapacity, Allocator>::operator=(const TypedArray<ElementType, InlineCapacity, Allocator>& other) {
     if ( this != &other) {
-        delete[] buffer; // don't forget this or you'll get a memory leak!
-        buffer = new ElementType[other.capacity]();
-        capacity = other.capacity;
-        origin = other.origin;
-        end = origin;
-        for ( int i=0; i<other.size(); i++) {
-            set(i,other.safe_get(i));
+        constexpr bool propagate = AllocTraits::propagate_on_container_copy_assignment::value;
+        TypedArray temp(other, propagate ? other.allocator() : this->allocator());
+        destroy_all();
+        reset();
+        if constexpr (propagate) {
+            this->allocator() = other.allocator();
+        }
+        take(temp);
+    }
+    return *this;
+}
+
+// Move assignment: b = std::move(a). the buffer can only be taken if
+// our allocator will be able to free it
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>& TypedArray<ElementType, InlineCapacity, Allocator>::operator=(TypedArray<ElementType, InlineCapacity, Allocator>&& other) noexcept(NOTHROW_MOVE_ASSIGN) {
+    if ( this == &other ) {
+        return *this;
+    }
+    constexpr bool propagate = AllocTraits::propagate_on_container_move_assignment::value;
+    if (propagate || this->allocator() == other.allocator()) {
+        destroy_all();
+        reset();
+        if constexpr (propagate) {
+            this->allocator() = other.allocator();
         }
+        shrink_policy = other.shrink_policy;
+        take(other);
+    } else {
+        TypedArray temp(std::move(other), this->allocator());
+        destroy_all();
+        reset();
+        shrink_policy = temp.shrink_policy;
+        take(temp);
     }
     return *this;
 }
 
+// pointers swap when both are on the heap. an inline one cant be
+// pointed at from the other object, that takes three moves. like the
+// std containers, swapping arrays with different allocators that dont
+// propagate on swap is undefined
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::swap(TypedArray& other) noexcept(NOTHROW_MOVE) {
+    if (is_inline() || other.is_inline()) {
+        TypedArray temp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(temp);
+        return;
+    }
+    if constexpr (AllocTraits::propagate_on_container_swap::value) {
+        using std::swap;
+        swap(this->allocator(), other.allocator());
+    }
+    std::swap(buffer, other.buffer);
+    std::swap(buffer_size, other.buffer_size);
+    std::swap(head, other.head);
+    std::swap(count, other.count);
+    std::swap(shrink_policy, other.shrink_policy);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void swap(TypedArray<ElementType, InlineCapacity, Allocator>& a, TypedArray<ElementType, InlineCapacity, Allocator>& b)
+    noexcept(noexcept(a.swap(b))) {
+    a.swap(b);
+}
+
 // Destructor
-template <typename ElementType>
-TypedArray<ElementType>::~TypedArray() {
-    delete[] buffer;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>::~TypedArray() {
+    destroy_all();
 }
 
 // Getters
-template <typename ElementType>
-ElementType &TypedArray<ElementType>::get(int index) {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType &TypedArray<ElementType, InlineCapacity, Allocator>::get(int index) {
     if (index < 0) {
         throw std::range_error("Out of range index in array");
     }
     if ( index >= size() ) {
-        ElementType x;
-        set(index, x);
-    } 
+        set(index, ElementType());
+    }
     return buffer[index_to_offset(index)];
 }
 
 // Getters
-template <typename ElementType>
-ElementType &TypedArray<ElementType>::safe_get(int index) const {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType &TypedArray<ElementType, InlineCapacity, Allocator>::safe_get(int index) const {
     if (index < 0 || index >= size() ) {
         throw std::range_error("Out of range index in array");
     }
     return buffer[index_to_offset(index)];
 }
 
-template <typename ElementType>
-int TypedArray<ElementType>::size() const {
-    return end - origin;
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::size() const {
+    return count;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::capacity() const {
+    return buffer_size;
 }
 
 // Setters
-template <typename ElementType>
-void TypedArray<ElementType>::set(int index, ElementType value) {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::set(int index, ElementType value) {
     if (index < 0) {
         throw std::range_error("Negative index in array");
     }
-    while ( out_of_buffer(index_to_offset(index) ) ) {
-        extend_buffer();
+    if ( index < size() ) {
+        buffer[index_to_offset(index)] = std::move(value);
+        return;
     }
-    buffer[index_to_offset(index)] = value; // Should call the copy constructor
-                                            // of ElementType.
-    if ( index >= size() ) {
-        end = index_to_offset(index+1);
+    if ( index >= capacity() ) {
+        grow(index + 1);
     }
+    // anything skipped over gets default constructed, then value is
+    // moved into the new last slot. count moves along with each one so
+    // a throwing constructor leaves a valid (shorter) array
+    while ( count < index ) {
+        new (buffer + index_to_offset(count)) ElementType();
+        count++;
+    }
+    new (buffer + index_to_offset(count)) ElementType(std::move(value));
+    count++;
 }
 
-template <typename ElementType>
-std::ostream &operator<<(std::ostream &os, TypedArray<ElementType> &array)
+// straight over the (at most two) runs of the buffer
+template <typename ElementType, int InlineCapacity, typename Allocator>
+std::ostream &operator<<(std::ostream &os, const TypedArray<ElementType, InlineCapacity, Allocator> &array)
 {
     os << '[';
-    for (int i=0; i<array.size(); i++ ) {
-        os << array.get(i);
-        if ( i < array.size() - 1 ) {
-            os << ",";
+    bool first = true;
+    array.for_each_run([&](const ElementType* p, int n) {
+        for (int i = 0; i < n; i++) {
+            if ( !first ) {
+                os << ",";
+            }
+            os << p[i];
+            first = false;
         }
-    }
+    });
     os << ']';
     return os;
 }
 
 // push to the back
-template <typename ElementType>
-void TypedArray<ElementType>::push(const ElementType &value) {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::push(const ElementType &value) {
     set(size(), value);
 }
 
-// push to the front of the array
-template <typename ElementType>
-void TypedArray<ElementType>::push_front(const ElementType &value) {
-    // extend_buffer re-centers stuff so origin wont be 0 after
-    while (origin == 0) {
-        extend_buffer();
+// push to the front of the array, into the slot before head (which is
+// the last slot of the buffer when head is 0)
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::push_front(const ElementType &value) {
+    if (count == buffer_size) {
+        // value can be one of our own elements (a.push_front(a[0])), and
+        // grow frees the buffer it lives in, so copy it first
+        ElementType copy(value);
+        grow(count + 1);
+        int slot = head == 0 ? buffer_size - 1 : head - 1;
+        new (buffer + slot) ElementType(std::move(copy));
+        head = slot;
+        count++;
+        return;
     }
-    origin--;
-    set(0, value);
+    int slot = head == 0 ? buffer_size - 1 : head - 1;
+    new (buffer + slot) ElementType(value);
+    head = slot;
+    count++;
 }
 
 // pop from back, throw if empty
-template <typename ElementType>
-ElementType TypedArray<ElementType>::pop() {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType TypedArray<ElementType, InlineCapacity, Allocator>::pop() {
     if (size() <= 0) {
         throw std::range_error("Cannot pop from an empty array");
     }
-    ElementType val = get(size() - 1);
-    end--;
+    ElementType* slot = buffer + index_to_offset(count - 1);
+    ElementType val = std::move(*slot);
+    slot->~ElementType();
+    count--;
+    maybe_shrink();
     return val;
 }
 
 // pop from front
-template <typename ElementType>
-ElementType TypedArray<ElementType>::pop_front() {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType TypedArray<ElementType, InlineCapacity, Allocator>::pop_front() {
     if (size() <= 0) {
         throw std::range_error("Cannot pop from an empty array");
     }
-    ElementType val = get(0);
-    origin++;
+    ElementType val = std::move(buffer[head]);
+    buffer[head].~ElementType();
+    head = head + 1 == buffer_size ? 0 : head + 1;
+    count--;
+    maybe_shrink();
     return val;
 }
 
-// concat two arrays together into a new one
-template <typename ElementType>
-TypedArray<ElementType> TypedArray<ElementType>::concat(const TypedArray& other) {
-    TypedArray res;
-    int i;
-    for (i = 0; i < size(); i++) {
-        res.push(safe_get(i));
+// concat two arrays together into a new one, sized once and copied
+// run by run
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator> TypedArray<ElementType, InlineCapacity, Allocator>::concat(const TypedArray& other) const & {
+    TypedArray res(AllocTraits::select_on_container_copy_construction(this->allocator()));
+    res.reserve(size() + other.size());
+    for_each_run([&](const ElementType* p, int n) { res.construct_back(p, n); });
+    other.for_each_run([&](const ElementType* p, int n) { res.construct_back(p, n); });
+    return res;
+}
+
+// concat on a temporary, e.g. the middle of a.concat(b).concat(c):
+// append onto it and hand its buffer over instead of copying. the room
+// is made before reading other, so other can be *this
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator> TypedArray<ElementType, InlineCapacity, Allocator>::concat(const TypedArray& other) && {
+    if (count + other.count > buffer_size) {
+        grow(count + other.count);
+    }
+    other.for_each_run([&](const ElementType* p, int n) { construct_back(p, n); });
+    return std::move(*this);
+}
+
+// reverse the array in place: piece i of the front half swaps with its
+// mirror image in the back half
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator>& TypedArray<ElementType, InlineCapacity, Allocator>::reverse() {
+    ElementType* p = data();
+    int half = count / 2;
+    for_each_piece(half, pieces(half), [&](int, int first, int last) {
+        std::swap_ranges(p + first, p + last, std::reverse_iterator<ElementType*>(p + count - first));
+    });
+    return *this;
+}
+
+// trivial results are written straight into the raw buffer from every
+// piece and only counted at the end, there is nothing to destroy if f
+// throws. anything else is built one at a time on one thread
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename F>
+typename TypedArray<ElementType, InlineCapacity, Allocator>::template mapped_type<F>
+TypedArray<ElementType, InlineCapacity, Allocator>::map(F f) const {
+    using Result = typename mapped_type<F>::value_type;
+    mapped_type<F> res{typename mapped_type<F>::allocator_type(this->allocator())};
+    res.reserve(count);
+    Result* out = res.buffer;
+    if constexpr (std::is_trivially_copyable<Result>::value &&
+                  std::is_trivially_destructible<Result>::value) {
+        for_each_piece(count, pieces(count), [&](int, int first, int last) {
+            for_each_run(first, last, [&](const ElementType* p, int n) {
+                Result* dst = out + first;
+                for (int i = 0; i < n; i++) {
+                    new (dst + i) Result(f(p[i]));
+                }
+                first += n;
+            });
+        });
+        res.count = count;
+    } else {
+        for_each_run([&](const ElementType* p, int n) {
+            for (int i = 0; i < n; i++) {
+                new (out + res.count) Result(f(p[i]));
+                res.count++;
+            }
+        });
     }
-    for (i = 0; i < other.size(); i++) {
-        res.push(other.safe_get(i));
+    return res;
+}
+
+// the pieces only mark what to keep, in a byte per element, and count
+// it. everything that allocates (reserve, construct_back) happens on
+// the calling thread afterwards, allocators like the pmr arenas arent
+// safe to call from several threads at once
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Pred>
+TypedArray<ElementType, InlineCapacity, Allocator> TypedArray<ElementType, InlineCapacity, Allocator>::filter(Pred pred) const {
+    TypedArray res(this->allocator());
+    int n = pieces(count);
+    if (n == 1) {
+        for_each_run([&](const ElementType* p, int len) {
+            for (int i = 0; i < len; i++) {
+                if (pred(p[i])) {
+                    res.push(p[i]);
+                }
+            }
+        });
+        return res;
     }
+    std::vector<unsigned char> keep(count);
+    std::vector<int> kept(n);
+    for_each_piece(count, n, [&](int piece, int first, int last) {
+        unsigned char* mark = keep.data() + first;
+        int total = 0;
+        for_each_run(first, last, [&](const ElementType* p, int len) {
+            for (int i = 0; i < len; i++) {
+                mark[i] = pred(p[i]) ? 1 : 0;
+                total += mark[i];
+            }
+            mark += len;
+        });
+        kept[piece] = total;
+    });
+    int total = 0;
+    for (int k : kept) {
+        total += k;
+    }
+    res.reserve(total);
+    // copy over runs of kept elements, so trivial types still get memcpy
+    int index = 0;
+    for_each_run([&](const ElementType* p, int len) {
+        const unsigned char* mark = keep.data() + index;
+        int i = 0;
+        while (i < len) {
+            while (i < len && !mark[i]) {
+                i++;
+            }
+            int start = i;
+            while (i < len && mark[i]) {
+                i++;
+            }
+            if (i > start) {
+                res.construct_back(p + start, i - start);
+            }
+        }
+        index += len;
+    });
     return res;
 }
 
-// reverse the array in place
-template <typename ElementType>
-TypedArray<ElementType>& TypedArray<ElementType>::reverse() {
-    int n = size();
-    // just swap from both ends
-    for (int i = 0; i < n / 2; i++) {
-        ElementType temp = safe_get(i);
-        set(i, safe_get(n - 1 - i));
-        set(n - 1 - i, temp);
+// a piece starts from its own first element, so op never needs an
+// identity value. double and float sums go to simd::sum, other numbers
+// go into REDUCE_LANES separate accumulators, independent ops the
+// compiler can put in one vector
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename T, typename Op>
+T TypedArray<ElementType, InlineCapacity, Allocator>::reduce(T init, Op op) const {
+    constexpr int REDUCE_LANES = 16;
+    constexpr bool simd_sum =
+        (std::is_same<ElementType, double>::value || std::is_same<ElementType, float>::value) &&
+        std::is_same<T, ElementType>::value &&
+        (std::is_same<Op, std::plus<>>::value || std::is_same<Op, std::plus<ElementType>>::value);
+    auto fold = [&](T acc, const ElementType* p, int n) {
+        int i = 0;
+        if constexpr (simd_sum) {
+            return acc + simd::sum(p, n);
+        } else if constexpr (std::is_arithmetic<ElementType>::value && std::is_arithmetic<T>::value) {
+            if (n >= 2 * REDUCE_LANES) {
+                T lanes[REDUCE_LANES];
+                for (int j = 0; j < REDUCE_LANES; j++) {
+                    lanes[j] = p[j];
+                }
+                for (i = REDUCE_LANES; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+                    for (int j = 0; j < REDUCE_LANES; j++) {
+                        lanes[j] = op(lanes[j], p[i + j]);
+                    }
+                }
+                for (int j = 0; j < REDUCE_LANES; j++) {
+                    acc = op(acc, lanes[j]);
+                }
+            }
+        }
+        for (; i < n; i++) {
+            acc = op(acc, p[i]);
+        }
+        return acc;
+    };
+    int n = pieces(count);
+    if (n == 1) {
+        for_each_run([&](const ElementType* p, int len) { init = fold(init, p, len); });
+        return init;
+    }
+    // pieces are never empty here, there is at least a grain in each
+    std::vector<T> partial;
+    partial.reserve(n);
+    for (int i = 0; i < n; i++) {
+        partial.push_back(init);
+    }
+    for_each_piece(count, n, [&](int piece, int first, int last) {
+        bool started = false;
+        for_each_run(first, last, [&](const ElementType* p, int len) {
+            if (!started) {
+                partial[piece] = fold(T(p[0]), p + 1, len - 1);
+                started = true;
+            } else {
+                partial[piece] = fold(partial[piece], p, len);
+            }
+        });
+    });
+    for (const T& x : partial) {
+        init = op(init, x);
+    }
+    return init;
+}
+
+// sort the pieces side by side, then merge neighbours pairwise until
+// there is one left. every round of merges runs in parallel too
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Compare>
+TypedArray<ElementType, InlineCapacity, Allocator>& TypedArray<ElementType, InlineCapacity, Allocator>::sort(Compare comp) {
+    ElementType* p = data();
+    int n = pieces(count);
+    if (n == 1) {
+        std::sort(p, p + count, comp);
+        return *this;
+    }
+    for_each_piece(count, n, [&](int, int first, int last) {
+        std::sort(p + first, p + last, comp);
+    });
+    auto bound = [&](int piece) { return int(int64_t(count) * std::min(piece, n) / n); };
+    for (int width = 1; width < n; width *= 2) {
+        int merges = (n + 2 * width - 1) / (2 * width);
+        parallel::for_range(merges, 1, [&](size_t first, size_t last) {
+            for (size_t m = first; m < last; m++) {
+                int lo = int(m) * 2 * width;
+                std::inplace_merge(p + bound(lo), p + bound(lo + width), p + bound(lo + 2 * width), comp);
+            }
+        }, merges);
     }
     return *this;
 }
 
+// double and float go to simd::find. other numbers get compared a
+// block at a time with no early exit inside the block, which
+// vectorizes, and the block with the match is then scanned again
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::find(const ElementType& value) const {
+    return find_with([&](const ElementType* p, int n) {
+        int i = 0;
+        if constexpr (std::is_same<ElementType, double>::value || std::is_same<ElementType, float>::value) {
+            return int(simd::find(p, n, value));
+        } else if constexpr (std::is_arithmetic<ElementType>::value) {
+            constexpr int BLOCK = 32;
+            for (; i + BLOCK <= n; i += BLOCK) {
+                bool hit = false;
+                for (int j = 0; j < BLOCK; j++) {
+                    hit |= p[i + j] == value;
+                }
+                if (hit) {
+                    break;
+                }
+            }
+        }
+        for (; i < n; i++) {
+            if (p[i] == value) {
+                return i;
+            }
+        }
+        return n;
+    });
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Pred>
+int TypedArray<ElementType, InlineCapacity, Allocator>::find_if(Pred pred) const {
+    return find_with([&](const ElementType* p, int n) {
+        return int(std::find_if(p, p + n, pred) - p);
+    });
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType* TypedArray<ElementType, InlineCapacity, Allocator>::data() {
+    if (head + count > buffer_size) {
+        reallocate(buffer_size);
+    }
+    return buffer + head;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+bool TypedArray<ElementType, InlineCapacity, Allocator>::is_inline() const {
+    return InlineCapacity > 0 &&
+           buffer == const_cast<TypedArray*>(this)->inline_data();
+}
+
+// input iterators can only be walked once, so those just get pushed
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename InputIt>
+void TypedArray<ElementType, InlineCapacity, Allocator>::append(InputIt first, InputIt last) {
+    using Category = typename std::iterator_traits<InputIt>::iterator_category;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+        int n = static_cast<int>(std::distance(first, last));
+        if (count + n > buffer_size) {
+            grow(count + n);
+        }
+        for (; first != last; ++first) {
+            new (buffer + index_to_offset(count)) ElementType(*first);
+            count++;
+        }
+    } else {
+        for (; first != last; ++first) {
+            push(*first);
+        }
+    }
+}
+
+// constructed back to front right before head, so head moves one slot
+// at a time and a throw leaves the part done so far in the array
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename InputIt>
+void TypedArray<ElementType, InlineCapacity, Allocator>::prepend(InputIt first, InputIt last) {
+    using Category = typename std::iterator_traits<InputIt>::iterator_category;
+    if constexpr (std::is_base_of<std::bidirectional_iterator_tag, Category>::value) {
+        int n = static_cast<int>(std::distance(first, last));
+        if (count + n > buffer_size) {
+            grow(count + n);
+        }
+        while (last != first) {
+            --last;
+            int slot = head == 0 ? buffer_size - 1 : head - 1;
+            new (buffer + slot) ElementType(*last);
+            head = slot;
+            count++;
+        }
+    } else {
+        // one pass only, collect it first
+        TypedArray temp(this->allocator());
+        temp.append(first, last);
+        prepend(temp.buffer, temp.buffer + temp.count);
+    }
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::erase(int first, int last) {
+    if (first < 0 || last > count || first > last) {
+        throw std::range_error("Out of range erase in array");
+    }
+    int n = last - first;
+    if (n == 0) {
+        return;
+    }
+    if (first < count - last) {
+        // fewer in front: slide [0, first) right by n, back to front
+        for (int i = first - 1; i >= 0; i--) {
+            buffer[index_to_offset(i + n)] = std::move(buffer[index_to_offset(i)]);
+        }
+        for (int i = 0; i < n; i++) {
+            buffer[index_to_offset(i)].~ElementType();
+        }
+        head = index_to_offset(n);
+    } else {
+        // fewer behind: slide [last, count) left by n
+        for (int i = last; i < count; i++) {
+            buffer[index_to_offset(i - n)] = std::move(buffer[index_to_offset(i)]);
+        }
+        for (int i = count - n; i < count; i++) {
+            buffer[index_to_offset(i)].~ElementType();
+        }
+    }
+    count -= n;
+    maybe_shrink();
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::clear() {
+    erase(0, count);
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::reserve(int n) {
+    if (n > buffer_size) {
+        reallocate(n);
+    }
+}
+
+// back to the inline buffer if the elements fit. without one an empty
+// array drops its buffer completely, like a moved-from one
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::shrink_to_fit() {
+    if (count < buffer_size && !is_inline()) {
+        reallocate(count);
+    }
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::set_shrink_policy(ShrinkPolicy policy) {
+    shrink_policy = policy;
+    maybe_shrink();
+}
+
 // + operator just calls concat
-template <typename ElementType>
-TypedArray<ElementType> TypedArray<ElementType>::operator+(const TypedArray& other) {
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator> TypedArray<ElementType, InlineCapacity, Allocator>::operator+(const TypedArray& other) const & {
     return concat(other);
 }
 
+template <typename ElementType, int InlineCapacity, typename Allocator>
+TypedArray<ElementType, InlineCapacity, Allocator> TypedArray<ElementType, InlineCapacity, Allocator>::operator+(const TypedArray& other) && {
+    return std::move(*this).concat(other);
+}
+
 // Private methods
 
-template <typename ElementType>
-int TypedArray<ElementType>::index_to_offset ( int index ) const {
-    return index + origin;
+/* Slot of element 'index', wrapping around the end of the buffer.
+   index is at most capacity here so one subtraction does it */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::index_to_offset ( int index ) const {
+    int offset = head + index;
+    return offset >= buffer_size ? offset - buffer_size : offset;
 }
 
-/* Position of the element at buffer position 'offset' */
-template <typename ElementType>
-int TypedArray<ElementType>::offset_to_index ( int offset ) const  {
-    return offset - origin;
+/* Calls f(pointer, length) for the elements in order: [head, end of
+   buffer) and then whatever wrapped around to the start. Both runs are
+   worked out before f is called, so f can add to the back of *this */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename F>
+void TypedArray<ElementType, InlineCapacity, Allocator>::for_each_run(F f) const {
+    int first_run = std::min(count, buffer_size - head),
+        second_run = count - first_run;
+    const ElementType* start = buffer + head;
+    const ElementType* wrapped = buffer;
+    if (first_run > 0) {
+        f(start, first_run);
+    }
+    if (second_run > 0) {
+        f(wrapped, second_run);
+    }
 }
 
-/* Non-zero if and only if offset lies ouside the buffer */
-template <typename ElementType>
-bool TypedArray<ElementType>::out_of_buffer ( int offset ) const {
-    return offset < 0 || offset >= capacity;
+/* Same over the elements [first, last) only, f(pointer, length) */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename F>
+void TypedArray<ElementType, InlineCapacity, Allocator>::for_each_run(int first, int last, F f) const {
+    while (first < last) {
+        int slot = index_to_offset(first),
+            run = std::min(last - first, buffer_size - slot);
+        f(static_cast<const ElementType*>(buffer + slot), run);
+        first += run;
+    }
 }
 
-/* Makes a new buffer that is twice the size of the old buffer,
-   copies the old information into the new buffer, and deletes
-   the old buffer */
-template <typename ElementType>
-void TypedArray<ElementType>::extend_buffer() {
+/* How many pieces the parallel algorithms split n elements into, at
+   most one per thread and at least a grain each. 1 means stay serial */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+int TypedArray<ElementType, InlineCapacity, Allocator>::pieces(int n) {
+    size_t per_grain = size_t(n) / parallel::ELEMENTWISE_GRAIN;
+    return int(std::max<size_t>(1, std::min(parallel::num_threads(), per_grain)));
+}
+
+/* f(piece, first, last) for every piece of [0, n), each on its own
+   thread. the pieces are the same for the same n and pieces */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename F>
+void TypedArray<ElementType, InlineCapacity, Allocator>::for_each_piece(int n, int pieces, F f) {
+    if (pieces == 1) {
+        f(0, 0, n);
+        return;
+    }
+    parallel::for_range(pieces, 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            f(int(i), int(int64_t(n) * i / pieces), int(int64_t(n) * (i + 1) / pieces));
+        }
+    }, pieces);
+}
 
-    auto temp = new ElementType[2 * capacity]();
-    int new_origin = capacity - (end - origin)/2,
-           new_end = new_origin + (end - origin);
+/* First index where match(pointer, length) hits, match returns the
+   offset in the run or length for none. Pieces finish out of order, so
+   the best hit so far is shared and a piece gives up once it is past it.
+   FIND_STEP keeps that check off the inner loop */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Match>
+int TypedArray<ElementType, InlineCapacity, Allocator>::find_with(Match match) const {
+    constexpr int FIND_STEP = 4096;
+    std::atomic<int> best(count);
+    for_each_piece(count, pieces(count), [&](int, int first, int last) {
+        for_each_run(first, last, [&](const ElementType* p, int n) {
+            for (int done = 0; done < n && first + done < best.load(std::memory_order_relaxed);) {
+                int step = std::min(n - done, FIND_STEP),
+                    hit = match(p + done, step);
+                if (hit < step) {
+                    int index = first + done + hit,
+                        current = best.load();
+                    while (index < current && !best.compare_exchange_weak(current, index)) {
+                    }
+                    break;
+                }
+                done += step;
+            }
+            first += n;
+        });
+    });
+    return best.load() == count ? -1 : best.load();
+}
 
-    for ( int i=0; i<size(); i++ ) {
-        temp[new_origin+i] = get(i);
+/* Copy constructs n elements onto the back, the room has to be there
+   already. The free slots can wrap too, so it goes a run at a time and
+   count only moves past fully built runs. Trivially copyable elements
+   are one memcpy per run */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::construct_back(const ElementType* src, int n) {
+    while (n > 0) {
+        int slot = index_to_offset(count),
+            run = std::min(n, buffer_size - slot);
+        if constexpr (std::is_trivially_copyable<ElementType>::value) {
+            std::memcpy(static_cast<void*>(buffer + slot), src, sizeof(ElementType) * run);
+        } else {
+            std::uninitialized_copy(src, src + run, buffer + slot);
+        }
+        count += run;
+        src += run;
+        n -= run;
     }
+}
+
+/* At least double, so pushes are amortized O(1). A moved-from array
+   has no buffer, this gives it one */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::grow(int min_capacity) {
+    reallocate(std::max(min_capacity, std::max(2 * buffer_size, INITIAL_CAPACITY)));
+}
+
+/* New buffer of new_capacity (>= size) with the elements unwrapped
+   to start at slot 0. Anything that fits goes to the inline buffer.
+   The old elements get destroyed after relocate_to, so a throwing copy
+   leaves the array untouched */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::reallocate(int new_capacity) {
+    bool to_inline = new_capacity <= InlineCapacity;
+    if (to_inline && is_inline()) {
+        unwrap_inline();
+        return;
+    }
+    ElementType* fresh = to_inline ? this->inline_data() : allocate(new_capacity);
+    try {
+        relocate_to(fresh);
+    } catch (...) {
+        if (!to_inline) {
+            deallocate(fresh, new_capacity);
+        }
+        throw;
+    }
+    destroy_all();
+    buffer = fresh;
+    buffer_size = to_inline ? InlineCapacity : new_capacity;
+    head = 0;
+}
+
+/* Unwraps the ring inside the inline buffer so it starts at slot 0,
+   without any memory from the allocator (short arrays never touch it).
+   Each pass moves every element one slot to the left into the free
+   slot before it, head passes in all. At most InlineCapacity^2 moves,
+   which is nothing for a buffer this small. A full ring has no free
+   slot, so its last element waits in a local meanwhile. If a move
+   throws the elements are gone, same basic guarantee std::deque gives */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::unwrap_inline() {
+    if (head == 0) {
+        return;
+    }
+    alignas(ElementType) unsigned char spare[sizeof(ElementType)];
+    ElementType* last = nullptr;
+    if (count == buffer_size) {
+        ElementType* slot = buffer + index_to_offset(count - 1);
+        last = new (spare) ElementType(std::move_if_noexcept(*slot));
+        slot->~ElementType();
+        count--;
+    }
+    int moved = 0;
+    try {
+        for (; head != 0; head--) {
+            for (moved = 0; moved < count; moved++) {
+                int from = (head + moved) % buffer_size;
+                int to = (from + buffer_size - 1) % buffer_size;
+                new (buffer + to) ElementType(std::move_if_noexcept(buffer[from]));
+                buffer[from].~ElementType();
+            }
+        }
+        moved = 0;
+        if (last) {
+            new (buffer + count) ElementType(std::move_if_noexcept(*last));
+            last->~ElementType();
+            count++;
+        }
+    } catch (...) {
+        // the first `moved` elements of this pass already sit a slot to
+        // the left, the rest havent moved yet
+        for (int k = 0; k < count; k++) {
+            int slot = (head + k - (k < moved ? 1 : 0) + buffer_size) % buffer_size;
+            buffer[slot].~ElementType();
+        }
+        if (last) {
+            last->~ElementType();
+        }
+        head = 0;
+        count = 0;
+        throw;
+    }
+}
 
-    delete[] buffer;
-    buffer = temp;
+/* Move constructs the elements in order into raw memory at dst (copies
+   if the move could throw and a copy is possible). On a throw whatever
+   was built at dst is destroyed again and *this is as it was */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::relocate_to(ElementType* dst) {
+    // the elements are at most two runs, [head, buffer_size) and [0, ...)
+    int first_run = std::min(count, buffer_size - head);
+    if constexpr (std::is_nothrow_move_constructible<ElementType>::value ||
+                  !std::is_copy_constructible<ElementType>::value) {
+        std::uninitialized_move(buffer + head, buffer + head + first_run, dst);
+        std::uninitialized_move(buffer, buffer + (count - first_run), dst + first_run);
+    } else {
+        std::uninitialized_copy(buffer + head, buffer + head + first_run, dst);
+        try {
+            std::uninitialized_copy(buffer, buffer + (count - first_run), dst + first_run);
+        } catch (...) {
+            std::destroy(dst, dst + first_run);
+            throw;
+        }
+    }
+}
+
+/* Takes other's elements, *this has to be empty (after reset or a
+   fresh constructor). A heap buffer is just taken over, inline
+   elements get moved over one by one */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::take(TypedArray& other) {
+    if (other.is_inline()) {
+        reset();
+        other.relocate_to(buffer);
+        count = other.count;
+        std::destroy(other.begin(), other.end());
+    } else {
+        buffer = other.buffer;
+        buffer_size = other.buffer_size;
+        head = other.head;
+        count = other.count;
+    }
+    other.reset();
+}
+
+/* Empty, on the inline buffer (or no buffer at all without one). The
+   old elements and buffer have to be dealt with already */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::reset() {
+    buffer = this->inline_data();
+    buffer_size = InlineCapacity;
+    head = 0;
+    count = 0;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::maybe_shrink() {
+    if (shrink_policy == ShrinkPolicy::Auto && !is_inline() && buffer_size > INITIAL_CAPACITY &&
+        count <= buffer_size / 4) {
+        reallocate(std::max(buffer_size / 2, INITIAL_CAPACITY));
+    }
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+ElementType* TypedArray<ElementType, InlineCapacity, Allocator>::allocate(int n) {
+    return n > 0 ? AllocTraits::allocate(this->allocator(), n) : nullptr;
+}
+
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::deallocate(ElementType* p, int n) {
+    if (p) {
+        AllocTraits::deallocate(this->allocator(), p, n);
+    }
+}
+
+/* Builds other's elements into *this, which is fresh out of a
+   constructor. Copies from a const other, moves (if that cant throw)
+   from a non-const one. Laid out from slot 0 and only as big as it
+   needs to be, a drained queue doesnt pass its big buffer on */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+template <typename Source>
+void TypedArray<ElementType, InlineCapacity, Allocator>::construct_from(Source& other) {
+    if (other.count <= InlineCapacity) {
+        reset();
+    } else {
+        buffer_size = std::max(other.count, INITIAL_CAPACITY);
+        buffer = allocate(buffer_size);
+    }
+    try {
+        for (; count < other.count; count++) {
+            auto& x = other.buffer[other.index_to_offset(count)];
+            if constexpr (std::is_const<Source>::value) {
+                new (buffer + count) ElementType(x);
+            } else {
+                new (buffer + count) ElementType(std::move_if_noexcept(x));
+            }
+        }
+    } catch (...) {
+        destroy_all();
+        throw;
+    }
+}
+
+/* Destroys the elements and frees the buffer if it is on the heap.
+   Leaves the pointers dangling, callers set them right after */
+template <typename ElementType, int InlineCapacity, typename Allocator>
+void TypedArray<ElementType, InlineCapacity, Allocator>::destroy_all() {
+    if (buffer) {
+        for (int i = 0; i < count; i++) {
+            buffer[index_to_offset(i)].~ElementType();
+        }
+        if (!is_inline()) {
+            deallocate(buffer, buffer_size);
+        }
+    }
+}
 
-    capacity = 2 * capacity;
-    origin = new_origin;
-    end = new_end;
+// TypedArray on a std::pmr::memory_resource, e.g. one arena per request
+// that gets thrown away in one go:
+//
+//     std::pmr::monotonic_buffer_resource arena;
+//     pmr::TypedArray<int> a(&arena);
+//
+// a pointer converts to the allocator, so the resource can be passed
+// straight to the constructors. deallocating on a monotonic resource is
+// free, the memory only comes back when the arena is released. the
+// arrays still have to be destroyed before that (their elements might
+// own something), but with trivially destructible elements that is all
+// there is to it
+namespace pmr {
 
-    return;
+    template <typename ElementType, int InlineCapacity = default_inline_capacity<ElementType>>
+    using TypedArray = ::TypedArray<ElementType, InlineCapacity, std::pmr::polymorphic_allocator<ElementType>>;
 
 }
 
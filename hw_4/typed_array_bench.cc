@@ -0,0 +1,277 @@
+#include "typed_array.h"
+#include "benchmark/benchmark.h"
+#include <memory_resource>
+#include <numeric>
+#include <vector>
+
+// TypedArray building and combining, reported as elements per second.
+// every iteration starts from an empty array so growth is included.
+// 1 << 24 doubles is 128MB, past L3.
+namespace {
+
+    void sizes(benchmark::internal::Benchmark* b) {
+        b->RangeMultiplier(16)->Range(16, 1 << 24)->Unit(benchmark::kMicrosecond);
+    }
+
+    void BM_TypedArrayPush(benchmark::State& state) {
+        int n = state.range(0);
+        for (auto _ : state) {
+            TypedArray<double> a;
+            for (int i = 0; i < n; i++) {
+                a.push(i);
+            }
+            benchmark::DoNotOptimize(a.size());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * n);
+    }
+    BENCHMARK(BM_TypedArrayPush)->Apply(sizes);
+
+    void BM_TypedArrayPushFront(benchmark::State& state) {
+        int n = state.range(0);
+        for (auto _ : state) {
+            TypedArray<double> a;
+            for (int i = 0; i < n; i++) {
+                a.push_front(i);
+            }
+            benchmark::DoNotOptimize(a.size());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * n);
+    }
+    BENCHMARK(BM_TypedArrayPushFront)->Apply(sizes);
+
+    // a.concat(b) with n elements each, 2n elements copied
+    void BM_TypedArrayConcat(benchmark::State& state) {
+        int n = state.range(0);
+        TypedArray<double> a, b;
+        for (int i = 0; i < n; i++) {
+            a.push(i);
+            b.push(-i);
+        }
+        for (auto _ : state) {
+            TypedArray<double> c = a.concat(b);
+            benchmark::DoNotOptimize(c.size());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * 2 * n);
+        state.SetBytesProcessed(int64_t(state.iterations()) * 2 * n * sizeof(double));
+    }
+    BENCHMARK(BM_TypedArrayConcat)->Apply(sizes);
+
+    // work queue, n items in flight, push at the back and pop at the
+    // front. on the ring buffer the capacity stays put
+    void BM_TypedArrayQueue(benchmark::State& state) {
+        int n = state.range(0);
+        TypedArray<double> q;
+        for (int i = 0; i < n; i++) {
+            q.push(i);
+        }
+        for (auto _ : state) {
+            for (int i = 0; i < n; i++) {
+                q.push(q.pop_front());
+            }
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * n);
+        state.counters["capacity"] = q.capacity();
+    }
+    BENCHMARK(BM_TypedArrayQueue)->Apply(sizes);
+
+    void BM_TypedArrayAppend(benchmark::State& state) {
+        int n = state.range(0);
+        std::vector<double> src(n, 1.5);
+        for (auto _ : state) {
+            TypedArray<double> a;
+            a.append(src.begin(), src.end());
+            benchmark::DoNotOptimize(a.size());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * n);
+    }
+    BENCHMARK(BM_TypedArrayAppend)->Apply(sizes);
+
+    // the bulk algorithms on n doubles that wrap around the end of the
+    // buffer, so both runs are in play. the Iterators versions do the
+    // same through begin()/end() with <algorithm> for comparison
+    TypedArray<double> wrapped(int n) {
+        TypedArray<double> a;
+        a.reserve(n);
+        for (int i = 0; i < n / 2; i++) {
+            a.push((i * 37) % 1000);
+            a.push_front((i * 91) % 1000);
+        }
+        return a;
+    }
+
+    void algorithm_sizes(benchmark::internal::Benchmark* b) {
+        b->RangeMultiplier(16)->Range(1 << 10, 1 << 22)->Unit(benchmark::kMicrosecond);
+    }
+
+    void BM_TypedArrayReduce(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(a.reduce(0.0));
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArrayReduce)->Apply(algorithm_sizes);
+
+    void BM_TypedArrayReduceIterators(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(std::accumulate(a.begin(), a.end(), 0.0));
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArrayReduceIterators)->Apply(algorithm_sizes);
+
+    // looking for something that isnt there, so the whole array is read
+    void BM_TypedArrayFind(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(a.find(-1.0));
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArrayFind)->Apply(algorithm_sizes);
+
+    void BM_TypedArrayFindIterators(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(std::find(a.begin(), a.end(), -1.0));
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArrayFindIterators)->Apply(algorithm_sizes);
+
+    void BM_TypedArrayMap(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            TypedArray<double> b = a.map([](double x) { return 2 * x + 1; });
+            benchmark::DoNotOptimize(b.size());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArrayMap)->Apply(algorithm_sizes);
+
+    void BM_TypedArrayFilter(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            TypedArray<double> b = a.filter([](double x) { return x < 500; });
+            benchmark::DoNotOptimize(b.size());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArrayFilter)->Apply(algorithm_sizes);
+
+    // reversing twice leaves it as it was, no setup inside the loop
+    void BM_TypedArrayReverse(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            a.reverse();
+            benchmark::DoNotOptimize(a.data());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArrayReverse)->Apply(algorithm_sizes);
+
+    void BM_TypedArraySort(benchmark::State& state) {
+        TypedArray<double> a = wrapped(state.range(0));
+        for (auto _ : state) {
+            state.PauseTiming();
+            TypedArray<double> b(a);
+            state.ResumeTiming();
+            b.sort();
+            benchmark::DoNotOptimize(b.data());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * a.size());
+    }
+    BENCHMARK(BM_TypedArraySort)->Apply(algorithm_sizes);
+
+    // one "request": 1000 arrays of k ints built and thrown away. the
+    // Arena version takes them out of a monotonic resource over a buffer
+    // that is reused from request to request, freeing is one release()
+    constexpr int REQUEST_ARRAYS = 1000;
+
+    void BM_TypedArrayRequestHeap(benchmark::State& state) {
+        int k = state.range(0);
+        for (auto _ : state) {
+            std::vector<TypedArray<int>> arrays;
+            arrays.reserve(REQUEST_ARRAYS);
+            for (int i = 0; i < REQUEST_ARRAYS; i++) {
+                arrays.emplace_back();
+                for (int j = 0; j < k; j++) {
+                    arrays.back().push(j);
+                }
+            }
+            benchmark::DoNotOptimize(arrays.data());
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * REQUEST_ARRAYS);
+    }
+    BENCHMARK(BM_TypedArrayRequestHeap)->Arg(4)->Arg(32)->Arg(256)->Unit(benchmark::kMicrosecond);
+
+    void BM_TypedArrayRequestArena(benchmark::State& state) {
+        int k = state.range(0);
+        std::vector<char> block(size_t(REQUEST_ARRAYS) * k * sizeof(int) * 4 + (1 << 16));
+        for (auto _ : state) {
+            std::pmr::monotonic_buffer_resource arena(block.data(), block.size());
+            {
+                std::vector<pmr::TypedArray<int>> arrays;
+                arrays.reserve(REQUEST_ARRAYS);
+                for (int i = 0; i < REQUEST_ARRAYS; i++) {
+                    arrays.emplace_back(&arena);
+                    for (int j = 0; j < k; j++) {
+                        arrays.back().push(j);
+                    }
+                }
+                benchmark::DoNotOptimize(arrays.data());
+            }
+            arena.release();
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * REQUEST_ARRAYS);
+    }
+    BENCHMARK(BM_TypedArrayRequestArena)->Arg(4)->Arg(32)->Arg(256)->Unit(benchmark::kMicrosecond);
+
+    // short arrays: build one with k ints and throw it away. default
+    // inline buffer (16 ints) against InlineCapacity 0, the old all-heap
+    // layout that allocates INITIAL_CAPACITY up front
+    template <int Inline>
+    void BM_TypedArrayShort(benchmark::State& state) {
+        int k = state.range(0);
+        for (auto _ : state) {
+            TypedArray<int, Inline> a;
+            for (int i = 0; i < k; i++) {
+                a.push(i);
+            }
+            benchmark::DoNotOptimize(a.size());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_TEMPLATE(BM_TypedArrayShort, 16)->Arg(0)->Arg(2)->Arg(8)->Arg(32);
+    BENCHMARK_TEMPLATE(BM_TypedArrayShort, 0)->Arg(0)->Arg(2)->Arg(8)->Arg(32);
+
+    // a million arrays of k ints held at once, bytes per array is the
+    // object plus its heap buffer (not counting malloc's own overhead)
+    template <int Inline>
+    void BM_TypedArrayFootprint(benchmark::State& state) {
+        int k = state.range(0);
+        size_t bytes = 0;
+        for (auto _ : state) {
+            std::vector<TypedArray<int, Inline>> arrays(1 << 20);
+            for (auto& a : arrays) {
+                for (int i = 0; i < k; i++) {
+                    a.push(i);
+                }
+            }
+            state.PauseTiming();
+            bytes = 0;
+            for (auto& a : arrays) {
+                bytes += sizeof(a) + (a.is_inline() ? 0 : a.capacity() * sizeof(int));
+            }
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(int64_t(state.iterations()) * (1 << 20));
+        state.counters["bytes_per_array"] = double(bytes) / (1 << 20);
+    }
+    BENCHMARK_TEMPLATE(BM_TypedArrayFootprint, 16)->Arg(0)->Arg(2)->Arg(8)->Arg(32)
+        ->Unit(benchmark::kMillisecond);
+    BENCHMARK_TEMPLATE(BM_TypedArrayFootprint, 0)->Arg(0)->Arg(2)->Arg(8)->Arg(32)
+        ->Unit(benchmark::kMillisecond);
+
+}
@@ -1,12 +1,37 @@
 #include <math.h>
 #include <float.h>
 #include <assert.h>
+#include <atomic>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 #include "typed_array.h"
+#include "batched.h"
 #include "matrix.h"
+#include "matrix_allocator.h"
+#include "matrix_io.h"
+#include "fixed_matrix.h"
+#include "decomposition.h"
+#include "gemm.h"
+#include "thread_pool.h"
+#include "simd.h"
+#include "sparse_matrix.h"
+#include "strassen.h"
 #include "gtest/gtest.h"
 
 namespace {
 
+    // fill with something deterministic that isnt too regular
+    void fill_pattern(Matrix& m, int seed) {
+        for (size_t r = 0; r < m.rows(); r++) {
+            for (size_t c = 0; c < m.cols(); c++) {
+                m(r, c) = ((r * 31 + c * 17 + seed) % 23) / 7.0 - 1.5;
+            }
+        }
+    }
+
     /* ======= TypedArray tests ======= */
 
     TEST(TypedArray, PushAndPop) {
@@ -99,6 +124,718 @@ namespace {
         EXPECT_EQ(a.size(), 1);
     }
 
+    TEST(TypedArray, MoveSemantics) {
+        TypedArray<int> a;
+        a.push(1);
+        a.push(2);
+
+        // move construct takes the elements, a is left empty but usable
+        TypedArray<int> b(std::move(a));
+        EXPECT_EQ(b.size(), 2);
+        EXPECT_EQ(b.get(1), 2);
+        EXPECT_EQ(a.size(), 0);
+        a.push_front(7);
+        a.push(8);
+        EXPECT_EQ(a.get(0), 7);
+        EXPECT_EQ(a.get(1), 8);
+
+        // move assign
+        TypedArray<int> c;
+        c.push(42);
+        c = std::move(b);
+        EXPECT_EQ(c.size(), 2);
+        EXPECT_EQ(c.get(0), 1);
+
+        // swap
+        swap(a, c);
+        EXPECT_EQ(a.get(0), 1);
+        EXPECT_EQ(c.get(0), 7);
+
+        // chained concat on temporaries
+        TypedArray<int> d = a.concat(c).concat(a) + c;
+        EXPECT_EQ(d.size(), 8);
+        EXPECT_EQ(d.get(2), 7);
+        EXPECT_EQ(d.get(7), 8);
+        EXPECT_EQ(a.size(), 2);
+    }
+
+    // counts what happens to it, to check TypedArray only constructs
+    // what it has to
+    struct Counted {
+        static int defaults, copies, moves, live;
+        int value;
+        Counted() : value(-1) { defaults++; live++; }
+        Counted(int v) : value(v) { live++; }
+        Counted(const Counted& o) : value(o.value) { copies++; live++; }
+        Counted(Counted&& o) noexcept : value(o.value) { moves++; live++; }
+        Counted& operator=(const Counted& o) { value = o.value; copies++; return *this; }
+        Counted& operator=(Counted&& o) noexcept { value = o.value; moves++; return *this; }
+        ~Counted() { live--; }
+        static void reset() { defaults = copies = moves = 0; }
+    };
+    int Counted::defaults = 0, Counted::copies = 0, Counted::moves = 0, Counted::live = 0;
+
+    TEST(TypedArray, GrowthConstructsOnlyWhatItNeeds) {
+        Counted::reset();
+        {
+            TypedArray<Counted> a;
+            // nothing gets made up front any more
+            EXPECT_EQ(Counted::live, 0);
+            Counted c(0);
+            for (int i = 0; i < 1000; i++) {
+                c.value = i;
+                a.push(c);
+                a.push_front(c);
+            }
+            EXPECT_EQ(Counted::defaults, 0);
+            // one copy per push, growth only ever moves
+            EXPECT_EQ(Counted::copies, 2000);
+            EXPECT_EQ(Counted::live, 2001);
+            EXPECT_EQ(a.get(0).value, 999);
+            EXPECT_EQ(a.get(1999).value, 999);
+            EXPECT_EQ(a.get(1000).value, 0);
+
+            // setting past the end default constructs the gap
+            a.set(2004, Counted(7));
+            EXPECT_EQ(Counted::defaults, 4);
+            EXPECT_EQ(a.size(), 2005);
+            EXPECT_EQ(a.get(2002).value, -1);
+
+            // pop destroys the slot
+            EXPECT_EQ(a.pop().value, 7);
+            EXPECT_EQ(a.pop_front().value, 999);
+            EXPECT_EQ(Counted::live, 2003 + 1);
+        }
+        // everything that was made was destroyed
+        EXPECT_EQ(Counted::live, 0);
+    }
+
+    // only movable, growth has to move
+    TEST(TypedArray, MoveOnlyElements) {
+        TypedArray<std::unique_ptr<int>> a;
+        for (int i = 0; i < 100; i++) {
+            a.set(a.size(), std::make_unique<int>(i));
+        }
+        EXPECT_EQ(*a.get(99), 99);
+        EXPECT_EQ(*a.pop(), 99);
+        EXPECT_EQ(*a.pop_front(), 0);
+        EXPECT_EQ(a.size(), 98);
+    }
+
+    // contents as a vector, for comparing
+    template <typename T, int N, typename A>
+    std::vector<T> contents(const TypedArray<T, N, A>& a) {
+        std::vector<T> v;
+        for (int i = 0; i < a.size(); i++) {
+            v.push_back(a.safe_get(i));
+        }
+        return v;
+    }
+
+    TEST(TypedArray, QueueReusesSlots) {
+        TypedArray<int> q;
+        for (int i = 0; i < 8; i++) {
+            q.push(i);
+        }
+        int cap = q.capacity();
+        // steady state queue, wraps around the end of the buffer over and over
+        for (int i = 8; i < 100000; i++) {
+            q.push(i);
+            EXPECT_EQ(q.pop_front(), i - 8);
+        }
+        EXPECT_EQ(q.capacity(), cap);
+        EXPECT_EQ(q.size(), 8);
+        EXPECT_EQ(q.get(0), 99992);
+        EXPECT_EQ(q.get(7), 99999);
+
+        // both ends wrapping, growing in the middle of it
+        TypedArray<int> d;
+        std::vector<int> expected;
+        for (int i = 0; i < 50; i++) {
+            d.push_front(-i);
+            d.push(i);
+            expected.insert(expected.begin(), -i);
+            expected.push_back(i);
+        }
+        EXPECT_EQ(contents(d), expected);
+        TypedArray<int> copy(d);
+        EXPECT_EQ(contents(copy), expected);
+    }
+
+    TEST(TypedArray, BulkOps) {
+        TypedArray<int> a;
+        a.push(10);
+        a.push_front(9);  // head wraps to the last slot
+        std::vector<int> tail = {11, 12, 13};
+        a.append(tail.begin(), tail.end());
+        a.prepend({6, 7, 8});
+        EXPECT_EQ(contents(a), (std::vector<int>{6, 7, 8, 9, 10, 11, 12, 13}));
+
+        // one pass input iterators too
+        std::istringstream in("14 15 16"), front("4 5");
+        a.append(std::istream_iterator<int>(in), std::istream_iterator<int>());
+        a.prepend(std::istream_iterator<int>(front), std::istream_iterator<int>());
+        EXPECT_EQ(contents(a), (std::vector<int>{4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16}));
+
+        // near the front and near the back, moves the short side
+        a.erase(1, 3);
+        EXPECT_EQ(contents(a), (std::vector<int>{4, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16}));
+        a.erase(8, 10);
+        EXPECT_EQ(contents(a), (std::vector<int>{4, 7, 8, 9, 10, 11, 12, 13, 16}));
+        a.erase(3, 3);
+        EXPECT_EQ(a.size(), 9);
+        EXPECT_THROW(a.erase(5, 10), std::range_error);
+        EXPECT_THROW(a.erase(-1, 2), std::range_error);
+        EXPECT_THROW(a.erase(4, 2), std::range_error);
+
+        TypedArray<int> b = {1, 2, 3};
+        EXPECT_EQ(contents(b), (std::vector<int>{1, 2, 3}));
+
+        // erase destroys what it removes
+        Counted::reset();
+        {
+            TypedArray<Counted> c;
+            for (int i = 0; i < 20; i++) {
+                c.push_front(Counted(i));
+            }
+            c.erase(2, 17);
+            EXPECT_EQ(Counted::live, 5);
+            EXPECT_EQ(c.get(1).value, 18);
+            EXPECT_EQ(c.get(2).value, 2);
+            c.clear();
+            EXPECT_EQ(Counted::live, 0);
+        }
+    }
+
+    TEST(TypedArray, ReserveAndShrink) {
+        TypedArray<double> a;
+        a.reserve(1000);
+        EXPECT_EQ(a.capacity(), 1000);
+        for (int i = 0; i < 1000; i++) {
+            a.push(i);
+        }
+        EXPECT_EQ(a.capacity(), 1000);
+        a.reserve(10);
+        EXPECT_EQ(a.capacity(), 1000);
+
+        a.erase(0, 990);
+        EXPECT_EQ(a.capacity(), 1000);
+        a.shrink_to_fit();
+        EXPECT_EQ(a.capacity(), 10);
+        EXPECT_DOUBLE_EQ(a.get(0), 990);
+        EXPECT_DOUBLE_EQ(a.get(9), 999);
+
+        // empty gives the heap buffer back, and still works after
+        a.clear();
+        a.shrink_to_fit();
+        EXPECT_TRUE(a.is_inline());
+        EXPECT_EQ(a.capacity(), TypedArray<double>::INLINE_CAPACITY);
+        a.push_front(1.5);
+        EXPECT_DOUBLE_EQ(a.get(0), 1.5);
+        TypedArray<double, 0> h;
+        h.push(1);
+        h.pop();
+        h.shrink_to_fit();
+        EXPECT_EQ(h.capacity(), 0);
+        h.push_front(2.5);
+        EXPECT_DOUBLE_EQ(h.get(0), 2.5);
+
+        // auto: a burst, then draining it gives the memory back
+        TypedArray<int> q;
+        q.set_shrink_policy(ShrinkPolicy::Auto);
+        for (int i = 0; i < 4096; i++) {
+            q.push(i);
+        }
+        int peak = q.capacity();
+        while (q.size() > 3) {
+            q.pop_front();
+        }
+        EXPECT_LE(q.capacity(), 20);
+        EXPECT_LT(q.capacity(), peak);
+        EXPECT_EQ(q.get(0), 4093);
+        EXPECT_EQ(q.get(2), 4095);
+    }
+
+    static_assert(std::is_same<std::iterator_traits<TypedArray<int>::iterator>::iterator_category,
+                               std::random_access_iterator_tag>::value, "");
+#if __cplusplus >= 202002L
+    static_assert(std::ranges::random_access_range<TypedArray<int>>);
+    static_assert(std::ranges::sized_range<const TypedArray<double>>);
+#endif
+
+    TEST(TypedArray, Iterators) {
+        // wrapped: 4 5 6 sit at the end of the buffer, 7 8 9 at the start
+        TypedArray<int> a;
+        for (int i = 9; i >= 4; i--) {
+            a.push_front(i);
+        }
+        for (int i = 10; i < 14; i++) {
+            a.push(i);
+        }
+        EXPECT_EQ(std::accumulate(a.begin(), a.end(), 0), 85);
+        EXPECT_EQ(a.end() - a.begin(), 10);
+        EXPECT_EQ(a.begin()[3], 7);
+        EXPECT_EQ(*(a.end() - 1), 13);
+        EXPECT_EQ(*a.rbegin(), 13);
+
+        std::sort(a.begin(), a.end(), std::greater<int>());
+        EXPECT_EQ(contents(a), (std::vector<int>{13, 12, 11, 10, 9, 8, 7, 6, 5, 4}));
+        EXPECT_TRUE(std::is_sorted(a.rbegin(), a.rend()));
+        EXPECT_EQ(std::find(a.begin(), a.end(), 7) - a.begin(), 6);
+
+        // const and range for
+        const TypedArray<int>& c = a;
+        TypedArray<int>::const_iterator it = a.begin();
+        EXPECT_EQ(*it, 13);
+        int sum = 0;
+        for (int x : c) {
+            sum += x;
+        }
+        EXPECT_EQ(sum, 85);
+        for (int& x : a) {
+            x *= 2;
+        }
+        EXPECT_EQ(a[9], 8);
+
+        // data unwraps, after that it is a plain array
+        TypedArray<int> w;
+        w.push(2);
+        w.push(3);
+        w.push_front(1);
+        int* p = w.data();
+        EXPECT_EQ(p[0], 1);
+        EXPECT_EQ(p[2], 3);
+        EXPECT_EQ(std::vector<int>(p, p + w.size()), contents(w));
+
+        std::ostringstream out;
+        out << w << " " << TypedArray<int>();
+        EXPECT_EQ(out.str(), "[1,2,3] []");
+
+        // concat across wrapped arrays, and onto itself
+        TypedArray<int> joined = w.concat(a);
+        EXPECT_EQ(joined.size(), 13);
+        EXPECT_EQ(joined[3], 26);
+        TypedArray<int> twice = std::move(joined).concat(w);
+        twice = std::move(twice).concat(twice);
+        EXPECT_EQ(twice.size(), 32);
+        EXPECT_EQ(twice[16], 1);
+        EXPECT_EQ(twice[31], 3);
+    }
+
+    TEST(TypedArray, SmallBuffer) {
+        // the inline buffer costs its bytes and nothing else
+        EXPECT_EQ(sizeof(TypedArray<double, 8>), sizeof(TypedArray<double, 0>) + 8 * sizeof(double));
+        EXPECT_EQ(TypedArray<char>::INLINE_CAPACITY, 64);
+        EXPECT_EQ(TypedArray<double>::INLINE_CAPACITY, 8);
+
+        TypedArray<int, 4> a;
+        EXPECT_TRUE(a.is_inline());
+        EXPECT_EQ(a.capacity(), 4);
+        a.push(2);
+        a.push(3);
+        a.push_front(1);  // wraps inside the inline buffer
+        EXPECT_TRUE(a.is_inline());
+        EXPECT_EQ(contents(a), (std::vector<int>{1, 2, 3}));
+        int* p = a.data();
+        EXPECT_EQ(p[0], 1);
+        EXPECT_EQ(p[2], 3);
+        EXPECT_TRUE(a.is_inline());
+
+        // fifth element spills to the heap, shrinking brings it back
+        a.append({4, 5});
+        EXPECT_FALSE(a.is_inline());
+        a.erase(1, 3);
+        a.shrink_to_fit();
+        EXPECT_TRUE(a.is_inline());
+        EXPECT_EQ(contents(a), (std::vector<int>{1, 4, 5}));
+
+        // copies of short arrays stay inline too
+        TypedArray<int, 4> b(a);
+        EXPECT_TRUE(b.is_inline());
+        EXPECT_EQ(contents(b), contents(a));
+
+        // moving an inline array moves the elements, the source is empty
+        // but usable
+        Counted::reset();
+        {
+            TypedArray<Counted, 4> small;
+            small.push(Counted(1));
+            small.push(Counted(2));
+            int before = Counted::moves;
+            TypedArray<Counted, 4> moved(std::move(small));
+            EXPECT_EQ(Counted::moves - before, 2);
+            EXPECT_EQ(small.size(), 0);
+            EXPECT_TRUE(small.is_inline());
+            EXPECT_EQ(Counted::live, 2);
+            EXPECT_EQ(moved.get(1).value, 2);
+            small.push(Counted(3));
+
+            // inline with heap, both ways
+            TypedArray<Counted, 4> big;
+            for (int i = 0; i < 10; i++) {
+                big.push(Counted(100 + i));
+            }
+            swap(moved, big);
+            EXPECT_EQ(moved.size(), 10);
+            EXPECT_FALSE(moved.is_inline());
+            EXPECT_EQ(big.size(), 2);
+            EXPECT_TRUE(big.is_inline());
+            EXPECT_EQ(big.get(0).value, 1);
+            big = std::move(moved);
+            EXPECT_EQ(big.size(), 10);
+            EXPECT_EQ(big.get(9).value, 109);
+            EXPECT_EQ(Counted::live, 11);
+        }
+        EXPECT_EQ(Counted::live, 0);
+    }
+
+    TEST(TypedArray, Algorithms) {
+        // wrapped around the end of the buffer: 1..6 at the back, 0 and
+        // -1 in the last slots
+        TypedArray<int, 0> a;
+        a.append({1, 2, 3, 4, 5, 6});
+        a.push_front(0);
+        a.push_front(-1);
+        EXPECT_EQ(a.size(), 8);
+
+        TypedArray<double> halves = a.map([](int x) { return x / 2.0; });
+        EXPECT_DOUBLE_EQ(halves[0], -0.5);
+        EXPECT_DOUBLE_EQ(halves[7], 3.0);
+        TypedArray<std::string> names = a.map([](int x) { return std::to_string(x); });
+        EXPECT_EQ(names.size(), 8);
+        EXPECT_EQ(names[1], "0");
+
+        EXPECT_EQ(contents(a.filter([](int x) { return x % 2 == 0; })), (std::vector<int>{0, 2, 4, 6}));
+        EXPECT_EQ(a.filter([](int x) { return x > 100; }).size(), 0);
+
+        EXPECT_EQ(a.reduce(0), 20);
+        EXPECT_EQ(a.reduce(1, [](int x, int y) { return std::max(x, y); }), 6);
+        EXPECT_EQ(TypedArray<int>().reduce(7), 7);
+
+        EXPECT_EQ(a.find(-1), 0);
+        EXPECT_EQ(a.find(6), 7);
+        EXPECT_EQ(a.find(42), -1);
+        EXPECT_EQ(a.find_if([](int x) { return x > 2; }), 4);
+
+        a.sort(std::greater<>());
+        EXPECT_EQ(contents(a), (std::vector<int>{6, 5, 4, 3, 2, 1, 0, -1}));
+        a.reverse();
+        EXPECT_EQ(contents(a), (std::vector<int>{-1, 0, 1, 2, 3, 4, 5, 6}));
+        a.pop();
+        a.reverse();
+        EXPECT_EQ(contents(a), (std::vector<int>{5, 4, 3, 2, 1, 0, -1}));
+
+        // blocked find across several blocks
+        TypedArray<double> d;
+        for (int i = 0; i < 1000; i++) {
+            d.push(i * 0.5);
+        }
+        EXPECT_EQ(d.find(499.5), 999);
+        EXPECT_EQ(d.find(100.0), 200);
+        EXPECT_EQ(d.find(0.25), -1);
+
+        // trivially copyable concat is a memcpy, the rest still copies
+        TypedArray<std::string> s1 = {"a", "b"}, s2 = {"c"};
+        EXPECT_EQ(contents(s1 + s2), (std::vector<std::string>{"a", "b", "c"}));
+    }
+
+    TEST(TypedArray, ParallelAlgorithms) {
+        // big enough for four pieces, and wrapped
+        parallel::ScopedThreads threads(4);
+        const int n = 4 * int(parallel::ELEMENTWISE_GRAIN) + 123;
+        TypedArray<int> a;
+        for (int i = 0; i < n / 2; i++) {
+            a.push(int((i * 7919LL) % n));
+            a.push_front(int((i * 104729LL + 13) % n));
+        }
+        std::vector<int> ref = contents(a);
+
+        std::vector<long long> doubled;
+        for (int x : ref) {
+            doubled.push_back(2LL * x);
+        }
+        EXPECT_EQ(contents(a.map([](int x) { return 2LL * x; })), doubled);
+
+        std::vector<int> odd;
+        std::copy_if(ref.begin(), ref.end(), std::back_inserter(odd), [](int x) { return x % 2 == 1; });
+        EXPECT_EQ(contents(a.filter([](int x) { return x % 2 == 1; })), odd);
+
+        EXPECT_EQ(a.reduce(0LL), std::accumulate(ref.begin(), ref.end(), 0LL));
+
+        // the first match wins even when a later piece finds one first
+        int target = ref[n / 2 + 5];
+        EXPECT_EQ(a.find(target), int(std::find(ref.begin(), ref.end(), target) - ref.begin()));
+        EXPECT_EQ(a.find(-5), -1);
+        EXPECT_EQ(a.find_if([](int x) { return x == 0; }),
+                  int(std::find(ref.begin(), ref.end(), 0) - ref.begin()));
+
+        TypedArray<int> r(a);
+        r.reverse();
+        EXPECT_EQ(contents(r), std::vector<int>(ref.rbegin(), ref.rend()));
+
+        a.sort();
+        std::sort(ref.begin(), ref.end());
+        EXPECT_EQ(contents(a), ref);
+
+        // uneven float sums stay close to the serial one
+        TypedArray<double> d;
+        for (int i = 0; i < n; i++) {
+            d.push(1.0 / (i + 1));
+        }
+        double serial = 0;
+        for (double x : d) {
+            serial += x;
+        }
+        EXPECT_NEAR(d.reduce(0.0), serial, 1e-12);
+    }
+
+    // counts what goes through it, on top of new/delete
+    struct CountingResource : std::pmr::memory_resource {
+        int allocations = 0, deallocations = 0;
+        size_t outstanding = 0;
+
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            allocations++;
+            outstanding += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            deallocations++;
+            outstanding -= bytes;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    // stateful allocator that goes along with copies, moves and swaps
+    template <typename T>
+    struct TaggedAllocator {
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        int tag;
+
+        explicit TaggedAllocator(int tag = 0) : tag(tag) {}
+        template <typename U>
+        TaggedAllocator(const TaggedAllocator<U>& other) : tag(other.tag) {}
+
+        T* allocate(size_t n) { return std::allocator<T>().allocate(n); }
+        void deallocate(T* p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+        template <typename U>
+        bool operator==(const TaggedAllocator<U>& other) const { return tag == other.tag; }
+        template <typename U>
+        bool operator!=(const TaggedAllocator<U>& other) const { return tag != other.tag; }
+    };
+
+    TEST(TypedArray, PushFrontOwnElement) {
+        // full array, so push_front has to grow while value still points
+        // into the old buffer
+        TypedArray<std::string, 0> a;
+        for (int i = 0; i < 10; i++) {
+            a.push(std::string(32, char('a' + i)));
+        }
+        while (a.size() < a.capacity()) {
+            a.push("filler");
+        }
+        int n = a.size();
+        a.push_front(a[0]);
+        EXPECT_EQ(a.size(), n + 1);
+        EXPECT_EQ(a[0], std::string(32, 'a'));
+        EXPECT_EQ(a[1], std::string(32, 'a'));
+    }
+
+    TEST(TypedArray, MemoryResource) {
+        CountingResource counting;
+        {
+            pmr::TypedArray<int, 0> a(&counting);
+            for (int i = 0; i < 100; i++) {
+                a.push(i);
+            }
+            EXPECT_GT(counting.allocations, 0);
+            EXPECT_EQ(a.get_allocator().resource(), &counting);
+
+            // a copy doesnt take the resource along unless asked to
+            pmr::TypedArray<int, 0> copy(a);
+            EXPECT_EQ(copy.get_allocator().resource(), std::pmr::get_default_resource());
+            pmr::TypedArray<int, 0> copy_here(a, &counting);
+            EXPECT_EQ(contents(copy_here), contents(a));
+
+            // moving steals the buffer and the resource with it
+            int before = counting.allocations;
+            pmr::TypedArray<int, 0> moved(std::move(copy_here));
+            EXPECT_EQ(counting.allocations, before);
+            EXPECT_EQ(moved.get_allocator().resource(), &counting);
+            EXPECT_EQ(moved.size(), 100);
+
+            // different resources dont propagate on move assignment, the
+            // elements move over into the target's resource
+            copy = std::move(moved);
+            EXPECT_EQ(copy.get_allocator().resource(), std::pmr::get_default_resource());
+            EXPECT_EQ(copy.size(), 100);
+            EXPECT_EQ(moved.size(), 0);
+
+            // whatever the algorithms build lands in the same resource
+            auto halves = a.map([](int x) { return x / 2.0; });
+            EXPECT_EQ(halves.get_allocator().resource(), &counting);
+            EXPECT_EQ(a.filter([](int x) { return x < 10; }).get_allocator().resource(), &counting);
+            EXPECT_DOUBLE_EQ(halves[99], 49.5);
+        }
+        EXPECT_EQ(counting.outstanding, 0u);
+        EXPECT_EQ(counting.allocations, counting.deallocations);
+
+        // a request's worth of arrays out of one arena, short ones never
+        // touch it
+        char block[1 << 14];
+        std::pmr::monotonic_buffer_resource arena(block, sizeof(block), &counting);
+        int before = counting.allocations;
+        {
+            std::vector<pmr::TypedArray<int>> arrays;
+            for (int i = 0; i < 50; i++) {
+                arrays.emplace_back(&arena);
+                for (int j = 0; j < i; j++) {
+                    arrays.back().push(j);
+                }
+            }
+            EXPECT_TRUE(arrays[3].is_inline());
+            EXPECT_FALSE(arrays[40].is_inline());
+            EXPECT_EQ(arrays[49].reduce(0), 49 * 48 / 2);
+        }
+        arena.release();
+        EXPECT_EQ(counting.outstanding, 0u);
+        EXPECT_EQ(counting.allocations, before);  // all of it fit in block
+    }
+
+    // like the pmr arenas it must only be used by one thread at a time,
+    // and notices when it isnt
+    struct SingleThreadResource : std::pmr::memory_resource {
+        std::atomic<bool> busy{false};
+        std::atomic<int> overlaps{0};
+
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            enter();
+            void* p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            leave();
+            return p;
+        }
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            enter();
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+            leave();
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+        void enter() {
+            if (busy.exchange(true)) {
+                overlaps++;
+            }
+            std::this_thread::yield();
+        }
+        void leave() { busy = false; }
+    };
+
+    TEST(TypedArray, SmallBufferNeverAllocates) {
+        // wrapped short arrays get unwrapped inside the inline buffer,
+        // data(), sort() and reverse() never go to the allocator
+        CountingResource counting;
+        pmr::TypedArray<int, 4> a(&counting);
+        a.push(2);
+        a.push(3);
+        a.push_front(1);
+        EXPECT_EQ(a.data()[2], 3);
+        a.push_front(0);  // full and wrapped
+        a.reverse();
+        a.push_front(a.pop());
+        a.sort();
+        EXPECT_EQ(contents(a), (std::vector<int>{0, 1, 2, 3}));
+        EXPECT_EQ(counting.allocations, 0);
+
+        // same for elements that have to be moved one at a time
+        pmr::TypedArray<std::string, 4> words(&counting);
+        for (int head = 0; head < 4; head++) {
+            words = pmr::TypedArray<std::string, 4>(&counting);
+            for (int i = 0; i < 3; i++) {
+                words.push(std::string(40, char('b' + i)));
+            }
+            for (int i = 0; i < head; i++) {
+                words.push(words.pop_front());
+            }
+            words.push_front(std::string(40, 'a'));
+            words.sort();
+            EXPECT_EQ(words.data()[0], std::string(40, 'a'));
+            EXPECT_EQ(words.data()[3], std::string(40, 'd'));
+        }
+        EXPECT_EQ(counting.allocations, 0);
+    }
+
+    TEST(TypedArray, ParallelAlgorithmsMemoryResource) {
+        parallel::ScopedThreads threads(4);
+        SingleThreadResource resource;
+        {
+            pmr::TypedArray<int, 0> a(&resource);
+            int n = 1 << 20;
+            a.reserve(n);
+            for (int i = 0; i < n; i++) {
+                a.push(int((i * 7919LL) % n));
+            }
+            auto even = a.filter([](int x) { return x % 2 == 0; });
+            EXPECT_EQ(even.size(), n / 2);
+            EXPECT_EQ(even.get_allocator().resource(), &resource);
+            for (int i = 0; i < 100; i++) {
+                EXPECT_EQ(even[i] % 2, 0);
+            }
+            auto doubled = a.map([](int x) { return 2.0 * x; });
+            EXPECT_EQ(doubled.size(), n);
+            a.sort();
+            EXPECT_EQ(a[n - 1], n - 1);
+            EXPECT_EQ(a.reduce(0LL), (long long)n * (n - 1) / 2);
+        }
+        EXPECT_EQ(resource.overlaps, 0);
+
+        // filter of a type that isnt trivially copyable
+        pmr::TypedArray<std::string, 0> words(&resource);
+        for (int i = 0; i < 100000; i++) {
+            words.push(std::to_string(i));
+        }
+        auto sevens = words.filter([](const std::string& w) { return w.back() == '7'; });
+        EXPECT_EQ(sevens.size(), 10000);
+        EXPECT_EQ(sevens[3], "37");
+        EXPECT_EQ(resource.overlaps, 0);
+    }
+
+    TEST(TypedArray, PropagatingAllocator) {
+        using Tagged = TypedArray<int, 2, TaggedAllocator<int>>;
+        Tagged a(TaggedAllocator<int>(1)), b(TaggedAllocator<int>(2));
+        a.append({1, 2, 3, 4});
+        b.append({5, 6, 7});
+        EXPECT_EQ(sizeof(TypedArray<int, 0>), sizeof(TypedArray<int, 0, std::allocator<int>>));
+
+        Tagged c(TaggedAllocator<int>(3));
+        c = a;
+        EXPECT_EQ(c.get_allocator().tag, 1);
+        EXPECT_EQ(contents(c), contents(a));
+
+        swap(a, b);
+        EXPECT_EQ(a.get_allocator().tag, 2);
+        EXPECT_EQ(b.get_allocator().tag, 1);
+        EXPECT_EQ(contents(a), (std::vector<int>{5, 6, 7}));
+
+        c = std::move(a);
+        EXPECT_EQ(c.get_allocator().tag, 2);
+        EXPECT_EQ(contents(c), (std::vector<int>{5, 6, 7}));
+
+        // different allocator passed to the move constructor, one by one
+        Tagged d(std::move(b), TaggedAllocator<int>(9));
+        EXPECT_EQ(d.get_allocator().tag, 9);
+        EXPECT_EQ(contents(d), (std::vector<int>{1, 2, 3, 4}));
+        EXPECT_EQ(b.size(), 0);
+    }
+
     /* ======= Matrix tests ======= */
 
     TEST(Matrix, Constructors) {
@@ -151,6 +888,28 @@ namespace {
         EXPECT_DOUBLE_EQ(A(1, 1), 4.0);
     }
 
+    TEST(Matrix, MoveSemantics) {
+        Matrix A = {{1, 2}, {3, 4}};
+        const double* storage = &A(0, 0);
+
+        // the buffer itself gets handed over, nothing is copied
+        Matrix B(std::move(A));
+        EXPECT_EQ(&B(0, 0), storage);
+        EXPECT_TRUE(A.isEmpty());
+        EXPECT_EQ(A.rows(), 0);
+
+        Matrix C;
+        C = std::move(B);
+        EXPECT_EQ(&C(0, 0), storage);
+        EXPECT_DOUBLE_EQ(C(1, 0), 3.0);
+        EXPECT_TRUE(B.isEmpty());
+
+        Matrix D(3, 1, 5.0);
+        swap(C, D);
+        EXPECT_EQ(C.rows(), 3);
+        EXPECT_EQ(&D(0, 0), storage);
+    }
+
     TEST(Matrix, BoundsChecking) {
         Matrix m(2, 2);
         EXPECT_THROW(m.at(5, 0), std::out_of_range);
@@ -264,6 +1023,31 @@ namespace {
         EXPECT_TRUE(A == A.transpose().transpose());
     }
 
+    TEST(Matrix, BlockedTranspose) {
+        // big and odd enough to go through several levels of recursion
+        Matrix A(150, 77);
+        fill_pattern(A, 11);
+        Matrix T = A.transpose();
+        EXPECT_EQ(T.rows(), 77);
+        EXPECT_EQ(T.cols(), 150);
+        for (size_t r = 0; r < A.rows(); r++) {
+            for (size_t c = 0; c < A.cols(); c++) {
+                EXPECT_DOUBLE_EQ(T(c, r), A(r, c));
+            }
+        }
+
+        // in place, square
+        Matrix S(101, 101);
+        fill_pattern(S, 12);
+        Matrix expected = S.transpose();
+        S.transpose_in_place();
+        EXPECT_TRUE(S == expected);
+
+        // in place, non square falls back to a copy
+        A.transpose_in_place();
+        EXPECT_TRUE(A == T);
+    }
+
     TEST(Matrix, TraceAndDiagonal) {
         Matrix A = {{1, 2}, {3, 4}};
         EXPECT_NEAR(A.trace(), 5.0, 0.001);
@@ -337,4 +1121,1096 @@ namespace {
         EXPECT_TRUE(res == A);
     }
 
+    TEST(Matrix, BlockedMultiplyMatchesNaive) {
+        // sizes chosen so none of them line up with the tile sizes and
+        // k spans more than one KC block
+        Matrix A(101, 301);
+        Matrix B(301, 67);
+        fill_pattern(A, 1);
+        fill_pattern(B, 2);
+
+        Matrix expected(101, 67);
+        gemm::multiply_naive(101, 67, 301, 1.0, &A(0, 0), 301, &B(0, 0), 67,
+                             0.0, &expected(0, 0), 67);
+        EXPECT_TRUE(A * B == expected);
+    }
+
+    TEST(Matrix, GemmAlphaBetaOnSubBlock) {
+        Matrix A(9, 9), B(9, 9), C(9, 9, 1.0), D(9, 9, 1.0);
+        fill_pattern(A, 3);
+        fill_pattern(B, 4);
+
+        // C[1:6, 2:9] = -1 * A[1:6, 0:5] * B[0:5, 2:9] + 2 * C[1:6, 2:9]
+        gemm::multiply(5, 7, 5, -1.0, &A(1, 0), 9, &B(0, 2), 9, 2.0, &C(1, 2), 9);
+        gemm::multiply_naive(5, 7, 5, -1.0, &A(1, 0), 9, &B(0, 2), 9, 2.0, &D(1, 2), 9);
+        EXPECT_TRUE(C == D);
+        // stuff outside the block should be untouched
+        EXPECT_DOUBLE_EQ(C(0, 0), 1.0);
+        EXPECT_DOUBLE_EQ(C(8, 8), 1.0);
+        EXPECT_DOUBLE_EQ(C(1, 1), 1.0);
+    }
+
+    /* ======= FixedMatrix tests ======= */
+
+    // can_add<A, B>::value is true if A + B compiles
+    template <typename A, typename B, typename = void>
+    struct can_add : std::false_type {};
+    template <typename A, typename B>
+    struct can_add<A, B, decltype(void(std::declval<A>() + std::declval<B>()))> : std::true_type {};
+
+    template <typename A, typename B, typename = void>
+    struct can_multiply : std::false_type {};
+    template <typename A, typename B>
+    struct can_multiply<A, B, decltype(void(std::declval<A>() * std::declval<B>()))> : std::true_type {};
+
+    TEST(FixedMatrix, CompileTime) {
+        constexpr Matrix2 A = {{1, 2}, {3, 4}};
+        constexpr Matrix2 B = A * A + Matrix2::identity();
+        static_assert(B(0, 0) == 8.0, "1*1 + 2*3 + 1");
+        static_assert(B(1, 1) == 23.0, "3*2 + 4*4 + 1");
+        static_assert(A.transpose()(0, 1) == 3.0, "transpose");
+        static_assert(A.trace() == 5.0, "trace");
+        static_assert(sizeof(Matrix4) == 16 * sizeof(double), "no heap, no extra members");
+
+        // sizes that dont fit together dont compile
+        static_assert(can_add<Matrix3, Matrix3>::value, "");
+        static_assert(!can_add<FixedMatrix<2, 3>, FixedMatrix<3, 2>>::value, "");
+        static_assert(can_multiply<FixedMatrix<2, 3>, FixedMatrix<3, 4>>::value, "");
+        static_assert(!can_multiply<FixedMatrix<2, 3>, FixedMatrix<2, 3>>::value, "");
+    }
+
+    TEST(FixedMatrix, Arithmetic) {
+        FixedMatrix<2, 3> A = {{1, 2, 3}, {4, 5, 6}};
+        FixedMatrix<3, 2> B = A.transpose();
+        FixedMatrix<2, 2> C = A * B;
+        EXPECT_DOUBLE_EQ(C(0, 0), 14.0);
+        EXPECT_DOUBLE_EQ(C(0, 1), 32.0);
+        EXPECT_DOUBLE_EQ(C(1, 1), 77.0);
+
+        FixedMatrix<2, 3> D = 2.0 * A - A / 2.0;
+        EXPECT_DOUBLE_EQ(D(1, 2), 9.0);
+        D += A;
+        D *= 2.0;
+        EXPECT_DOUBLE_EQ(D(0, 0), 5.0);
+        EXPECT_TRUE(-A + A == (FixedMatrix<2, 3>::zeros()));
+        EXPECT_NEAR(Matrix2::ones().norm(), 2.0, 1e-12);
+        EXPECT_THROW(A.at(2, 0), std::out_of_range);
+
+        Matrix3 M = {{2, 0, 0}, {0, 3, 0}};
+        M *= Matrix3::identity();
+        EXPECT_DOUBLE_EQ(M.diagonal()(1, 0), 3.0);
+        EXPECT_DOUBLE_EQ(M(2, 2), 0.0);
+    }
+
+    TEST(FixedMatrix, DynamicInterop) {
+        Matrix A = {{1, 2}, {3, 4}};
+        Matrix2 F(A);
+        EXPECT_DOUBLE_EQ(F(1, 0), 3.0);
+        EXPECT_THROW(Matrix3 bad(A), std::invalid_argument);
+
+        Matrix back = (F * F).to_matrix();
+        EXPECT_TRUE(back == A * A);
+
+        // views over the fixed storage work with the dynamic operators
+        Matrix sum = F.view() + A;
+        EXPECT_DOUBLE_EQ(sum(1, 1), 8.0);
+        F.view() = A * 10.0;
+        EXPECT_DOUBLE_EQ(F(0, 1), 20.0);
+
+        // and a block of a big matrix can be pulled into a fixed one
+        Matrix big(5, 5, 1.0);
+        Matrix3 corner(big.block(2, 2, 3, 3));
+        EXPECT_DOUBLE_EQ(corner.trace(), 3.0);
+    }
+
+    /* ======= LU / Cholesky tests ======= */
+
+    TEST(LU, SmallSystem) {
+        Matrix A = {{2, 1, 1}, {4, -6, 0}, {-2, 7, 2}};
+        Matrix b = {{5}, {-2}, {9}};
+        Matrix x = A.solve(b);
+        EXPECT_NEAR(x(0, 0), 1.0, 1e-12);
+        EXPECT_NEAR(x(1, 0), 1.0, 1e-12);
+        EXPECT_NEAR(x(2, 0), 2.0, 1e-12);
+        EXPECT_NEAR(A.determinant(), -16.0, 1e-12);
+
+        // needs a row swap right away
+        Matrix P = {{0, 1}, {1, 0}};
+        EXPECT_NEAR(P.determinant(), -1.0, 1e-12);
+        EXPECT_TRUE(P.inverse() == P);
+    }
+
+    TEST(LU, BlockedMatchesProduct) {
+        // bigger than a couple of panels, and diagonally dominant so its
+        // well conditioned
+        size_t n = 150;
+        Matrix A(n, n);
+        fill_pattern(A, 15);
+        for (size_t i = 0; i < n; i++) {
+            A(i, i) += n;
+        }
+        LU lu(A);
+        EXPECT_FALSE(lu.isSingular());
+
+        Matrix B(n, 3);
+        fill_pattern(B, 16);
+        Matrix X = lu.solve(B);
+        EXPECT_TRUE(A * X == B);
+        EXPECT_TRUE(A * lu.inverse() == Matrix::identity(n));
+    }
+
+    TEST(LU, SingularAndErrors) {
+        Matrix S = {{1, 2}, {2, 4}};
+        LU lu(S);
+        EXPECT_TRUE(lu.isSingular());
+        EXPECT_DOUBLE_EQ(S.determinant(), 0.0);
+        EXPECT_THROW(S.inverse(), std::runtime_error);
+        EXPECT_THROW(Matrix(2, 3).determinant(), std::logic_error);
+        EXPECT_THROW(Matrix::identity(2).solve(Matrix(3, 1)), std::invalid_argument);
+    }
+
+    TEST(Cholesky, Spd) {
+        Matrix A = {{4, 12, -16}, {12, 37, -43}, {-16, -43, 98}};
+        Cholesky chol(A);
+        Matrix L = chol.factor();
+        Matrix expected = {{2, 0, 0}, {6, 1, 0}, {-8, 5, 3}};
+        EXPECT_TRUE(L == expected);
+        EXPECT_NEAR(chol.determinant(), 36.0, 1e-9);
+        EXPECT_NEAR(A.determinant(), 36.0, 1e-9);
+
+        // bigger, A = M * M^T + n*I is spd
+        size_t n = 140;
+        Matrix M(n, n);
+        fill_pattern(M, 17);
+        Matrix S = M * M.transpose();
+        for (size_t i = 0; i < n; i++) {
+            S(i, i) += n;
+        }
+        Cholesky big(S);
+        Matrix F = big.factor();
+        EXPECT_TRUE(F * F.transpose() == S);
+        Matrix b(n, 2, 1.0);
+        EXPECT_TRUE(S * big.solve(b) == b);
+
+        // several panels and update blocks, with junk above the diagonal
+        // since only the lower triangle is read
+        n = 2 * Cholesky::UPDATE_WIDTH + 3 * Cholesky::NB + 5;
+        Matrix N(n, n);
+        fill_pattern(N, 23);
+        Matrix T = N * N.transpose();
+        for (size_t i = 0; i < n; i++) {
+            T(i, i) += n;
+        }
+        Matrix junk = T;
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = i + 1; j < n; j++) {
+                junk(i, j) = -1e6;
+            }
+        }
+        Matrix G = Cholesky(junk).factor();
+        EXPECT_TRUE(G * G.transpose() == T);
+
+        EXPECT_THROW(Cholesky(Matrix({{1, 2}, {2, 1}})), std::domain_error);
+    }
+
+    /* ======= ThreadPool tests ======= */
+
+    TEST(ThreadPool, CoversRangeOnce) {
+        ThreadPool pool(3);
+        std::vector<int> hits(1000, 0);
+        pool.parallel_for(hits.size(), 4, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                hits[i]++;
+            }
+        });
+        for (int h : hits) {
+            EXPECT_EQ(h, 1);
+        }
+    }
+
+    TEST(ThreadPool, RethrowsFromWorker) {
+        ThreadPool pool(2);
+        EXPECT_THROW(pool.parallel_for(100, 3, [](size_t begin, size_t) {
+            if (begin > 0) {
+                throw std::runtime_error("boom");
+            }
+        }), std::runtime_error);
+    }
+
+    TEST(ThreadPool, ScopedThreadCount) {
+        parallel::set_num_threads(2);
+        EXPECT_EQ(parallel::num_threads(), 2);
+        {
+            parallel::ScopedThreads t(5);
+            EXPECT_EQ(parallel::num_threads(), 5);
+        }
+        EXPECT_EQ(parallel::num_threads(), 2);
+        parallel::set_num_threads(0);
+    }
+
+    TEST(Matrix, ParallelMatchesSerial) {
+        Matrix A(300, 200), B(200, 150);
+        fill_pattern(A, 5);
+        fill_pattern(B, 6);
+        EXPECT_TRUE(A.multiply(B, 4) == A.multiply(B, 1));
+
+        // big enough that the elementwise ops actually get split up
+        Matrix C(400, 400), D(400, 400);
+        fill_pattern(C, 7);
+        fill_pattern(D, 8);
+        Matrix serial_sum, parallel_sum;
+        {
+            parallel::ScopedThreads t(1);
+            serial_sum = C + D * 2.0;
+        }
+        {
+            parallel::ScopedThreads t(4);
+            parallel_sum = C + D * 2.0;
+        }
+        EXPECT_TRUE(serial_sum == parallel_sum);
+    }
+
+    TEST(Matrix, ExpressionTemplates) {
+        Matrix A = {{1, 2}, {3, 4}};
+        Matrix B = {{5, 6}, {7, 8}};
+        Matrix C = {{1, 1}, {1, 1}};
+
+        // nothing is computed until assignment
+        auto expr = A + B * 2.0 - C;
+        EXPECT_FALSE((std::is_same<decltype(expr), Matrix>::value));
+        Matrix D = expr;
+        EXPECT_DOUBLE_EQ(D(0, 0), 10.0);
+        EXPECT_DOUBLE_EQ(D(1, 1), 19.0);
+
+        // mixing in -, /, and scalar on the left
+        Matrix E = -(A / 2.0) + 3.0 * C;
+        EXPECT_DOUBLE_EQ(E(0, 0), 2.5);
+        EXPECT_DOUBLE_EQ(E(1, 1), 1.0);
+
+        // += / -= with a whole expression on the right
+        Matrix F = A;
+        F += B - C;
+        EXPECT_DOUBLE_EQ(F(0, 0), 5.0);
+        F -= A * 2.0;
+        EXPECT_DOUBLE_EQ(F(1, 1), 3.0);
+
+        // aliasing the output is fine for elementwise stuff
+        Matrix G = A;
+        G = G + G * 2.0;
+        EXPECT_DOUBLE_EQ(G(1, 0), 9.0);
+
+        // expression times a matrix gets evaluated first
+        Matrix H = (A + C) * Matrix::identity(2);
+        EXPECT_TRUE(H == A + C);
+
+        // mismatch deep in the tree still throws
+        Matrix Z(3, 3);
+        EXPECT_THROW(A + B * 2.0 - Z, std::invalid_argument);
+        EXPECT_THROW(F += Z * 2.0, std::invalid_argument);
+    }
+
+    /* ======= simd kernel tests ======= */
+
+    // run the check once for every level this cpu can do
+    template <typename Check>
+    void for_each_simd_level(Check check) {
+        simd::Level levels[] = {simd::Level::Scalar, simd::Level::AVX2, simd::Level::AVX512};
+        for (simd::Level level : levels) {
+            if (static_cast<int>(level) > static_cast<int>(simd::detected())) {
+                continue;
+            }
+            simd::set_level(level);
+            SCOPED_TRACE(simd::level_name(level));
+            check();
+        }
+        simd::set_level(simd::detected());
+    }
+
+    TEST(Simd, KernelsMatchScalar) {
+        // 37 so every kernel has a remainder to deal with
+        std::vector<double> a(37), b(37), out(37);
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = i * 0.5 - 3.0;
+            b[i] = 1.0 / (i + 1);
+        }
+        double expected_sq = 0;
+        for (double x : a) {
+            expected_sq += x * x;
+        }
+
+        for_each_simd_level([&] {
+            simd::add(a.data(), b.data(), out.data(), a.size());
+            EXPECT_DOUBLE_EQ(out[36], a[36] + b[36]);
+            simd::sub(a.data(), b.data(), out.data(), a.size());
+            EXPECT_DOUBLE_EQ(out[5], a[5] - b[5]);
+            simd::scale(a.data(), 3.0, out.data(), a.size());
+            EXPECT_DOUBLE_EQ(out[33], a[33] * 3.0);
+            simd::fill(out.data(), 2.5, out.size());
+            EXPECT_DOUBLE_EQ(out[0], 2.5);
+            EXPECT_DOUBLE_EQ(out[36], 2.5);
+            EXPECT_NEAR(simd::sum_squares(a.data(), a.size()), expected_sq, 1e-9);
+        });
+    }
+
+    TEST(Simd, AllClose) {
+        std::vector<double> a(29, 1.0), b(29, 1.0);
+        for_each_simd_level([&] {
+            EXPECT_TRUE(simd::all_close(a.data(), b.data(), a.size(), 1e-6));
+            // mismatch in the vector body and in the scalar tail
+            b[3] = 1.1;
+            EXPECT_FALSE(simd::all_close(a.data(), b.data(), a.size(), 1e-6));
+            b[3] = 1.0;
+            b[28] = 0.9;
+            EXPECT_FALSE(simd::all_close(a.data(), b.data(), a.size(), 1e-6));
+            b[28] = 1.0;
+            // same as fabs(a - b) > eps, NaN doesnt count as a mismatch
+            b[9] = NAN;
+            EXPECT_TRUE(simd::all_close(a.data(), b.data(), a.size(), 1e-6));
+            b[9] = 1.0;
+        });
+    }
+
+    TEST(Simd, SumAndFind) {
+        // 77 doubles / floats: the unrolled body, the single vector loop
+        // and a scalar tail all get used
+        std::vector<double> a(77);
+        std::vector<float> f(77);
+        double expected = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = i * 0.25 - 4.0;
+            f[i] = float(a[i]);
+            expected += a[i];
+        }
+        for_each_simd_level([&] {
+            EXPECT_NEAR(simd::sum(a.data(), a.size()), expected, 1e-12);
+            EXPECT_NEAR(simd::sum(f.data(), f.size()), expected, 1e-4);
+            EXPECT_DOUBLE_EQ(simd::sum(a.data(), 0), 0.0);
+            for (size_t i : {size_t(0), size_t(5), size_t(40), size_t(76)}) {
+                EXPECT_EQ(simd::find(a.data(), a.size(), a[i]), i);
+                EXPECT_EQ(simd::find(f.data(), f.size(), f[i]), i);
+            }
+            EXPECT_EQ(simd::find(a.data(), a.size(), 0.1), a.size());
+            EXPECT_EQ(simd::find(f.data(), f.size(), 0.1f), f.size());
+            // NaN never equals anything
+            EXPECT_EQ(simd::find(a.data(), a.size(), double(NAN)), a.size());
+        });
+    }
+
+    TEST(Matrix, SimdBackedOps) {
+        Matrix A(13, 11), B(13, 11);
+        fill_pattern(A, 9);
+        fill_pattern(B, 10);
+        for_each_simd_level([&] {
+            Matrix sum = A + B;
+            Matrix diff = A - B;
+            Matrix scaled = A * 0.5;
+            EXPECT_DOUBLE_EQ(sum(12, 10), A(12, 10) + B(12, 10));
+            EXPECT_DOUBLE_EQ(diff(4, 7), A(4, 7) - B(4, 7));
+            EXPECT_DOUBLE_EQ(scaled(6, 3), A(6, 3) * 0.5);
+            EXPECT_TRUE(A == sum - B);
+            EXPECT_FALSE(sum == A);
+        });
+    }
+
+    TEST(Matrix, Views) {
+        Matrix A = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+
+        // views read straight out of A
+        ConstMatrixView r = static_cast<const Matrix&>(A).row(1);
+        EXPECT_EQ(r.rows(), 1);
+        EXPECT_EQ(r.cols(), 3);
+        EXPECT_DOUBLE_EQ(r(0, 2), 6.0);
+        MatrixView c = A.col(2);
+        EXPECT_DOUBLE_EQ(c(2, 0), 9.0);
+        MatrixView d = A.diagonal_view();
+        EXPECT_EQ(d.rows(), 3);
+        EXPECT_DOUBLE_EQ(d(1, 0), 5.0);
+        MatrixView b = A.block(1, 1, 2, 2);
+        EXPECT_DOUBLE_EQ(b(0, 0), 5.0);
+        EXPECT_DOUBLE_EQ(b(1, 1), 9.0);
+        EXPECT_THROW(A.block(2, 2, 2, 2), std::out_of_range);
+        EXPECT_THROW(b.at(2, 0), std::out_of_range);
+
+        // writes go through to A, and views mix with matrices in expressions
+        c(0, 0) = 30;
+        EXPECT_DOUBLE_EQ(A(0, 2), 30.0);
+        A.row(0) = A.row(2) * 2.0;
+        EXPECT_DOUBLE_EQ(A(0, 0), 14.0);
+        EXPECT_DOUBLE_EQ(A(0, 2), 18.0);
+        b += Matrix::identity(2);
+        EXPECT_DOUBLE_EQ(A(1, 1), 6.0);
+        EXPECT_DOUBLE_EQ(A(2, 2), 10.0);
+        d.fill(0.0);
+        EXPECT_DOUBLE_EQ(A(1, 1), 0.0);
+        EXPECT_THROW(A.row(0) = A.col(0), std::invalid_argument);
+
+        // copying out
+        Matrix blk = A.block(0, 1, 3, 2);
+        EXPECT_EQ(blk.cols(), 2);
+        EXPECT_DOUBLE_EQ(blk(2, 0), 8.0);
+        A = A.row(2) + A.row(0);
+        EXPECT_EQ(A.rows(), 1);
+        EXPECT_DOUBLE_EQ(A(0, 0), 7.0);
+        EXPECT_DOUBLE_EQ(A(0, 1), 24.0);
+    }
+
+    TEST(Matrix, ViewProducts) {
+        Matrix A(20, 30), B(30, 25);
+        fill_pattern(A, 13);
+        fill_pattern(B, 14);
+
+        // product of two blocks without copying them out first
+        Matrix expected = Matrix(A.block(2, 3, 10, 7)) * Matrix(B.block(5, 1, 7, 12));
+        Matrix got = A.block(2, 3, 10, 7) * B.block(5, 1, 7, 12);
+        EXPECT_TRUE(got == expected);
+
+        // row times column, and mixing matrices with views
+        Matrix dot = A.row(4) * B.col(3);
+        EXPECT_EQ(dot.rows(), 1);
+        EXPECT_EQ(dot.cols(), 1);
+        EXPECT_TRUE(A * B.block(0, 0, 30, 5) == Matrix((A * B).block(0, 0, 20, 5)));
+        EXPECT_THROW(A.row(0) * A.row(0), std::invalid_argument);
+    }
+
+    TEST(MatrixAllocator, Aligned) {
+        for (size_t n = 1; n < 40; n += 3) {
+            Matrix m(n, n + 1);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(m.view().data()) % matrix_memory::ALIGNMENT, 0u);
+        }
+        Matrix p(7, 9);
+        Matrix moved = std::move(p);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(moved.view().data()) % matrix_memory::ALIGNMENT, 0u);
+    }
+
+    TEST(MatrixAllocator, PoolReusesBuffers) {
+        matrix_memory::PoolResource& pool = matrix_memory::pool();
+        pool.trim();
+        pool.reset_stats();
+        size_t outstanding = pool.stats().bytes_outstanding;
+        {
+            matrix_memory::ScopedResource use(&pool);
+            Matrix A(50, 50, 1.0), B(50, 50, 2.0);
+            EXPECT_EQ(A.resource(), &pool);
+            for (int i = 0; i < 10; i++) {
+                Matrix C = A + B;  // same size every time, so only the first one misses
+                EXPECT_DOUBLE_EQ(C(49, 49), 3.0);
+                EXPECT_EQ(reinterpret_cast<uintptr_t>(C.view().data()) % matrix_memory::ALIGNMENT, 0u);
+            }
+            matrix_memory::PoolStats stats = pool.stats();
+            EXPECT_EQ(stats.misses, 3u);
+            EXPECT_EQ(stats.hits, 9u);
+            EXPECT_EQ(stats.bytes_outstanding - outstanding, 2 * 32768u);  // A and B, 20000 bytes rounds up
+        }
+        // out of scope, new matrices go back to the default resource
+        Matrix D(4, 4);
+        EXPECT_NE(D.resource(), &pool);
+        EXPECT_EQ(pool.stats().bytes_outstanding, outstanding);
+        EXPECT_GT(pool.stats().bytes_cached, 0u);
+        pool.trim();
+        EXPECT_EQ(pool.stats().bytes_cached, 0u);
+    }
+
+    TEST(MatrixAllocator, MixingResources) {
+        matrix_memory::PoolResource& pool = matrix_memory::pool();
+        Matrix plain(10, 10, 1.0);
+        Matrix pooled;
+        {
+            matrix_memory::ScopedResource use(&pool);
+            pooled = Matrix(10, 10, 2.0);
+            // a copy takes the current resource
+            Matrix copy = plain;
+            EXPECT_EQ(copy.resource(), &pool);
+        }
+        // moves carry the buffer (and its resource) along
+        EXPECT_EQ(pooled.resource(), &pool);
+        swap(plain, pooled);
+        EXPECT_EQ(plain.resource(), &pool);
+        EXPECT_DOUBLE_EQ(plain(0, 0), 2.0);
+        EXPECT_DOUBLE_EQ(pooled(0, 0), 1.0);
+        pooled = plain;  // copy assignment keeps its own storage
+        EXPECT_NE(pooled.resource(), &pool);
+        EXPECT_TRUE(pooled == plain);
+        pool.trim();
+    }
+
+    TEST(MatrixAllocator, SeparatePools) {
+        CountingResource counting;
+        {
+            matrix_memory::PoolResource first, second(&counting);
+
+            // first gets this thread's cache going, second still caches
+            // and neither sees the other's numbers
+            first.deallocate(first.allocate(1000), 1000);
+            void* p = second.allocate(1000);
+            second.deallocate(p, 1000);
+            EXPECT_EQ(second.allocate(1000), p);
+            EXPECT_EQ(second.stats().hits, 1u);
+            EXPECT_EQ(second.stats().misses, 1u);
+            EXPECT_EQ(second.stats().bytes_outstanding, 1024u);
+            EXPECT_EQ(first.stats().misses, 1u);
+            EXPECT_EQ(first.stats().bytes_outstanding, 0u);
+            EXPECT_EQ(first.stats().bytes_cached, 1024u);
+
+            // reset_stats only zeroes the counters
+            second.reset_stats();
+            EXPECT_EQ(second.stats().hits, 0u);
+            EXPECT_EQ(second.stats().bytes_outstanding, 1024u);
+            second.deallocate(p, 1000);
+
+            // too big to pool, still counted
+            size_t big = matrix_memory::PoolResource::MAX_POOLED_BYTES + 64;
+            void* q = second.allocate(big);
+            EXPECT_EQ(second.stats().bytes_outstanding, big);
+            EXPECT_EQ(second.stats().misses, 1u);
+            second.deallocate(q, big);
+            EXPECT_EQ(second.stats().bytes_outstanding, 0u);
+
+            // a thread never caches more than MAX_CACHED_BYTES
+            size_t size = matrix_memory::PoolResource::MAX_POOLED_BYTES / 4;
+            std::vector<void*> buffers;
+            for (int i = 0; i < 8; i++) {
+                buffers.push_back(second.allocate(size));
+            }
+            for (void* b : buffers) {
+                second.deallocate(b, size);
+            }
+            EXPECT_LE(first.stats().bytes_cached + second.stats().bytes_cached,
+                      matrix_memory::PoolResource::MAX_CACHED_BYTES);
+            EXPECT_GT(second.stats().bytes_cached, 0u);
+            first.trim();
+        }
+        // destroying a pool gives back what this thread cached
+        EXPECT_EQ(counting.outstanding, 0u);
+        EXPECT_EQ(counting.allocations, counting.deallocations);
+    }
+
+    /* ======= SparseMatrix tests ======= */
+
+    TEST(SparseMatrix, Triplets) {
+        // out of order, with a duplicate that gets summed
+        SparseMatrix A(3, 4, {{2, 1, 5.0}, {0, 3, 1.0}, {0, 0, 2.0}, {2, 1, 1.0}, {1, 2, -3.0}});
+        EXPECT_EQ(A.rows(), 3);
+        EXPECT_EQ(A.cols(), 4);
+        EXPECT_EQ(A.nonZeros(), 4);
+        EXPECT_DOUBLE_EQ(A.at(2, 1), 6.0);
+        EXPECT_DOUBLE_EQ(A.at(1, 2), -3.0);
+        EXPECT_DOUBLE_EQ(A.at(1, 1), 0.0);
+        EXPECT_THROW(A.at(3, 0), std::out_of_range);
+        EXPECT_THROW(SparseMatrix(2, 2, {{2, 0, 1.0}}), std::out_of_range);
+
+        Matrix dense = {{2, 0, 0, 1}, {0, 0, -3, 0}, {0, 6, 0, 0}};
+        EXPECT_TRUE(A.to_dense() == dense);
+        EXPECT_TRUE(SparseMatrix(dense) == A);
+
+        std::vector<SparseMatrix::Triplet> t = A.to_csc().triplets();
+        ASSERT_EQ(t.size(), 4u);
+        EXPECT_EQ(t[1].row, 0u);
+        EXPECT_EQ(t[1].col, 3u);
+        EXPECT_EQ(A.outer_index(), std::vector<size_t>({0, 2, 3, 4}));
+        EXPECT_EQ(A.inner_index(), std::vector<size_t>({0, 3, 2, 1}));
+    }
+
+    TEST(SparseMatrix, FormatsAndTranspose) {
+        Matrix dense(30, 20);
+        fill_pattern(dense, 3);
+        for (size_t r = 0; r < 30; r++) {
+            for (size_t c = 0; c < 20; c++) {
+                if ((r * 7 + c * 3) % 5 != 0) {
+                    dense(r, c) = 0.0;
+                }
+            }
+        }
+        SparseMatrix csr(dense), csc(dense, SparseMatrix::Format::CSC);
+        EXPECT_EQ(csc.format(), SparseMatrix::Format::CSC);
+        EXPECT_EQ(csc.outer_index().size(), 21u);
+        EXPECT_EQ(csr.nonZeros(), csc.nonZeros());
+        EXPECT_TRUE(csr == csc);
+        EXPECT_TRUE(csc.to_csr() == csr);
+        EXPECT_TRUE(csc.to_dense() == dense);
+
+        SparseMatrix t = csr.transpose();
+        EXPECT_EQ(t.rows(), 20);
+        EXPECT_EQ(t.format(), SparseMatrix::Format::CSC);
+        EXPECT_TRUE(t.to_dense() == dense.transpose());
+        EXPECT_TRUE(t.to_csr().to_dense() == dense.transpose());
+        EXPECT_TRUE((csr * 2.0).to_dense() == dense * 2.0);
+        EXPECT_TRUE(csr != csr * 2.0);
+    }
+
+    TEST(SparseMatrix, Products) {
+        // a few dense rows so the row partitioning actually has to balance
+        std::vector<SparseMatrix::Triplet> t;
+        size_t n = 600;
+        for (size_t r = 0; r < n; r++) {
+            t.push_back({r, (r * 13) % n, 1.0 + r % 7});
+            t.push_back({r, (r * 29 + 5) % n, -0.5});
+            if (r % 100 == 0) {
+                for (size_t c = 0; c < n; c += 2) {
+                    t.push_back({r, c, 0.25});
+                }
+            }
+        }
+        SparseMatrix A(n, n, t);
+        Matrix dense = A.to_dense();
+        Matrix X(n, 40);
+        fill_pattern(X, 9);
+        Matrix expected = dense * X;
+
+        for (size_t threads : {1, 4}) {
+            EXPECT_TRUE(A.multiply(X, threads) == expected);
+            EXPECT_TRUE(A.to_csc().multiply(X, threads) == expected);
+        }
+        EXPECT_TRUE(A * X.block(0, 3, n, 10) == Matrix(expected.block(0, 3, n, 10)));
+
+        std::vector<double> x(n), y;
+        for (size_t i = 0; i < n; i++) {
+            x[i] = X(i, 0);
+        }
+        y = A * x;
+        std::vector<double> ycsc = A.to_csc() * x;
+        for (size_t i = 0; i < n; i++) {
+            EXPECT_NEAR(y[i], expected(i, 0), 1e-9);
+            EXPECT_NEAR(ycsc[i], expected(i, 0), 1e-9);
+        }
+
+        // every piece gets roughly the same number of non-zeros
+        std::vector<size_t> bounds = A.partition(4);
+        ASSERT_EQ(bounds.size(), 5u);
+        EXPECT_EQ(bounds.front(), 0u);
+        EXPECT_EQ(bounds.back(), n);
+        for (size_t p = 0; p < 4; p++) {
+            size_t nnz = A.outer_index()[bounds[p + 1]] - A.outer_index()[bounds[p]];
+            EXPECT_LT(nnz, A.nonZeros() / 2);
+        }
+
+        EXPECT_THROW(A * Matrix(n + 1, 2), std::invalid_argument);
+        EXPECT_THROW(A * std::vector<double>(3), std::invalid_argument);
+    }
+
+    /* ======= matrix_io tests ======= */
+
+    // overwrite bytes of a file in place
+    void patch_file(const std::string& path, size_t offset, const char* bytes, size_t n) {
+        std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+        f.seekp(offset);
+        f.write(bytes, n);
+    }
+
+    TEST(MatrixIO, SaveAndLoad) {
+        std::string path = testing::TempDir() + "matrix_io_roundtrip.bin";
+        Matrix A(37, 53);
+        fill_pattern(A, 21);
+        matrix_io::save(path, A);
+
+        Matrix B = matrix_io::load(path);
+        EXPECT_TRUE(A == B);
+
+        matrix_io::MappedMatrix mapped(path, true);
+        EXPECT_EQ(mapped.rows(), 37);
+        EXPECT_EQ(mapped.cols(), 53);
+        EXPECT_TRUE(mapped.verify());
+        ConstMatrixView v = mapped.view();
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(v.data()) % 64, 0u);
+        EXPECT_DOUBLE_EQ(v(36, 52), A(36, 52));
+        // works anywhere a view does
+        EXPECT_TRUE(Matrix(mapped.view() * 2.0) == A * 2.0);
+        EXPECT_TRUE(A.transpose() * mapped.view() == A.transpose() * A);
+
+        // a strided block, and a bigger alignment
+        matrix_io::save(path, A.block(3, 4, 10, 7), 4096);
+        matrix_io::MappedMatrix block(path);
+        EXPECT_EQ(block.header().payload_offset, 4096u);
+        EXPECT_TRUE(Matrix(block.view()) == Matrix(A.block(3, 4, 10, 7)));
+
+        matrix_io::MappedMatrix moved = std::move(block);
+        EXPECT_EQ(moved.rows(), 10);
+        EXPECT_THROW(block.view(), std::logic_error);
+
+        matrix_io::save(path, Matrix());
+        EXPECT_TRUE(matrix_io::load(path).isEmpty());
+        std::remove(path.c_str());
+    }
+
+    TEST(MatrixIO, RejectsBadFiles) {
+        std::string path = testing::TempDir() + "matrix_io_bad.bin";
+        EXPECT_THROW(matrix_io::MappedMatrix(path + ".missing"), std::runtime_error);
+        EXPECT_THROW(matrix_io::save(path, Matrix(2, 2), 12), std::invalid_argument);
+
+        Matrix A(8, 8, 1.5);
+        matrix_io::save(path, A);
+
+        // flip a byte of the payload, the header is still fine
+        patch_file(path, 64 + 100, "x", 1);
+        matrix_io::MappedMatrix mapped(path);
+        EXPECT_FALSE(mapped.verify());
+        EXPECT_THROW(matrix_io::MappedMatrix(path, true), std::runtime_error);
+
+        // change the row count without fixing the checksum
+        matrix_io::save(path, A);
+        patch_file(path, 16, "\x09", 1);
+        EXPECT_THROW(matrix_io::load(path), std::runtime_error);
+
+        // not a matrix file
+        patch_file(path, 0, "NOPE", 4);
+        EXPECT_THROW(matrix_io::load(path), std::runtime_error);
+
+        // cut off half way through the payload
+        matrix_io::save(path, A);
+        ASSERT_EQ(truncate(path.c_str(), 64 + 200), 0);
+        EXPECT_THROW(matrix_io::load(path), std::runtime_error);
+        std::remove(path.c_str());
+    }
+
+    TEST(MatrixIO, ConcurrentSaves) {
+        // every save has its own temporary, so whichever rename lands
+        // last, the file is one whole matrix and nothing is left behind
+        std::string dir = testing::TempDir() + "matrix_io_XXXXXX";
+        ASSERT_NE(mkdtemp(&dir[0]), nullptr);
+        std::string path = dir + "/m.bin";
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; t++) {
+            writers.emplace_back([&path, t]() {
+                for (int i = 0; i < 5; i++) {
+                    matrix_io::save(path, Matrix(64, 64, double(t)));
+                }
+            });
+        }
+        for (std::thread& w : writers) {
+            w.join();
+        }
+        matrix_io::MappedMatrix mapped(path, true);
+        double v = mapped.view()(0, 0);
+        EXPECT_TRUE(Matrix(mapped.view()) == Matrix(64, 64, v));
+
+        std::remove(path.c_str());
+        EXPECT_EQ(rmdir(dir.c_str()), 0);  // fails if a temporary was left
+    }
+
+    /* ======= scalar type tests ======= */
+
+    TEST(FloatMatrix, Basics) {
+        FloatMatrix A = {{1, 2}, {3, 4}};
+        FloatMatrix B(2, 2, 0.5f);
+        static_assert(std::is_same<decltype(A(0, 0)), float&>::value, "float storage");
+        // scalars are converted to the element type, so this stays float
+        static_assert(std::is_same<expr_value_t<decltype(A * 2.0)>, float>::value, "float expression");
+
+        FloatMatrix C = A + B * 2.0;
+        EXPECT_FLOAT_EQ(C(1, 1), 5.0f);
+        C -= A;
+        EXPECT_TRUE(C == FloatMatrix::ones(2, 2));
+        EXPECT_TRUE(A * FloatMatrix::identity(2) == A);
+        EXPECT_TRUE(A.transpose() == FloatMatrix({{1, 3}, {2, 4}}));
+        EXPECT_FLOAT_EQ(A.trace(), 5.0f);
+        EXPECT_NEAR(A.norm(), std::sqrt(30.0), 1e-12);
+        EXPECT_NEAR(A.determinant(), -2.0f, 1e-5);
+        EXPECT_TRUE(A * A.inverse() == FloatMatrix::identity(2));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(A.view().data()) % 64, 0u);
+
+        // converting goes through the expression constructor
+        Matrix D = A;
+        EXPECT_DOUBLE_EQ(D(1, 0), 3.0);
+        FloatMatrix E = D * 0.5;
+        EXPECT_FLOAT_EQ(E(1, 1), 2.0f);
+
+        // big enough for the simd kernels and the blocked product
+        Matrix X(70, 90), Y(90, 50);
+        fill_pattern(X, 1);
+        fill_pattern(Y, 2);
+        FloatMatrix Xf = X, Yf = Y;
+        EXPECT_TRUE(FloatMatrix(X * Y) == Xf * Yf);
+        EXPECT_TRUE(FloatMatrix(X + X) == Xf + Xf);
+        EXPECT_TRUE(FloatMatrix(X.block(3, 4, 20, 30) * Y.block(0, 1, 30, 5)) ==
+                    Xf.block(3, 4, 20, 30) * Yf.block(0, 1, 30, 5));
+        EXPECT_NEAR(Xf.norm(), X.norm(), 1e-4);
+    }
+
+    TEST(ComplexMatrix, Basics) {
+        using cd = std::complex<double>;
+        const cd i(0, 1);
+        ComplexMatrix A = {{cd(1, 1), 2}, {i, cd(0, -2)}};
+        ComplexMatrix B = A * i;
+        EXPECT_EQ(B(0, 0), cd(-1, 1));
+        EXPECT_EQ(B(1, 1), cd(2, 0));
+        EXPECT_TRUE(A == B / i);
+        EXPECT_EQ(A.trace(), cd(1, -1));
+        EXPECT_NEAR(A.norm(), std::sqrt(2.0 + 4.0 + 1.0 + 4.0), 1e-12);
+
+        ComplexMatrix P = A * A;
+        EXPECT_EQ(P(0, 0), cd(1, 1) * cd(1, 1) + 2.0 * i);
+        EXPECT_EQ(P(1, 1), 2.0 * i + cd(0, -2) * cd(0, -2));
+        EXPECT_TRUE(A * ComplexMatrix::identity(2) == A);
+        EXPECT_TRUE(A.transpose().transpose() == A);
+        EXPECT_THROW(A.solve(A), std::logic_error);
+
+        ComplexMatrix Big(40, 70), Other(70, 30);
+        for (size_t r = 0; r < 40; r++) {
+            for (size_t c = 0; c < 70; c++) {
+                Big(r, c) = cd(r % 5 - 2.0, c % 3 - 1.0);
+            }
+        }
+        for (size_t r = 0; r < 70; r++) {
+            for (size_t c = 0; c < 30; c++) {
+                Other(r, c) = cd(c % 7 * 0.5, r % 2 - 0.5);
+            }
+        }
+        ComplexMatrix prod = Big * Other;
+        cd expected = 0;
+        for (size_t k = 0; k < 70; k++) {
+            expected += Big(13, k) * Other(k, 17);
+        }
+        EXPECT_NEAR(std::abs(prod(13, 17) - expected), 0.0, 1e-9);
+    }
+
+    TEST(FloatMatrix, MixedPrecisionProduct) {
+        // long reductions of values near 1, where summing in float loses
+        // digits but the inputs themselves are exact floats
+        size_t m = 8, n = 8, k = 20000;
+        FloatMatrix A(m, k), B(k, n);
+        for (size_t r = 0; r < m; r++) {
+            for (size_t p = 0; p < k; p++) {
+                A(r, p) = 1.0f + float((r * 7 + p * 13) % 101) / 1024.0f;
+            }
+        }
+        for (size_t p = 0; p < k; p++) {
+            for (size_t c = 0; c < n; c++) {
+                B(p, c) = 1.0f - float((p * 11 + c * 3) % 97) / 2048.0f;
+            }
+        }
+        Matrix exact = Matrix(A) * Matrix(B);
+        FloatMatrix plain = A * B;
+        FloatMatrix mixed = multiply_mixed(A, B);
+        Matrix wide = multiply_mixed<double>(A, B);
+
+        double plain_err = 0, mixed_err = 0;
+        for (size_t r = 0; r < m; r++) {
+            for (size_t c = 0; c < n; c++) {
+                plain_err = std::max(plain_err, std::fabs(plain(r, c) - exact(r, c)) / exact(r, c));
+                mixed_err = std::max(mixed_err, std::fabs(mixed(r, c) - exact(r, c)) / exact(r, c));
+            }
+        }
+        // mixed only rounds once at the end, half an ulp of float
+        EXPECT_LE(mixed_err, 6e-8);
+        EXPECT_GT(plain_err, mixed_err);
+        EXPECT_TRUE(wide == exact);
+        EXPECT_THROW(multiply_mixed(A, A), std::invalid_argument);
+    }
+
+
+    /* ======= batched tests ======= */
+
+    // count matrices back to back, each stride apart, from fill_pattern
+    std::vector<double> pattern_batch(size_t count, size_t rows, size_t cols, size_t stride, int seed) {
+        std::vector<double> out(count * stride, -7.0);
+        for (size_t i = 0; i < count; i++) {
+            Matrix m(rows, cols);
+            fill_pattern(m, seed + int(i));
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t c = 0; c < cols; c++) {
+                    out[i * stride + r * cols + c] = m(r, c);
+                }
+            }
+        }
+        return out;
+    }
+
+    TEST(Batched, StridedMultiply) {
+        // 8x8 and something odd sized, both with a partial last group
+        for (size_t n : {8, 13}) {
+            size_t count = 45, stride = n * n + 3;
+            auto A = pattern_batch(count, n, n, stride, 1);
+            auto B = pattern_batch(count, n, n, stride, 50);
+            auto C = pattern_batch(count, n, n, stride, 99);
+            auto C0 = C;
+            batched::multiply<double>(count, n, n, n, 2.0, A.data(), n, stride,
+                                      B.data(), n, stride, 0.5, C.data(), n, stride);
+            for (size_t i = 0; i < count; i++) {
+                Matrix a(n, n), b(n, n), c0(n, n), c(n, n);
+                for (size_t r = 0; r < n; r++) {
+                    for (size_t j = 0; j < n; j++) {
+                        a(r, j) = A[i * stride + r * n + j];
+                        b(r, j) = B[i * stride + r * n + j];
+                        c0(r, j) = C0[i * stride + r * n + j];
+                        c(r, j) = C[i * stride + r * n + j];
+                    }
+                }
+                Matrix expected = a * b * 2.0 + c0 * 0.5;
+                EXPECT_TRUE(c == expected) << "matrix " << i << " of " << n << "x" << n;
+                // the gap between matrices is left alone
+                EXPECT_EQ(C[i * stride + n * n], -7.0);
+            }
+        }
+
+        // rectangular, float, beta 0 with garbage in C
+        size_t count = 20, m = 5, n = 3, k = 7;
+        std::vector<float> A(count * m * k), B(count * k * n), C(count * m * n, NAN);
+        for (size_t i = 0; i < A.size(); i++) A[i] = float(i % 11) - 5.0f;
+        for (size_t i = 0; i < B.size(); i++) B[i] = float(i % 7) * 0.5f;
+        batched::multiply<float>(count, m, n, k, 1.0f, A.data(), k, m * k,
+                                 B.data(), n, k * n, 0.0f, C.data(), n, m * n);
+        for (size_t i = 0; i < count; i++) {
+            for (size_t r = 0; r < m; r++) {
+                for (size_t c = 0; c < n; c++) {
+                    float expected = 0;
+                    for (size_t p = 0; p < k; p++) {
+                        expected += A[i * m * k + r * k + p] * B[i * k * n + p * n + c];
+                    }
+                    EXPECT_FLOAT_EQ(C[i * m * n + r * n + c], expected);
+                }
+            }
+        }
+    }
+
+    TEST(Batched, Interleaved) {
+        size_t count = 11, rows = 4, cols = 6;
+        auto A = pattern_batch(count, rows, cols, rows * cols, 3);
+        auto B = pattern_batch(count, cols, rows, cols * rows, 8);
+
+        auto IA = batched::Interleaved<double>::pack(count, rows, cols, A.data(), cols, rows * cols);
+        EXPECT_EQ(IA.count(), count);
+        EXPECT_EQ(IA.groups(), 2u);
+        EXPECT_EQ(IA(9, 2, 5), A[9 * rows * cols + 2 * cols + 5]);
+        std::vector<double> back(A.size());
+        IA.unpack(back.data(), cols, rows * cols);
+        EXPECT_EQ(back, A);
+
+        // product against the strided version
+        auto IB = batched::Interleaved<double>::pack(count, cols, rows, B.data(), rows, cols * rows);
+        batched::Interleaved<double> IC(1, 1, 1);
+        batched::multiply(IA, IB, IC);
+        EXPECT_EQ(IC.rows(), rows);
+        EXPECT_EQ(IC.cols(), rows);
+        std::vector<double> got(count * rows * rows), expected(count * rows * rows);
+        IC.unpack(got.data(), rows, rows * rows);
+        batched::multiply<double>(count, rows, rows, cols, 1.0, A.data(), cols, rows * cols,
+                                  B.data(), rows, cols * rows, 0.0, expected.data(), rows, rows * rows);
+        EXPECT_EQ(got, expected);
+
+        // transpose then add gives A^T + B elementwise
+        batched::Interleaved<double> IT(count, cols, rows), IS(count, cols, rows);
+        batched::transpose(IA, IT);
+        batched::add(IT, IB, IS);
+        for (size_t i = 0; i < count; i++) {
+            for (size_t r = 0; r < cols; r++) {
+                for (size_t c = 0; c < rows; c++) {
+                    EXPECT_EQ(IS(i, r, c), IA(i, c, r) + IB(i, r, c));
+                }
+            }
+        }
+
+        EXPECT_THROW(batched::multiply(IA, IA, IC), std::invalid_argument);
+        EXPECT_THROW(batched::add(IA, IB, IC), std::invalid_argument);
+        EXPECT_THROW(batched::transpose(IA, IA), std::invalid_argument);
+
+        // C cant be one of the inputs, square or not. C is left alone
+        EXPECT_THROW(batched::multiply(IC, IC, IC), std::invalid_argument);
+        EXPECT_THROW(batched::multiply(IA, IB, IA), std::invalid_argument);
+        EXPECT_THROW(batched::multiply(IA, IB, IB), std::invalid_argument);
+        std::vector<double> after(got.size());
+        IC.unpack(after.data(), rows, rows * rows);
+        EXPECT_EQ(after, expected);
+    }
+
+    TEST(Batched, StridedAddAndTranspose) {
+        size_t count = 30, rows = 5, cols = 9, ld = 12, stride = rows * ld;
+        auto A = pattern_batch(count, rows, ld, stride, 2);
+        auto B = pattern_batch(count, rows, ld, stride, 40);
+        std::vector<double> S(count * stride, -1.0), T(count * cols * rows, -1.0);
+        batched::add<double>(count, rows, cols, A.data(), ld, stride, B.data(), ld, stride,
+                             S.data(), ld, stride);
+        batched::transpose<double>(count, rows, cols, A.data(), ld, stride,
+                                   T.data(), rows, cols * rows);
+        for (size_t i = 0; i < count; i++) {
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t c = 0; c < ld; c++) {
+                    size_t at = i * stride + r * ld + c;
+                    // only the first cols of each row are part of the matrix
+                    EXPECT_EQ(S[at], c < cols ? A[at] + B[at] : -1.0);
+                    if (c < cols) {
+                        EXPECT_EQ(T[i * cols * rows + c * rows + r], A[at]);
+                    }
+                }
+            }
+        }
+    }
+
+
+    /* ======= Strassen tests ======= */
+
+    double max_abs_diff(const Matrix& a, const Matrix& b) {
+        double d = 0;
+        for (size_t r = 0; r < a.rows(); r++) {
+            for (size_t c = 0; c < a.cols(); c++) {
+                d = std::max(d, std::fabs(a(r, c) - b(r, c)));
+            }
+        }
+        return d;
+    }
+
+    TEST(Strassen, MatchesClassical) {
+        // 256 with cutoff 32 halves evenly 3 times, no padding
+        Matrix A(256, 256), B(256, 256);
+        fill_pattern(A, 1);
+        fill_pattern(B, 2);
+        Matrix expected = A * B;
+        EXPECT_LT(max_abs_diff(strassen::multiply<double>(A.view(), B.view(), 32), expected), 1e-11);
+
+        // odd rectangular sub-blocks, padded and with row strides
+        Matrix Big(300, 400);
+        fill_pattern(Big, 3);
+        auto L = Big.block(5, 7, 150, 203);
+        auto R = Big.block(40, 100, 203, 97);
+        Matrix classical = multiply<double>(L, R);
+        Matrix fast = strassen::multiply<double>(L, R, 16);
+        EXPECT_EQ(fast.rows(), 150u);
+        EXPECT_EQ(fast.cols(), 97u);
+        EXPECT_LT(max_abs_diff(fast, classical), 1e-11);
+
+        // below the cutoff it is just the blocked product
+        EXPECT_TRUE(strassen::multiply<double>(L, R) == classical);
+
+        FloatMatrix Af(A), Bf(B);
+        FloatMatrix pf = strassen::multiply<float>(Af.view(), Bf.view(), 32);
+        FloatMatrix cf = Af * Bf;
+        for (size_t r = 0; r < 256; r++) {
+            for (size_t c = 0; c < 256; c++) {
+                EXPECT_NEAR(pf(r, c), cf(r, c), 1e-2);
+            }
+        }
+
+        EXPECT_THROW(strassen::multiply<double>(L, L), std::invalid_argument);
+        EXPECT_THROW(strassen::multiply<double>(A.view(), B.view(), 8), std::invalid_argument);
+    }
+
+    TEST(Strassen, WorkspaceAndCutoff) {
+        size_t n = 128;
+        Matrix A(n, n), B(n, n), C(n, n);
+        fill_pattern(A, 4);
+        fill_pattern(B, 5);
+        Matrix expected = A * B;
+
+        // 2 levels: 64 x 64 + 64 x 64 then 32 x 32 + 32 x 32
+        strassen::Workspace<double> ws(n, n, n, 32);
+        EXPECT_EQ(ws.capacity(), 2u * 64 * 64 + 2u * 32 * 32);
+        EXPECT_EQ(strassen::Workspace<double>::required(n, n, n, 128), 0u);
+        const double* before = ws.data();
+        for (int i = 0; i < 3; i++) {
+            strassen::multiply(n, n, n, &A(0, 0), n, &B(0, 0), n, &C(0, 0), n, 32, 0, &ws);
+            EXPECT_LT(max_abs_diff(C, expected), 1e-11);
+        }
+        // smaller products fit and dont reallocate, bigger ones grow it
+        strassen::multiply(n / 2, n / 2, n / 2, &A(0, 0), n, &B(0, 0), n, &C(0, 0), n, 32, 0, &ws);
+        EXPECT_EQ(ws.data(), before);
+        ws.reserve(4 * n, 4 * n, 4 * n, 32);
+        EXPECT_GE(ws.capacity(), strassen::Workspace<double>::required(4 * n, 4 * n, 4 * n, 32));
+
+        size_t old = strassen::cutoff();
+        EXPECT_EQ(old, strassen::DEFAULT_CUTOFF);
+        strassen::set_cutoff(32);
+        EXPECT_EQ(strassen::Workspace<double>::required(n, n, n), 2u * 64 * 64 + 2u * 32 * 32);
+        EXPECT_LT(max_abs_diff(strassen::multiply<double>(A.view(), B.view()), expected), 1e-11);
+        EXPECT_THROW(strassen::set_cutoff(4), std::invalid_argument);
+        strassen::set_cutoff(old);
+    }
+
 } // namespace